@@ -0,0 +1,113 @@
+#ifndef __JAST_BYTECODE_H__
+#define __JAST_BYTECODE_H__
+
+#include <stdint.h>
+
+// Register bytecode of a checked P program, written by the parser with --emit-bytecode and run by pvm.
+//
+// Every function, and the program body as function 0, runs in a frame of untyped 8-byte registers:
+// its parameters and local variables first, at the slots semantic analysis bound them to, then the
+// temporaries of expressions. The instructions are typed, so a register holds a plain int, double,
+// string pointer or array pointer without a tag. A call passes its arguments in consecutive registers
+// at the top of the caller's frame, which become the first registers of the callee's frame, and the
+// result comes back in the first of them. Arrays live in memory apart from the registers, global ones
+// in the global array memory and local ones in an array area of the frame, one 8-byte cell per element.
+//
+// File: BcHeader, then nFuncs BcFunction, nReals doubles, nStringBytes bytes of '\0' terminated strings,
+// nInsts BcInst and nInsts int32_t source lines, all native-endian.
+#define BC_MAGIC			"JPBC"
+#define BC_VERSION			1
+
+// Operands: a, b, c are registers, imm is a 32-bit immediate in place of b and c. Jumps are relative
+// to the next instruction. Booleans are 0 or 1 in the int of a register.
+typedef enum BcOp {
+	kBcNop = 0,
+	kBcHalt,			// end of the program body.
+	kBcMove,			// a = b
+	kBcLoadInt,			// a = imm, sign-extended over all 8 bytes, so 0 is also 0.0 and an empty string.
+	kBcLoadReal,		// a = reals[imm]
+	kBcLoadStr,			// a = the string at offset imm of the strings.
+	kBcGetGlobal,		// a = globals[imm]
+	kBcSetGlobal,		// globals[imm] = a
+	kBcLocalArray,		// a = address of cell imm of the frame's array area.
+	kBcGlobalArray,		// a = address of cell imm of the global array memory.
+	kBcClearArray,		// zero imm cells from address a.
+	kBcCheckIndex,		// stop with an error unless 0 <= a < imm.
+	kBcLoadElem,		// a = b[c]
+	kBcStoreElem,		// a[b] = c
+	kBcAddInt, kBcSubInt, kBcMulInt, kBcDivInt, kBcModInt,		// a = b op c
+	kBcNegInt,			// a = -b
+	kBcAddIntK,			// a = b + (int16_t)c
+	kBcAddReal, kBcSubReal, kBcMulReal, kBcDivReal,
+	kBcNegReal,
+	kBcIntToReal,		// a = (double)b
+	kBcLtInt, kBcLeInt, kBcEqInt, kBcGeInt, kBcGtInt, kBcNeInt,
+	kBcLtReal, kBcLeReal, kBcEqReal, kBcGeReal, kBcGtReal, kBcNeReal,
+	kBcAnd, kBcOr,
+	kBcNot,				// a = !b
+	kBcConcat,			// a = b followed by c, a new string.
+	kBcJump,			// jump by imm.
+	kBcJumpTrue,		// jump by imm if a.
+	kBcJumpFalse,		// jump by imm unless a.
+	kBcCall,			// call function b with c arguments from register a on, the result goes to a.
+	kBcReturn,			// return a.
+	kBcReturnVoid,
+	kBcPrintInt, kBcPrintReal, kBcPrintBool, kBcPrintStr,		// print a and a newline.
+	kBcReadInt, kBcReadReal, kBcReadBool, kBcReadStr,			// read a from stdin.
+	kBcOps
+} BcOp_t;
+
+struct BcInst {
+	uint16_t nOp;
+	uint16_t a;
+	union {
+		struct {
+			uint16_t b;
+			uint16_t c;
+		};
+		int32_t imm;
+	};
+};
+
+// Value of a register or array cell.
+union BcValue {
+	int32_t n;
+	double d;
+	const char *psz;		// NULL is the empty string.
+	BcValue *p;
+	int64_t raw;
+};
+
+struct BcHeader {
+	char pszMagic[4];
+	int32_t nVersion;
+	int32_t nFuncs;
+	int32_t nGlobals;			// global registers, one per global symbol.
+	int32_t nGlobalCells;		// cells of global arrays.
+	int32_t nReals;
+	int32_t nStringBytes;
+	int32_t nInsts;
+};
+
+struct BcFunction {
+	int32_t nEntry;				// first instruction.
+	int32_t nParams;
+	int32_t nRegs;				// frame registers, parameters and locals included.
+	int32_t nArrayCells;		// cells of the local arrays.
+	int32_t nReturnType;		// SymbolValue_t, kVoid for a procedure and the program body.
+	int32_t nName;				// offset of the name in the strings.
+};
+
+#define BC_MAX_REGS			65535
+
+// A program in memory, the parts of a bytecode file.
+struct BcImage {
+	BcHeader oHeader;
+	const BcFunction *pFuncs;
+	const double *pReals;
+	const char *pStrings;
+	const BcInst *pCode;
+	const int32_t *pLines;
+};
+
+#endif //__JAST_BYTECODE_H__
@@ -2,19 +2,72 @@
 #ifndef __JAST_H__
 #define __JAST_H__
 
+#include <stddef.h>
+
+// Symbol values for kinds, types and operators, shared by the parser, the AST and the symbol table.
+typedef enum SymbolValue { 
+	kUnknown = -1, kProgram = 0, kFunction, kParameter, kVariable, kLoopVar, kConstant, kInteger, kReal, kBoolean, kString, kVoid,
+	kADD, kMINUS, kMULTIPLY, kDIVIDE, kNEG, kMOD, kAND, kOR, kNOT, kLT, kLE, kEQ, kGE, kGT, kNE, kSTRCAT
+} SymbolValue_t;
+
+// Kind of an expression node, decided once on construction.
+typedef enum ExprKind {
+	kExprBinary = 0, kExprUnary, kExprConstant, kExprVariableRef, kExprFunctionInvocation
+} ExprKind_t;
+
+// Kind of an AST node, set by its constructor.
+typedef enum AstKind {
+	kAstId = 0, kAstIntValue, kAstType, kAstLiteral, kAstProgram, kAstDeclaration, kAstExpression, kAstCompoundStatement,
+	kAstPrint, kAstVariableRef, kAstAssign, kAstRead, kAstFunctionInvocation, kAstFunction, kAstCondition, kAstWhile,
+	kAstReturn, kAstFor, kAstEpsilon, kAstKinds
+} AstKind_t;
+
+// Diagnostic codes, see the message table in Diag.cpp.
+typedef enum DiagCode {
+	kDiagSyntax, kDiagPrintNotScalar, kDiagUndeclared, kDiagNotVariable, kDiagIndexNotInteger, kDiagOverSubscript,
+	kDiagArrayAssign, kDiagAssignConstant, kDiagAssignLoopVar, kDiagAssignIncompatible, kDiagReadNotScalar, kDiagReadConstant,
+	kDiagRedeclared, kDiagArrayIndexNotPositive, kDiagUnaryOperand, kDiagBinaryOperands, kDiagCallNonFunction,
+	kDiagArgumentCount, kDiagArgumentType, kDiagConditionNotBoolean, kDiagReturnFromProcedure, kDiagReturnType,
+	kDiagLoopBounds, kDiagBadCharacter, kDiagCodes
+} DiagCode_t;
+
 struct Location {
     int line;
     int col;
 };
 
+// Value of an expression in the tree-walking interpreter, read as the nResultType of the expression.
+union EvalValue {
+	int n;					// integer, and boolean as 0 or 1.
+	double d;
+	const char *psz;		// NULL is the empty string.
+	EvalValue *p;			// cells of an array variable.
+};
+
 // AST node with a pointer "pBody" pointing to the non-terminal struct associated with the tree node.
 struct AstNode {
 	int  (*print)(AstNode *ptr, int);
 	int  (*visit)(AstNode *ptr);
 	int  (*codegen)(AstNode *ptr);
+	EvalValue (*eval)(AstNode *ptr);
 	void *pBody;
 	AstNode *pNext;
 	Location location;
+	AstKind_t nKind;
+};
+
+// Head and tail of a link list of AstNode, so that appending to the list needs no walk to its end.
+struct AstList {
+	AstNode *pHead;
+	AstNode *pTail;
+};
+
+// Copy of the stdout bytes and stderr records of an output capture, written out later in order.
+struct OutCapture {
+	char *pOut;
+	size_t nOut;
+	char *pErr;
+	size_t nErr;
 };
 
 #endif //__JAST_H__
\ No newline at end of file
@@ -12,17 +12,19 @@ extern int PrintAstNode(AstNode *pAst, int nLevel);
 extern int VisitAstNode(AstNode *pAst);
 extern int CodeGenAstNode(AstNode *pAst);
 extern AstNode *AddSiblingNode(AstNode *pNode, AstNode *pSibling);
+extern AstList NewAstList(AstNode *pFirstNode);
+extern AstList AppendAstList(AstList oList, AstNode *pNode);
 
 // extern from jProgram.cpp
 extern AstNode *NewProgramNode(int nLine, int nCol, const char *pszProgName, AstNode *pFirstDeclarationNode, AstNode *pFirstFunctionNode, AstNode *pCompoundStatementNode);
 
 // extern from jDeclaration.cpp
-extern AstNode *NewDeclarationNode_Type(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pTypeNode, const char *pszKind);
+extern AstNode *NewDeclarationNode_Type(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pTypeNode, SymbolValue_t nKind);
 extern AstNode *NewDeclarationNode_LiteralConstant(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pLiteralNode);
 
 // extern from jType.cpp
-extern AstNode *NewScalerTypeNode(int nLine, int nCol, const char *pszType);
-extern AstNode *NewArrTypeNode(int nLine, int nCol, AstNode *pFirstIntNode, const char *pszType);
+extern AstNode *NewScalerTypeNode(int nLine, int nCol, SymbolValue_t nType);
+extern AstNode *NewArrTypeNode(int nLine, int nCol, AstNode *pFirstIntNode, SymbolValue_t nType);
 extern AstNode *NewIdNode(int nLine, int nCol, const char *pszName);
 extern AstNode *NewIntValueNode(int nLine, int nCol, int n);
 
@@ -33,7 +35,8 @@ extern AstNode *NewLiteralStringNode(int nLine, int nCol, const char *pszStr);
 extern AstNode *NewLiteralBooleanNode(int nLine, int nCol, bool nBoolean);
 
 // extern froom jExpression.cpp
-extern AstNode *NewExpressionNode(int nLine, int nCol, const char *pszOp, AstNode *pLeftNode, AstNode *pRightNode);
+extern AstNode *NewExpressionNode(int nLine, int nCol, SymbolValue_t nOp, AstNode *pLeftNode, AstNode *pRightNode);
+extern AstNode *NewOperandNode(int nLine, int nCol, ExprKind_t nKind, AstNode *pOperandNode);
 
 // extern froom jCompoundStatement.cpp
 extern AstNode *NewCompoundStatementNode(int nLine, int nCol, AstNode *pFirstDeclarationNode, AstNode *pFirstStatementNode);
@@ -55,5 +58,58 @@ extern AstNode *NewFunctionNode(int nLine, int nCol, const char *pszFuncName, As
 // extern froom SymTab.cpp
 extern void SymTab_Init();
 extern void SymTab_EnableDump(bool bEnable);
+extern void SymTab_Release();
+
+// extern froom Arena.cpp
+extern void Arena_Release();
+
+// extern froom StrPool.cpp
+extern const char *StrPool_Intern(const char *psz);
+extern const char *StrPool_InternN(const char *psz, int n);
+extern void StrPool_Release();
+
+// extern froom AstBin.cpp
+extern int AstBin_Save(AstNode *pRoot, const char *pszFile);
+extern AstNode *AstBin_Load(const char *pszFile);
+
+// extern froom IncCache.cpp
+extern void IncCache_Open(const char *pszFile);
+extern int IncCache_Save();
+extern void IncCache_Release();
+extern bool IncCache_IsOpen();
+
+// extern froom WorkPool.cpp
+extern void WorkPool_SetJobs(int nJobs);
+extern int  WorkPool_GetJobs();
+extern void WorkPool_Run(int nItems, void (*funcItem)(int, void*), void (*funcThread)(bool, void*), void *pArg);
+
+// extern froom OutBuf.cpp
+extern void OutBuf_Printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+extern void OutBuf_ErrPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+extern void OutBuf_Flush();
+extern void OutBuf_BeginCapture();
+extern void OutBuf_TakeCapture(OutCapture *pCapture);
+extern void OutBuf_EmitCapture(OutCapture *pCapture);
+extern void OutBuf_Release();
+
+// extern froom Diag.cpp
+extern void Diag_SetJson(bool bJson);
+extern void Diag_SetFile(const char *pszFile);
+extern void Diag_Report(int nLine, int nCol, DiagCode_t nCode, ...);
+extern void Diag_Flush();
+extern void Diag_Release();
+
+// extern froom Eval.cpp
+extern int  Eval_Run(AstNode *pRoot);
+
+// extern froom ByteCode.cpp
+extern int  ByteCode_Generate(AstNode *pRoot);
+extern int  ByteCode_Save(const char *pszFile);
+extern void ByteCode_Dump();
+extern void ByteCode_Release();
+
+// extern froom Native.cpp
+extern int  Native_EmitAsm(const char *pszFile);
+extern int  Native_Build(const char *pszExe);
 
 #endif //__JAST_API_H__
@@ -2,33 +2,35 @@
 #ifndef __JAST_INTERNAL_H__
 #define __JAST_INTERNAL_H__
 
+#include <stddef.h>
+#include <stdarg.h>
+#include <new>
 #include "jast.h"
+#include "bytecode.h"
 
 // -----------------------------------------------------------------
-// Definition struct and constants for symbol table.
+// Definition struct for symbol table.
 // -----------------------------------------------------------------
-typedef enum SymbolValue { 
-	kUnknown = -1, kProgram = 0, kFunction, kParameter, kVariable, kLoopVar, kConstant, kInteger, kReal, kBoolean, kString, kVoid,
-	kADD, kMINUS, kMULTIPLY, kDIVIDE, kNEG, kMOD, kAND, kOR, kNOT, kLT, kLE, kEQ, kGE, kGT, kNE, kSTRCAT
-} SymbolValue_t;
-
 typedef struct Symbol {
 	int nLevel;
-	char *pszName;
-	char *pszKind;
-	char *pszScalerType;
-	char *pszTypeStr;
-	char *pszAttr;
+	const char *pszName;
+	const char *pszKind;
+	const char *pszScalerType;
+	const char *pszTypeStr;
+	const char *pszAttr;
 	SymbolValue_t nSymKind;
 	SymbolValue_t nSymType;
 	AstNode *pAst;			// FunctionNode if nSymKind == kFunction, else TypeNode, or ProgramNode for kProgram.
+	int nShadow;			// index of the outer symbol with the same name hidden by this one, -1 if none.
 } Symbol_t;
 
 // -----------------------------------------------------------------
 // Definition struct for each non-terminal content body.
 // -----------------------------------------------------------------
 struct IdNode {
-	const char *pszName;
+	const char *pszName;			// interned by StrPool.
+	int nLevel;						// filled by visit() of a declaration, scope level and slot of the symbol,
+	int nSlot;						// see VariableRefNode, -1 if it was not entered.
 };
 
 struct IntValueNode {
@@ -71,8 +73,10 @@ struct ExpressionNode {
 	const char *pszOp;				// string of math operator, or indicating special operand with "constant", "VariableReference", or "FunctionInvocation".
 	AstNode *pLeftNode;	
 	AstNode *pRightNode;
+	ExprKind_t nKind;				// operator or operand kind, visitors switch on it instead of comparing pszOp.
 	SymbolValue_t nOp;				// symbol value for the operator. 
 	SymbolValue_t nResultType;		// filled by visit(), the resultant type of this expression after calculation.
+	const char *pszTypeStr;			// type string of an array result, set by GetArrayTypeString() on first use.
 };
 
 struct CompoundStatementNode {
@@ -88,11 +92,13 @@ struct FunctionInvocationNode {
 	const char *pszFuncName;
 	AstNode *pFirstExpressionNode; 	// a link list of ExpressionNode.
 	SymbolValue_t nReturnType;		// filled by visit(), symbol value of the return type.
+	AstNode *pFuncNode;				// filled by visit() of a valid call, FunctionNode of the callee.
 };
 
 struct FunctionNode {
 	const char *pszFuncName;
 	const char *pszReturnType;		// if pReturnTypeNode == NULL, pszReturnType is "void".
+	SymbolValue_t nReturnType;		// symbol value of the return type, kVoid for a procedure.
 	const char *pszParamTypeStr;	// string of the function's parameter types for printing.
 	AstNode *pFirstArgDeclNode; 	// a link list of DeclarationNode for each declaration in formal parameter list.
 	AstNode *pFirstArgTypeNode;		// a link list of Typde Node for type of each formal parameter.
@@ -104,6 +110,10 @@ struct VariableRefNode {
 	const char *pszVarName;
 	AstNode *pFirstArrRefNode; 		// a link list of ExpressionNode.
 	SymbolValue_t nVarType;			// filled by visit(), symbol value of the type of the referenced variable.
+	// Binding, filled by visit() of a valid reference, so later passes need no symbol table:
+	AstNode *pTypeNode;				// TypeNode of the declaration the name resolved to.
+	int nLevel;						// scope level of the variable, 0 for globals.
+	int nSlot;						// index among the globals, or in the frame of the enclosing function, see SymTab_GetSlot().
 };
 
 struct AssignNode {
@@ -143,32 +153,48 @@ struct ForNode {
 };
 
 // extern from jast.cpp
-extern AstNode *NewAstNode(int nLine, int nCol, void *pBody, int (*funcPrint)(AstNode*, int), int (*funcVisit)(AstNode*), int (*funcCodeGen)(AstNode*));
+extern AstNode *NewAstNode(int nLine, int nCol, AstKind_t nKind, void *pBody, int (*funcPrint)(AstNode*, int), int (*funcVisit)(AstNode*), int (*funcCodeGen)(AstNode*), EvalValue (*funcEval)(AstNode*));
 extern AstNode *DupAstNode(AstNode *pAst);
 extern AstNode *AddSiblingNode(AstNode *pNode, AstNode *pSibling);
-extern void ErrorMessage(AstNode *pAst, const char *format, ...);
+extern AstList NewAstList(AstNode *pFirstNode);
+extern AstList AppendAstList(AstList oList, AstNode *pNode);
+extern void ErrorMessage(AstNode *pAst, DiagCode_t nCode, ...);
 extern void PrintLeadingTabs(int nTab);
+extern void PrintNodeLine(int nLevel, const char *pszWhat, int nLine, int nCol, const char *pszArg1 = NULL, const char *pszArg2 = NULL, const char *pszArg3 = NULL);
+extern int  FormatInt(char *pszBuf, int n);
 extern int  PrintAstNode(AstNode *pAst, int nLevel);
 extern int  PrintAstList(AstNode *pFirstAst, int nLevel);
 extern int  VisitAstNode(AstNode *pAst);
 extern int  VisitAstList(AstNode *pFirstAst, bool bErrorBreak);
 extern int  CodeGenAstNode(AstNode *pAst);
 extern int  CodeGenAstList(AstNode *pFirstAst);
+extern EvalValue EvalAstNode(AstNode *pAst);
+extern void EvalAstList(AstNode *pFirstAst);
 extern int  AstLinkLength(AstNode *pFirstNode);
+extern void ForEachAstNode(AstNode *pAst, void (*func)(AstNode*, void*), void *pArg);
+extern int  CountSlots(AstNode *pScope, bool bGlobals);
 extern int  SearchStringItem(const char *pszItem, const char *ppszItems[]);
 extern bool InSymbolValueSet(SymbolValue_t nSymbol, const SymbolValue_t pnSymbols[]);
 extern SymbolValue_t GetSymbolValue(const char *pszSymbol);
 extern const char *GetSymbolString(SymbolValue_t n);
 extern const char *GetArrayTypeString(AstNode *pAst);
 
+// extern from jType.cpp
+extern const char *InternArrayTypeString(const char *pszScalerType, AstNode *pFirstIntNode);
+
+// extern from jFunction.cpp
+extern int  VisitFunctionSignature(AstNode *pAst);
+extern int  VisitFunctionBody(AstNode *pAst);
+
 // extern from SymTab.cpp
 extern void SymTab_Init();
 extern void SymTab_Release();
 extern int  SymTab_Push();
 extern int  SymTab_Pop();
-extern int  SymTab_Insert(const char *pszName, const char *pszKind, const char *pszScalerType, const char *pszTypeStr, const char *pszAttr, AstNode *pAst);
+extern int  SymTab_Insert(const char *pszName, SymbolValue_t nKind, SymbolValue_t nScalerType, const char *pszTypeStr, const char *pszAttr, AstNode *pAst);
 extern int  SymTab_Lookup(const char *pszName);
 extern int 	SymTab_GetLevel(int n);
+extern int 	SymTab_GetSlot(int n);
 extern const char *SymTab_GetName(int n);
 extern const char *SymTab_GetKind(int n);
 extern const char *SymTab_GetScalerType(int n);
@@ -178,6 +204,110 @@ extern SymbolValue_t SymTab_GetKindValue(int n);
 extern SymbolValue_t SymTab_GetTypeValue(int n);
 extern AstNode *SymTab_GetAstNode(int n);
 extern void SymTab_Dump();
+extern bool SymTab_IsDumpEnabled();
 extern int 	SymTab_GetCurrStackLevel();
+extern int 	SymTab_GetCount();
+extern void SymTab_EnableDump(bool bEnable);
+extern void SymTab_ShareGlobals();
+extern void SymTab_SetGlobalView(int nCount);
+
+// extern from Arena.cpp
+struct Arena;
+extern void *Arena_Alloc(size_t nSize);
+extern char *Arena_AllocChars(size_t nSize);
+extern Arena *Arena_GetCurrent();
+extern void Arena_Use(Arena *pArena);
+extern void Arena_SetShared(bool bShared);
+extern void Arena_Release();
+
+// Construct a node body or AstNode in the per-compilation arena.
+template <typename T> T *Arena_New() { return new (Arena_Alloc(sizeof(T))) T; }
+
+// extern from StrPool.cpp
+extern const char *StrPool_Intern(const char *psz);
+extern const char *StrPool_InternN(const char *psz, int n);
+struct StrPool;
+extern StrPool *StrPool_GetCurrent();
+extern void StrPool_Use(StrPool *pPool);
+extern void StrPool_SetShared(bool bShared);
+extern void StrPool_Release();
+
+// extern from AstBin.cpp
+extern const char *AstBin_Serialize(AstNode *pAst, size_t *pnSize);
+extern void AstBin_Release();
+
+// extern from IncCache.cpp
+extern bool IncCache_IsOpen();
+extern bool IncCache_Replay(AstNode *pFunc, int *pnErr);
+extern void IncCache_Begin(AstNode *pFunc);
+extern void IncCache_End(AstNode *pFunc, int nErr);
+
+// extern from WorkPool.cpp
+extern int  WorkPool_GetJobs();
+extern void WorkPool_Run(int nItems, void (*funcItem)(int, void*), void (*funcThread)(bool, void*), void *pArg);
+
+// extern from OutBuf.cpp
+extern char *OutBuf_Reserve(size_t nMore);
+extern void OutBuf_Commit(size_t n);
+extern void OutBuf_Write(const char *p, size_t n);
+extern void OutBuf_Puts(const char *psz);
+extern void OutBuf_Printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+extern void OutBuf_Flush();
+extern void OutBuf_ErrWrite(const char *p, size_t n);
+extern void OutBuf_ErrVPrintf(const char *format, va_list args);
+extern void OutBuf_ErrPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+extern void OutBuf_BeginCapture();
+extern void OutBuf_EndCapture(const char **ppOut, size_t *pnOut, const char **ppErr, size_t *pnErr);
+extern void OutBuf_DropCapture();
+extern bool OutBuf_Replay(const char *pOut, size_t nOut, const char *pErr, size_t nErr);
+extern void OutBuf_TakeCapture(OutCapture *pCapture);
+extern void OutBuf_EmitCapture(OutCapture *pCapture);
+extern void OutBuf_Release();
+
+// extern from Diag.cpp
+extern void Diag_VReport(int nLine, int nCol, DiagCode_t nCode, va_list args);
+extern void Diag_Report(int nLine, int nCol, DiagCode_t nCode, ...);
+extern size_t Diag_Mark();
+extern const char *Diag_Since(size_t nMark, size_t *pnBytes);
+extern void Diag_Truncate(size_t nMark);
+extern bool Diag_Append(const char *p, size_t nBytes);
+extern void Diag_Flush();
+extern void Diag_Release();
+
+// extern from Eval.cpp
+extern void Eval_Error(AstNode *pAst, const char *format, ...) __attribute__((format(printf, 2, 3), noreturn));
+extern EvalValue *Eval_Variable(int nLevel, int nSlot);
+extern EvalValue *Eval_NewArray(AstNode *pTypeNode, int nSlot);
+extern EvalValue *Eval_PushArgs(AstNode *pCall, int nArgs);
+extern EvalValue Eval_Call(AstNode *pCall, AstNode *pFunc, EvalValue *pArgs);
+extern SymbolValue_t Eval_GetReturnType();
+extern void Eval_Return(EvalValue oValue);
+extern bool Eval_IsReturning();
+extern const char *Eval_Concat(const char *pszLeft, const char *pszRight);
+extern void Eval_Print(SymbolValue_t nType, EvalValue oValue);
+extern EvalValue Eval_Read(AstNode *pAst, SymbolValue_t nType);
+
+// extern from ByteCode.cpp
+extern int  ByteCode_FunctionIndex(AstNode *pFunc);
+extern void ByteCode_BeginFunction(int nFunc, AstNode *pScope, int nParams, SymbolValue_t nReturnType, const char *pszName);
+extern void ByteCode_EndFunction();
+extern SymbolValue_t ByteCode_GetReturnType();
+extern void ByteCode_SetLine(int nLine);
+extern int  ByteCode_Emit(BcOp_t nOp, int a, int b, int c);
+extern int  ByteCode_EmitImm(BcOp_t nOp, int a, int nImm);
+extern int  ByteCode_Here();
+extern void ByteCode_JumpTo(BcOp_t nOp, int a, int nTarget);
+extern void ByteCode_PatchJump(int nInst);
+extern int  ByteCode_NewTemp();
+extern int  ByteCode_GetTop();
+extern void ByteCode_SetTop(int nTop);
+extern bool ByteCode_IsTemp(int nReg);
+extern void ByteCode_MoveTo(int nDest, int nReg);
+extern int  ByteCode_IntToReal(int nReg);
+extern int  ByteCode_RealConst(double d);
+extern int  ByteCode_StrConst(const char *psz);
+extern int  ByteCode_ArrayCells(TypeNode *pType);
+extern int  ByteCode_ArrayAddress(AstNode *pTypeNode, int nLevel, int nSlot);
+extern void ByteCode_GetImage(BcImage *pImage);
 
 #endif //__JAST_INTERNAL_H__
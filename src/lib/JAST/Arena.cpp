@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include "JAST/jast_internal.h"
+
+#define ARENA_CHUNK_SIZE	(256 * 1024)
+#define ARENA_ALIGN			16
+
+// Per-compilation arena: AST nodes, node bodies and pooled strings are carved out of big chunks
+// and never freed one by one, Arena_Release() drops everything at the end of a compilation.
+// Every thread compiles into an arena of its own; worker threads helping with one compilation
+// use the arena of the thread that owns it through Arena_Use(), serialized by its lock.
+struct ArenaChunk {
+	ArenaChunk *pPrev;
+	size_t nUsed;
+	size_t nSize;
+	alignas(ARENA_ALIGN) char pData[ARENA_ALIGN];
+};
+
+struct Arena {
+	ArenaChunk *pChunk;
+	bool bShared;			// other threads allocate too, take the lock.
+	std::mutex oLock;
+};
+
+thread_local Arena g_oArena;			// arena of the compilation on this thread.
+thread_local Arena *g_pArena = NULL;	// arena of another thread in use, or NULL for g_oArena.
+
+static inline Arena *current_arena()
+{
+	return g_pArena ? g_pArena : &g_oArena;
+}
+
+// Allocate nSize bytes aligned to nAlign (a power of 2 up to ARENA_ALIGN) from an arena.
+static void *alloc_in(Arena *pArena, size_t nSize, size_t nAlign)
+{
+	ArenaChunk *p = pArena->pChunk;
+	size_t nChunk;
+	void *pMem;
+
+	if (p)
+		p->nUsed = (p->nUsed + nAlign - 1) & ~(nAlign - 1);
+	if (!p || p->nUsed + nSize > p->nSize){
+		nChunk = (nSize > ARENA_CHUNK_SIZE) ? nSize : ARENA_CHUNK_SIZE;
+		p = (ArenaChunk *)malloc(offsetof(ArenaChunk, pData) + nChunk);
+		p->pPrev = pArena->pChunk;
+		p->nUsed = 0;
+		p->nSize = nChunk;
+		pArena->pChunk = p;
+	}
+	pMem = p->pData + p->nUsed;
+	p->nUsed += nSize;
+	return pMem;
+}
+
+// Allocate from the current arena of this thread.
+static void *arena_alloc(size_t nSize, size_t nAlign)
+{
+	Arena *pArena = current_arena();
+
+	if (pArena->bShared){
+		std::lock_guard<std::mutex> oLock(pArena->oLock);
+		return alloc_in(pArena, nSize, nAlign);
+	}
+	return alloc_in(pArena, nSize, nAlign);
+}
+
+// Allocate nSize bytes for a node or node body.
+void *Arena_Alloc(size_t nSize)
+{
+	return arena_alloc(nSize, ARENA_ALIGN);
+}
+
+// Allocate nSize bytes for characters, packed without alignment.
+char *Arena_AllocChars(size_t nSize)
+{
+	return (char *)arena_alloc(nSize, 1);
+}
+
+// Get the arena this thread allocates from, to hand it to worker threads.
+Arena *Arena_GetCurrent()
+{
+	return current_arena();
+}
+
+// Allocate from the arena of another thread, or from the own one again with NULL.
+void Arena_Use(Arena *pArena)
+{
+	g_pArena = (pArena == &g_oArena) ? NULL : pArena;
+}
+
+// Turn the lock of the current arena on while more than one thread may allocate from it.
+void Arena_SetShared(bool bShared)
+{
+	current_arena()->bShared = bShared;
+}
+
+// Release every allocation of the own arena of this thread at once.
+void Arena_Release()
+{
+	ArenaChunk *p;
+
+	while((p = g_oArena.pChunk)){
+		g_oArena.pChunk = p->pPrev;
+		free(p);
+	}
+}
@@ -0,0 +1,724 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "JAST/jast_api.h"
+#include "JAST/jast_internal.h"
+
+// extern from scanner.l
+extern const char *LexGetSourceCode(int nLine, int *pnLeng);
+extern void LexKeepSourceLine(const char *text, size_t len);
+
+// Binary AST file, all numbers are zigzag varints (7 bits a byte, low bits first), reals are native doubles:
+//   header:  "JAST", version, flags, number of strings, number of nodes, number of source lines, root node
+//   strings: length and characters (no '\0') of every interned string, referred to by index
+//   nodes:   kind, line, col, previous sibling, then the fields of the kind, children referred to by index
+//   lines:   length and characters of every source line, for error messages
+// Nodes are written children first, so a loader can rebuild each node with its constructor in one pass.
+// A list is stored as its head and a previous-sibling index in every element after the head; -1 means NULL.
+// Nodes derived by constructors (for-loop declaration, function argument types) are not stored,
+// neither are debug-only epsilon nodes, which the parser never builds.
+#define AST_BIN_MAGIC		"JAST"
+#define AST_BIN_VERSION		1
+#define AST_BIN_DUMP_ON_POP	1		// flags: //&D+ was in effect at the end of the source.
+#define MIN_BIN_SIZE		(64 * 1024)
+#define MIN_STR_SLOTS		1024
+
+// ----------------------------------------------------------------
+// Save
+// ----------------------------------------------------------------
+// Save and load state is per thread, like the compilation it belongs to.
+thread_local char *g_pBinOut = NULL;
+thread_local size_t g_nBinOutUsed = 0;
+thread_local size_t g_nBinOutSize = 0;
+
+// Index of interned string pointers, open addressing like the symbol table.
+struct BinStrSlot {
+	const char *psz;
+	int nIndex;
+};
+thread_local BinStrSlot *g_pBinStrSlots = NULL;
+thread_local int g_nBinStrSlots = 0;
+thread_local const char **g_ppszBinStrs = NULL;
+thread_local int g_nBinStrs = 0;
+thread_local int g_nBinNodes = 0;
+
+static void put_bytes(const void *p, size_t n)
+{
+	size_t nSize = g_nBinOutSize ? g_nBinOutSize : MIN_BIN_SIZE;
+
+	if (g_nBinOutUsed + n > g_nBinOutSize){
+		while(nSize < g_nBinOutUsed + n)
+			nSize *= 2;
+		g_pBinOut = (char *)realloc(g_pBinOut, nSize);
+		g_nBinOutSize = nSize;
+	}
+	memcpy(g_pBinOut + g_nBinOutUsed, p, n);
+	g_nBinOutUsed += n;
+}
+
+static void put_int(int n)
+{
+	unsigned char pBytes[5];
+	uint32_t u = ((uint32_t)n << 1) ^ (uint32_t)(n >> 31);
+	int i = 0;
+
+	while(u >= 0x80){
+		pBytes[i++] = (unsigned char)(u | 0x80);
+		u >>= 7;
+	}
+	pBytes[i++] = (unsigned char)u;
+	put_bytes(pBytes, i);
+}
+
+static unsigned int hash_pointer(const char *psz)
+{
+	uintptr_t n = (uintptr_t)psz;
+	return (unsigned int)((n ^ (n >> 15)) * 2654435761u);
+}
+
+// Get the string table index of the input string, adding it to the table if it is new.
+static int string_index(const char *psz)
+{
+	unsigned int i, nMask;
+	int j, nOld = g_nBinStrSlots;
+	BinStrSlot *pOld = g_pBinStrSlots;
+
+	if ((g_nBinStrs + 1) * 2 > g_nBinStrSlots){
+		g_nBinStrSlots = nOld ? nOld * 2 : MIN_STR_SLOTS;
+		g_pBinStrSlots = (BinStrSlot *)calloc(g_nBinStrSlots, sizeof(BinStrSlot));
+		g_ppszBinStrs = (const char **)realloc(g_ppszBinStrs, g_nBinStrSlots / 2 * sizeof(const char *));
+		nMask = g_nBinStrSlots - 1;
+		for(j = 0; j < nOld; j++){
+			if (!pOld[j].psz)
+				continue;
+			for(i = hash_pointer(pOld[j].psz) & nMask; g_pBinStrSlots[i].psz; i = (i + 1) & nMask)
+				;
+			g_pBinStrSlots[i] = pOld[j];
+		}
+		free(pOld);
+	}
+	nMask = g_nBinStrSlots - 1;
+	for(i = hash_pointer(psz) & nMask; g_pBinStrSlots[i].psz; i = (i + 1) & nMask){
+		if (g_pBinStrSlots[i].psz == psz)
+			return g_pBinStrSlots[i].nIndex;
+	}
+	g_pBinStrSlots[i].psz = psz;
+	g_pBinStrSlots[i].nIndex = g_nBinStrs;
+	g_ppszBinStrs[g_nBinStrs] = psz;
+	return g_nBinStrs++;
+}
+
+// Empty the save buffer and string table, keeping their memory.
+static void reset_save()
+{
+	if (g_pBinStrSlots)
+		memset(g_pBinStrSlots, 0, g_nBinStrSlots * sizeof(BinStrSlot));
+	g_nBinOutUsed = 0;
+	g_nBinStrs = g_nBinNodes = 0;
+}
+
+static int save_node(AstNode *pAst, int nPrev);
+
+// Save the elements of a list in order and return the index of its head.
+static int save_list(AstNode *pFirst)
+{
+	int n, nHead = -1, nPrev = -1;
+
+	for(AstNode *p = pFirst; p; p = p->pNext){
+		n = save_node(p, nPrev);
+		if (nHead < 0)
+			nHead = n;
+		nPrev = n;
+	}
+	return nHead;
+}
+
+// Save a single node, not its siblings, and return its index.
+static int save_child(AstNode *pAst)
+{
+	return pAst ? save_node(pAst, -1) : -1;
+}
+
+// Save the children of the node, then the node itself, and return its index.
+static int save_node(AstNode *pAst, int nPrev)
+{
+	int n[5] = {-1, -1, -1, -1, -1};
+	void *pBody = pAst->pBody;
+
+	switch(pAst->nKind){
+	case kAstType:
+		n[0] = save_list(((TypeNode *)pBody)->pFirstIntNode);
+		break;
+	case kAstProgram:
+		n[0] = save_list(((ProgramNode *)pBody)->pFirstDeclarationNode);
+		n[1] = save_list(((ProgramNode *)pBody)->pFirstFunctionNode);
+		n[2] = save_child(((ProgramNode *)pBody)->pCompoundStatementNode);
+		break;
+	case kAstDeclaration:
+		n[0] = save_list(((DeclarationNode *)pBody)->pFirstIdNode);
+		if (((DeclarationNode *)pBody)->pLiteralNode)
+			n[1] = save_child(((DeclarationNode *)pBody)->pLiteralNode);
+		else
+			n[2] = save_child(((DeclarationNode *)pBody)->pTypeNode);
+		break;
+	case kAstExpression:
+		n[0] = save_child(((ExpressionNode *)pBody)->pLeftNode);
+		n[1] = save_child(((ExpressionNode *)pBody)->pRightNode);
+		break;
+	case kAstCompoundStatement:
+		n[0] = save_list(((CompoundStatementNode *)pBody)->pFirstDeclarationNode);
+		n[1] = save_list(((CompoundStatementNode *)pBody)->pFirstStatementNode);
+		break;
+	case kAstPrint:
+		n[0] = save_child(((PrintNode *)pBody)->pExpressionNode);
+		break;
+	case kAstVariableRef:
+		n[0] = save_list(((VariableRefNode *)pBody)->pFirstArrRefNode);
+		break;
+	case kAstAssign:
+		n[0] = save_child(((AssignNode *)pBody)->pVariableRefNode);
+		n[1] = save_child(((AssignNode *)pBody)->pExpressionNode);
+		break;
+	case kAstRead:
+		n[0] = save_child(((ReadNode *)pBody)->pVariableRefNode);
+		break;
+	case kAstFunctionInvocation:
+		n[0] = save_list(((FunctionInvocationNode *)pBody)->pFirstExpressionNode);
+		break;
+	case kAstFunction:
+		n[0] = save_list(((FunctionNode *)pBody)->pFirstArgDeclNode);
+		n[1] = save_child(((FunctionNode *)pBody)->pReturnTypeNode);
+		n[2] = save_list(((FunctionNode *)pBody)->pFirstStatementNode);
+		break;
+	case kAstCondition:
+		n[0] = save_child(((ConditionNode *)pBody)->pExpressionNode);
+		n[1] = save_child(((ConditionNode *)pBody)->pThenCompoundStatementNode);
+		n[2] = save_child(((ConditionNode *)pBody)->pElseCompoundStatementNode);
+		break;
+	case kAstWhile:
+		n[0] = save_child(((WhileNode *)pBody)->pExpressionNode);
+		n[1] = save_child(((WhileNode *)pBody)->pCompoundStatementNode);
+		break;
+	case kAstReturn:
+		n[0] = save_child(((ReturnNode *)pBody)->pExpressionNode);
+		break;
+	case kAstFor:
+		n[0] = save_child(((ForNode *)pBody)->pLoopVarNode);
+		n[1] = save_child(((ForNode *)pBody)->pAssignSymbolNode);
+		n[2] = save_child(((ForNode *)pBody)->pStartIntNode);
+		n[3] = save_child(((ForNode *)pBody)->pEndIntNode);
+		n[4] = save_child(((ForNode *)pBody)->pCompoundStatementNode);
+		break;
+	default:
+		break;
+	}
+
+	put_int(pAst->nKind);
+	put_int(pAst->location.line);
+	put_int(pAst->location.col);
+	put_int(nPrev);
+	switch(pAst->nKind){
+	case kAstId:
+		put_int(string_index(((IdNode *)pBody)->pszName));
+		break;
+	case kAstIntValue:
+		put_int(((IntValueNode *)pBody)->nValue);
+		break;
+	case kAstType:
+		put_int(((TypeNode *)pBody)->nScalerType);
+		put_int(n[0]);
+		break;
+	case kAstLiteral:
+		put_int(((LiteralNode *)pBody)->nType);
+		switch(((LiteralNode *)pBody)->nType){
+		case kInteger: put_int(((LiteralNode *)pBody)->nLiteralInt); break;
+		case kReal: put_bytes(&((LiteralNode *)pBody)->dLiteralReal, sizeof(double)); break;
+		case kBoolean: put_int(((LiteralNode *)pBody)->nLiteralBoolean); break;
+		default: put_int(string_index(((LiteralNode *)pBody)->pszLiteralString)); break;
+		}
+		break;
+	case kAstProgram:
+		put_int(string_index(((ProgramNode *)pBody)->pszName));
+		put_int(n[0]);
+		put_int(n[1]);
+		put_int(n[2]);
+		break;
+	case kAstDeclaration:
+		put_int(((DeclarationNode *)pBody)->nKind);
+		put_int(n[0]);
+		put_int(n[1]);
+		put_int(n[2]);
+		break;
+	case kAstExpression:
+		put_int(((ExpressionNode *)pBody)->nKind);
+		put_int(((ExpressionNode *)pBody)->nOp);
+		put_int(n[0]);
+		put_int(n[1]);
+		break;
+	case kAstVariableRef:
+		put_int(string_index(((VariableRefNode *)pBody)->pszVarName));
+		put_int(n[0]);
+		break;
+	case kAstFunctionInvocation:
+		put_int(string_index(((FunctionInvocationNode *)pBody)->pszFuncName));
+		put_int(n[0]);
+		break;
+	case kAstFunction:
+		put_int(string_index(((FunctionNode *)pBody)->pszFuncName));
+		put_int(n[0]);
+		put_int(n[1]);
+		put_int(n[2]);
+		break;
+	case kAstCompoundStatement:
+	case kAstAssign:
+	case kAstCondition:
+	case kAstWhile:
+		put_int(n[0]);
+		put_int(n[1]);
+		if (pAst->nKind == kAstCondition)
+			put_int(n[2]);
+		break;
+	case kAstPrint:
+	case kAstRead:
+	case kAstReturn:
+		put_int(n[0]);
+		break;
+	case kAstFor:
+		for(int i = 0; i < 5; i++)
+			put_int(n[i]);
+		break;
+	default:
+		break;
+	}
+	return g_nBinNodes++;
+}
+
+// Write the AST with its strings and source lines to a binary file, return 0 on success, -1 on failure.
+int AstBin_Save(AstNode *pRoot, const char *pszFile)
+{
+	char *pNodes;
+	size_t nNodes;
+	int i, nRoot, nLines, nLeng;
+	const char *pszLine;
+	FILE *fp;
+	int nErr = 0;
+
+	// Nodes first, they fill the string table.
+	reset_save();
+	nRoot = pRoot ? save_node(pRoot, -1) : -1;
+	pNodes = g_pBinOut;
+	nNodes = g_nBinOutUsed;
+	g_pBinOut = NULL;
+	g_nBinOutUsed = g_nBinOutSize = 0;
+
+	for(nLines = 0; LexGetSourceCode(nLines, &nLeng); nLines++)
+		;
+	put_bytes(AST_BIN_MAGIC, 4);
+	put_int(AST_BIN_VERSION);
+	put_int(SymTab_IsDumpEnabled() ? AST_BIN_DUMP_ON_POP : 0);
+	put_int(g_nBinStrs);
+	put_int(g_nBinNodes);
+	put_int(nLines);
+	put_int(nRoot);
+	for(i = 0; i < g_nBinStrs; i++){
+		nLeng = strlen(g_ppszBinStrs[i]);
+		put_int(nLeng);
+		put_bytes(g_ppszBinStrs[i], nLeng);
+	}
+	put_bytes(pNodes, nNodes);
+	for(i = 0; i < nLines; i++){
+		pszLine = LexGetSourceCode(i, &nLeng);
+		put_int(nLeng);
+		put_bytes(pszLine, nLeng);
+	}
+
+	fp = fopen(pszFile, "wb");
+	if (!fp || fwrite(g_pBinOut, 1, g_nBinOutUsed, fp) != g_nBinOutUsed){
+		OutBuf_ErrPrintf("Cannot write AST file %s\n", pszFile);
+		nErr = -1;
+	}
+	if (fp && fclose(fp) != 0 && nErr == 0){
+		OutBuf_ErrPrintf("Cannot write AST file %s\n", pszFile);
+		nErr = -1;
+	}
+
+	free(pNodes);
+	AstBin_Release();
+	return nErr;
+}
+
+// Serialize the subtree of pAst, not its siblings, followed by the characters of its strings, so equal
+// bytes mean equal subtrees including locations. The buffer stays valid until the next AstBin_ call.
+const char *AstBin_Serialize(AstNode *pAst, size_t *pnSize)
+{
+	int i, nLeng;
+
+	reset_save();
+	save_node(pAst, -1);
+	for(i = 0; i < g_nBinStrs; i++){
+		nLeng = strlen(g_ppszBinStrs[i]);
+		put_int(nLeng);
+		put_bytes(g_ppszBinStrs[i], nLeng);
+	}
+	*pnSize = g_nBinOutUsed;
+	return g_pBinOut;
+}
+
+// Release the save buffer and string table.
+void AstBin_Release()
+{
+	free(g_pBinOut);
+	free(g_pBinStrSlots);
+	free(g_ppszBinStrs);
+	g_pBinOut = NULL;
+	g_nBinOutUsed = g_nBinOutSize = 0;
+	g_pBinStrSlots = NULL;
+	g_ppszBinStrs = NULL;
+	g_nBinStrSlots = g_nBinStrs = g_nBinNodes = 0;
+}
+
+// ----------------------------------------------------------------
+// Load
+// ----------------------------------------------------------------
+thread_local const char *g_pBinIn = NULL;
+thread_local size_t g_nBinInSize = 0;
+thread_local size_t g_nBinInPos = 0;
+thread_local bool g_bBinInBad = false;
+thread_local bool *g_pBinInUsed = NULL;		// node is a child or list element of a loaded node.
+thread_local int *g_pBinInNext = NULL;		// index of the next sibling of every node, -1 for none.
+
+// Sets of node kinds a child may have.
+#define BIN_KIND(k)			(1u << (k))
+#define BIN_STATEMENTS		(BIN_KIND(kAstCompoundStatement) | BIN_KIND(kAstPrint) | BIN_KIND(kAstAssign) | BIN_KIND(kAstRead) \
+							| BIN_KIND(kAstFunctionInvocation) | BIN_KIND(kAstCondition) | BIN_KIND(kAstWhile) | BIN_KIND(kAstReturn) | BIN_KIND(kAstFor))
+
+static void get_bytes(void *p, size_t n)
+{
+	if (g_bBinInBad || n > g_nBinInSize - g_nBinInPos){
+		g_bBinInBad = true;
+		memset(p, 0, n);
+		return;
+	}
+	memcpy(p, g_pBinIn + g_nBinInPos, n);
+	g_nBinInPos += n;
+}
+
+static int get_int()
+{
+	uint32_t u = 0;
+	unsigned char c = 0x80;
+	int nShift;
+
+	for(nShift = 0; (c & 0x80) && nShift < 35; nShift += 7){
+		get_bytes(&c, 1);
+		u |= (uint32_t)(c & 0x7f) << nShift;
+	}
+	if (c & 0x80)
+		g_bBinInBad = true;
+	return (int)(u >> 1) ^ -(int)(u & 1);
+}
+
+// Read a count that must be at least 0 and no more than the bytes left in the file.
+static int get_count()
+{
+	int n = get_int();
+
+	if (n < 0 || (size_t)n > g_nBinInSize - g_nBinInPos)
+		g_bBinInBad = true;
+	return g_bBinInBad ? 0 : n;
+}
+
+// Get the interned string of a string table index.
+static const char *get_string(const char **ppszStrs, int nStrs)
+{
+	int n = get_int();
+
+	if (n < 0 || n >= nStrs){
+		g_bBinInBad = true;
+		return "";
+	}
+	return ppszStrs[n];
+}
+
+// Get an already loaded list by the index of its head, NULL for -1. Every element has to be of one
+// of the kinds in nKinds and belong to no other node, so the loaded nodes form a tree.
+static AstNode *get_list(AstNode **ppNodes, int nLoaded, uint32_t nKinds, bool bRequired)
+{
+	int n = get_int();
+
+	if (n == -1 && !bRequired)
+		return NULL;
+	if (n < 0 || n >= nLoaded){
+		g_bBinInBad = true;
+		return NULL;
+	}
+	for(int i = n; i >= 0; i = g_pBinInNext[i]){
+		if (!(nKinds & BIN_KIND(ppNodes[i]->nKind)) || g_pBinInUsed[i]){
+			g_bBinInBad = true;
+			return NULL;
+		}
+		g_pBinInUsed[i] = true;
+	}
+	return ppNodes[n];
+}
+
+// Get a single child, a list of one element.
+static AstNode *get_node(AstNode **ppNodes, int nLoaded, uint32_t nKinds, bool bRequired)
+{
+	AstNode *pAst = get_list(ppNodes, nLoaded, nKinds, bRequired);
+
+	if (pAst && pAst->pNext){
+		g_bBinInBad = true;
+		return NULL;
+	}
+	return pAst;
+}
+
+// Kinds the left operand of an expression of kind nExprKind may have.
+static uint32_t operand_kinds(int nExprKind)
+{
+	switch(nExprKind){
+	case kExprConstant:				return BIN_KIND(kAstLiteral);
+	case kExprVariableRef:			return BIN_KIND(kAstVariableRef);
+	case kExprFunctionInvocation:	return BIN_KIND(kAstFunctionInvocation);
+	default:						return BIN_KIND(kAstExpression);
+	}
+}
+
+// Rebuild one node from its record with its constructor.
+static AstNode *load_node(AstNode **ppNodes, int nLoaded, const char **ppszStrs, int nStrs)
+{
+	AstKind_t nKind = (AstKind_t)get_int();
+	int nLine = get_int();
+	int nCol = get_int();
+	int nPrev = get_int();
+	AstNode *p[5], *pAst = NULL;
+	const char *psz;
+	int n, n2;
+	double d;
+
+	// A sibling is linked once, before the list becomes a child.
+	if (nPrev < -1 || nPrev >= nLoaded || (nPrev >= 0 && (g_pBinInUsed[nPrev] || g_pBinInNext[nPrev] >= 0)))
+		g_bBinInBad = true;
+	if (g_bBinInBad)
+		return NULL;
+
+	switch(nKind){
+	case kAstId:
+		pAst = NewIdNode(nLine, nCol, get_string(ppszStrs, nStrs));
+		break;
+	case kAstIntValue:
+		pAst = NewIntValueNode(nLine, nCol, get_int());
+		break;
+	case kAstType:
+		n = get_int();
+		p[0] = get_list(ppNodes, nLoaded, BIN_KIND(kAstIntValue), false);
+		if (n < kInteger || n > kVoid)
+			g_bBinInBad = true;
+		else if (p[0])
+			pAst = NewArrTypeNode(nLine, nCol, p[0], (SymbolValue_t)n);
+		else
+			pAst = NewScalerTypeNode(nLine, nCol, (SymbolValue_t)n);
+		break;
+	case kAstLiteral:
+		switch(get_int()){
+		case kInteger: pAst = NewLiteralIntNode(nLine, nCol, get_int()); break;
+		case kReal: get_bytes(&d, sizeof(d)); pAst = NewLiteralRealNode(nLine, nCol, d); break;
+		case kBoolean: pAst = NewLiteralBooleanNode(nLine, nCol, get_int() != 0); break;
+		case kString: pAst = NewLiteralStringNode(nLine, nCol, get_string(ppszStrs, nStrs)); break;
+		default: g_bBinInBad = true; break;
+		}
+		break;
+	case kAstProgram:
+		psz = get_string(ppszStrs, nStrs);
+		p[0] = get_list(ppNodes, nLoaded, BIN_KIND(kAstDeclaration), false);
+		p[1] = get_list(ppNodes, nLoaded, BIN_KIND(kAstFunction), false);
+		p[2] = get_node(ppNodes, nLoaded, BIN_KIND(kAstCompoundStatement), true);
+		if (!g_bBinInBad)
+			pAst = NewProgramNode(nLine, nCol, psz, p[0], p[1], p[2]);
+		break;
+	case kAstDeclaration:
+		n = get_int();
+		p[0] = get_list(ppNodes, nLoaded, BIN_KIND(kAstId), true);
+		p[1] = get_node(ppNodes, nLoaded, BIN_KIND(kAstLiteral), false);
+		p[2] = get_node(ppNodes, nLoaded, BIN_KIND(kAstType), false);
+		if (g_bBinInBad || n < kParameter || n > kConstant || (!p[1] && !p[2]))
+			g_bBinInBad = true;
+		else if (p[1])
+			pAst = NewDeclarationNode_LiteralConstant(nLine, nCol, p[0], p[1]);
+		else
+			pAst = NewDeclarationNode_Type(nLine, nCol, p[0], p[2], (SymbolValue_t)n);
+		break;
+	case kAstExpression:
+		n = get_int();
+		n2 = get_int();
+		p[0] = get_node(ppNodes, nLoaded, operand_kinds(n), n != kExprUnary);
+		p[1] = get_node(ppNodes, nLoaded, BIN_KIND(kAstExpression), n <= kExprUnary);
+		// A unary operator has only its right operand, an operand node only its left.
+		if (g_bBinInBad || n < kExprBinary || n > kExprFunctionInvocation || (n == kExprUnary && p[0]) || (n >= kExprConstant && p[1]))
+			g_bBinInBad = true;
+		else if (n >= kExprConstant)
+			pAst = NewOperandNode(nLine, nCol, (ExprKind_t)n, p[0]);
+		else if (n2 < kADD || n2 > kNE)
+			g_bBinInBad = true;
+		else
+			pAst = NewExpressionNode(nLine, nCol, (SymbolValue_t)n2, p[0], p[1]);
+		break;
+	case kAstCompoundStatement:
+		p[0] = get_list(ppNodes, nLoaded, BIN_KIND(kAstDeclaration), false);
+		p[1] = get_list(ppNodes, nLoaded, BIN_STATEMENTS, false);
+		pAst = NewCompoundStatementNode(nLine, nCol, p[0], p[1]);
+		break;
+	case kAstPrint:
+		pAst = NewPrintNode(nLine, nCol, get_node(ppNodes, nLoaded, BIN_KIND(kAstExpression), true));
+		break;
+	case kAstVariableRef:
+		psz = get_string(ppszStrs, nStrs);
+		pAst = NewVariableRefNode(nLine, nCol, psz, get_list(ppNodes, nLoaded, BIN_KIND(kAstExpression), false));
+		break;
+	case kAstAssign:
+		p[0] = get_node(ppNodes, nLoaded, BIN_KIND(kAstVariableRef), true);
+		p[1] = get_node(ppNodes, nLoaded, BIN_KIND(kAstExpression), true);
+		pAst = NewAssignNode(nLine, nCol, p[0], p[1]);
+		break;
+	case kAstRead:
+		pAst = NewReadNode(nLine, nCol, get_node(ppNodes, nLoaded, BIN_KIND(kAstVariableRef), true));
+		break;
+	case kAstFunctionInvocation:
+		psz = get_string(ppszStrs, nStrs);
+		pAst = NewFunctionInvocationNode(nLine, nCol, psz, get_list(ppNodes, nLoaded, BIN_KIND(kAstExpression), false));
+		break;
+	case kAstFunction:
+		psz = get_string(ppszStrs, nStrs);
+		p[0] = get_list(ppNodes, nLoaded, BIN_KIND(kAstDeclaration), false);
+		p[1] = get_node(ppNodes, nLoaded, BIN_KIND(kAstType), true);
+		p[2] = get_list(ppNodes, nLoaded, BIN_STATEMENTS, false);
+		if (!g_bBinInBad)
+			pAst = NewFunctionNode(nLine, nCol, psz, p[0], p[1], p[2]);
+		break;
+	case kAstCondition:
+		p[0] = get_node(ppNodes, nLoaded, BIN_KIND(kAstExpression), true);
+		p[1] = get_node(ppNodes, nLoaded, BIN_KIND(kAstCompoundStatement), true);
+		p[2] = get_node(ppNodes, nLoaded, BIN_KIND(kAstCompoundStatement), false);
+		pAst = NewConditionNode(nLine, nCol, p[0], p[1], p[2]);
+		break;
+	case kAstWhile:
+		p[0] = get_node(ppNodes, nLoaded, BIN_KIND(kAstExpression), true);
+		p[1] = get_node(ppNodes, nLoaded, BIN_KIND(kAstCompoundStatement), true);
+		pAst = NewWhileNode(nLine, nCol, p[0], p[1]);
+		break;
+	case kAstReturn:
+		pAst = NewReturnNode(nLine, nCol, get_node(ppNodes, nLoaded, BIN_KIND(kAstExpression), true));
+		break;
+	case kAstFor:
+		p[0] = get_node(ppNodes, nLoaded, BIN_KIND(kAstId), true);
+		p[1] = get_node(ppNodes, nLoaded, BIN_KIND(kAstId), true);
+		p[2] = get_node(ppNodes, nLoaded, BIN_KIND(kAstIntValue), true);
+		p[3] = get_node(ppNodes, nLoaded, BIN_KIND(kAstIntValue), true);
+		p[4] = get_node(ppNodes, nLoaded, BIN_KIND(kAstCompoundStatement), true);
+		if (!g_bBinInBad)
+			pAst = NewForNode(nLine, nCol, p[0], p[1], p[2], p[3], p[4]);
+		break;
+	default:
+		g_bBinInBad = true;
+		break;
+	}
+	if (g_bBinInBad)
+		return NULL;
+	if (nPrev >= 0){
+		ppNodes[nPrev]->pNext = pAst;
+		g_pBinInNext[nPrev] = nLoaded;
+	}
+	return pAst;
+}
+
+// Read a binary AST file written by AstBin_Save() and rebuild the tree, its strings and source lines.
+// Return the root node, or NULL if the file cannot be read or is not a valid AST file.
+AstNode *AstBin_Load(const char *pszFile)
+{
+	FILE *fp;
+	char *pData = NULL;
+	char pszMagic[4];
+	long nSize;
+	int i, n, nFlags, nStrs, nNodes, nLines, nRoot;
+	const char **ppszStrs = NULL;
+	AstNode **ppNodes = NULL, *pRoot = NULL;
+
+	fp = fopen(pszFile, "rb");
+	if (!fp){
+		OutBuf_ErrPrintf("Cannot read AST file %s\n", pszFile);
+		return NULL;
+	}
+	if (fseek(fp, 0, SEEK_END) == 0 && (nSize = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0){
+		pData = (char *)malloc(nSize ? nSize : 1);
+		if (pData && fread(pData, 1, nSize, fp) != (size_t)nSize){
+			free(pData);
+			pData = NULL;
+		}
+	}
+	fclose(fp);
+	if (!pData){
+		OutBuf_ErrPrintf("Cannot read AST file %s\n", pszFile);
+		return NULL;
+	}
+
+	g_pBinIn = pData;
+	g_nBinInSize = nSize;
+	g_nBinInPos = 0;
+	g_bBinInBad = false;
+
+	get_bytes(pszMagic, 4);
+	if (g_bBinInBad || memcmp(pszMagic, AST_BIN_MAGIC, 4) != 0 || get_int() != AST_BIN_VERSION)
+		g_bBinInBad = true;
+	nFlags = get_int();
+	nStrs = get_count();
+	nNodes = get_count();
+	nLines = get_count();
+	nRoot = get_int();
+	if (nRoot < 0 || nRoot >= nNodes)
+		g_bBinInBad = true;
+
+	// Strings go straight into the string pool.
+	if (!g_bBinInBad)
+		ppszStrs = (const char **)malloc((nStrs + 1) * sizeof(const char *));
+	for(i = 0; i < nStrs && !g_bBinInBad; i++){
+		n = get_count();
+		ppszStrs[i] = StrPool_InternN(g_pBinIn + g_nBinInPos, n);
+		g_nBinInPos += n;
+	}
+
+	if (!g_bBinInBad){
+		ppNodes = (AstNode **)malloc((nNodes + 1) * sizeof(AstNode *));
+		g_pBinInUsed = (bool *)calloc(nNodes + 1, sizeof(bool));
+		g_pBinInNext = (int *)malloc((nNodes + 1) * sizeof(int));
+		memset(g_pBinInNext, 0xff, (nNodes + 1) * sizeof(int));
+	}
+	for(i = 0; i < nNodes && !g_bBinInBad; i++)
+		ppNodes[i] = load_node(ppNodes, i, ppszStrs, nStrs);
+
+	for(i = 0; i < nLines && !g_bBinInBad; i++){
+		n = get_count();
+		LexKeepSourceLine(g_pBinIn + g_nBinInPos, n);
+		g_nBinInPos += n;
+	}
+
+	if (g_bBinInBad || g_nBinInPos != g_nBinInSize || ppNodes[nRoot]->nKind != kAstProgram || g_pBinInUsed[nRoot])
+		OutBuf_ErrPrintf("Invalid AST file %s\n", pszFile);
+	else {
+		pRoot = ppNodes[nRoot];
+		SymTab_EnableDump((nFlags & AST_BIN_DUMP_ON_POP) != 0);
+	}
+
+	free(ppNodes);
+	free(ppszStrs);
+	free(pData);
+	free(g_pBinInUsed);
+	free(g_pBinInNext);
+	g_pBinInUsed = NULL;
+	g_pBinInNext = NULL;
+	g_pBinIn = NULL;
+	g_nBinInSize = g_nBinInPos = 0;
+	return pRoot;
+}
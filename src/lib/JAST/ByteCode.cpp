@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "JAST/jast_api.h"
+#include "JAST/jast_internal.h"
+
+// Bytecode generation: the codegen callbacks of the nodes emit the instructions of one function
+// at a time through the ByteCode_ functions, see include/JAST/bytecode.h for the machine.
+// Registers of a frame: locals at their slots 0 .. g_nBcLocals - 1, then temporaries used like a stack,
+// g_nBcTop is the first free one. An expression callback returns the register of its value.
+
+static const char *k_ppszBcOps[kBcOps] = {
+	"nop", "halt", "move", "loadi", "loadr", "loads", "getg", "setg", "larr", "garr", "clra", "chki",
+	"lde", "ste", "addi", "subi", "muli", "divi", "modi", "negi", "addik", "addr", "subr", "mulr", "divr", "negr",
+	"itor", "lti", "lei", "eqi", "gei", "gti", "nei", "ltr", "ler", "eqr", "ger", "gtr", "ner",
+	"and", "or", "not", "cat", "jmp", "jt", "jf", "call", "ret", "retv",
+	"printi", "printr", "printb", "prints", "readi", "readr", "readb", "reads",
+};
+
+// The program being generated.
+std::vector<BcInst> g_oBcCode;
+std::vector<int32_t> g_oBcLines;
+std::vector<BcFunction> g_oBcFuncs;
+std::vector<double> g_oBcReals;
+std::vector<char> g_oBcStrings;
+std::unordered_map<const char *, int> g_oBcStringOffsets;		// interned string to offset.
+std::unordered_map<AstNode *, int> g_oBcFuncIndex;				// FunctionNode to function index.
+std::map<int, int> g_oBcGlobalArrays;							// global slot to cell offset.
+int g_nBcGlobals = 0;
+int g_nBcGlobalCells = 0;
+bool g_bBcFailed = false;
+
+// The function being generated.
+std::map<std::pair<AstNode *, int>, int> g_oBcLocalArrays;		// TypeNode and slot to cell offset.
+BcFunction *g_pBcFunc = NULL;
+int g_nBcLocals = 0;
+int g_nBcTop = 0;
+int g_nBcLine = 0;
+
+// ----------------------------------------------------------------
+// Program and functions
+// ----------------------------------------------------------------
+
+static void release_program()
+{
+	std::vector<BcInst>().swap(g_oBcCode);
+	std::vector<int32_t>().swap(g_oBcLines);
+	std::vector<BcFunction>().swap(g_oBcFuncs);
+	std::vector<double>().swap(g_oBcReals);
+	std::vector<char>().swap(g_oBcStrings);
+	g_oBcStringOffsets.clear();
+	g_oBcFuncIndex.clear();
+	g_oBcGlobalArrays.clear();
+	g_oBcLocalArrays.clear();
+	g_nBcGlobals = g_nBcGlobalCells = 0;
+	g_pBcFunc = NULL;
+	g_bBcFailed = false;
+}
+
+// Generate the bytecode of a program that passed semantic analysis without errors.
+// Return 0 on success, -1 if it does not fit the limits of the machine.
+int ByteCode_Generate(AstNode *pRoot)
+{
+	ProgramNode *pProgram = (ProgramNode *)pRoot->pBody;
+	AstNode *p;
+	int n = 1;
+
+	release_program();
+	ByteCode_StrConst("");
+	// Function 0 is the program body, the functions follow in source order, so calls can be emitted before their callees.
+	for(p = pProgram->pFirstFunctionNode; p; p = p->pNext)
+		g_oBcFuncIndex[p] = n++;
+	if (n > UINT16_MAX + 1){
+		OutBuf_ErrPrintf("bytecode: %d functions, more than %d\n", n - 1, UINT16_MAX);
+		return -1;
+	}
+	g_oBcFuncs.resize(n);
+	g_nBcGlobals = CountSlots(pRoot, true);
+	CodeGenAstNode(pRoot);
+	return g_bBcFailed ? -1 : 0;
+}
+
+// Get the index of a function from its FunctionNode.
+int ByteCode_FunctionIndex(AstNode *pFunc)
+{
+	return g_oBcFuncIndex[pFunc];
+}
+
+// Start generating a function, pScope is the subtree with all its declarations.
+void ByteCode_BeginFunction(int nFunc, AstNode *pScope, int nParams, SymbolValue_t nReturnType, const char *pszName)
+{
+	g_pBcFunc = &g_oBcFuncs[nFunc];
+	g_pBcFunc->nEntry = g_oBcCode.size();
+	g_pBcFunc->nParams = nParams;
+	g_pBcFunc->nReturnType = nReturnType;
+	g_pBcFunc->nName = ByteCode_StrConst(pszName);
+	g_pBcFunc->nArrayCells = 0;
+	g_nBcLocals = CountSlots(pScope, false);
+	if (g_nBcLocals < nParams)
+		g_nBcLocals = nParams;		// a function without a body has no parameter slots.
+	g_pBcFunc->nRegs = g_nBcLocals;
+	g_nBcTop = g_nBcLocals;
+	g_oBcLocalArrays.clear();
+}
+
+void ByteCode_EndFunction()
+{
+	if (g_pBcFunc->nRegs > BC_MAX_REGS){
+		OutBuf_ErrPrintf("bytecode: function '%s' needs %d registers, more than %d\n", &g_oBcStrings[g_pBcFunc->nName], g_pBcFunc->nRegs, BC_MAX_REGS);
+		g_bBcFailed = true;
+	}
+	g_pBcFunc = NULL;
+}
+
+// Return type of the function being generated.
+SymbolValue_t ByteCode_GetReturnType()
+{
+	return (SymbolValue_t)g_pBcFunc->nReturnType;
+}
+
+// Set the source line of the instructions emitted from now on.
+void ByteCode_SetLine(int nLine)
+{
+	g_nBcLine = nLine;
+}
+
+// ----------------------------------------------------------------
+// Instructions
+// ----------------------------------------------------------------
+
+int ByteCode_Emit(BcOp_t nOp, int a, int b, int c)
+{
+	BcInst oInst;
+
+	oInst.nOp = nOp;
+	oInst.a = a;
+	oInst.b = b;
+	oInst.c = c;
+	g_oBcCode.push_back(oInst);
+	g_oBcLines.push_back(g_nBcLine);
+	return g_oBcCode.size() - 1;
+}
+
+int ByteCode_EmitImm(BcOp_t nOp, int a, int nImm)
+{
+	BcInst oInst;
+
+	oInst.nOp = nOp;
+	oInst.a = a;
+	oInst.imm = nImm;
+	g_oBcCode.push_back(oInst);
+	g_oBcLines.push_back(g_nBcLine);
+	return g_oBcCode.size() - 1;
+}
+
+// Index of the next instruction, a jump target.
+int ByteCode_Here()
+{
+	return g_oBcCode.size();
+}
+
+// Emit a jump to an instruction already emitted.
+void ByteCode_JumpTo(BcOp_t nOp, int a, int nTarget)
+{
+	ByteCode_EmitImm(nOp, a, nTarget - (ByteCode_Here() + 1));
+}
+
+// Make the jump emitted at nInst go to the next instruction.
+void ByteCode_PatchJump(int nInst)
+{
+	g_oBcCode[nInst].imm = ByteCode_Here() - (nInst + 1);
+}
+
+// Get a new temporary register on top of the frame.
+int ByteCode_NewTemp()
+{
+	if (++g_nBcTop > g_pBcFunc->nRegs)
+		g_pBcFunc->nRegs = g_nBcTop;
+	return g_nBcTop - 1;
+}
+
+// Get or set the first free temporary, to free the temporaries of a subexpression.
+int ByteCode_GetTop()
+{
+	return g_nBcTop;
+}
+
+void ByteCode_SetTop(int nTop)
+{
+	g_nBcTop = nTop;
+}
+
+// Whether a register is a temporary rather than a local variable.
+bool ByteCode_IsTemp(int nReg)
+{
+	return nReg >= g_nBcLocals;
+}
+
+// Whether an instruction only computes register a from its operands.
+static bool computes_a(int nOp)
+{
+	switch(nOp){
+	case kBcMove: case kBcLoadInt: case kBcLoadReal: case kBcLoadStr: case kBcGetGlobal:
+	case kBcLocalArray: case kBcGlobalArray: case kBcLoadElem:
+		return true;
+	default:
+		return nOp >= kBcAddInt && nOp <= kBcConcat;
+	}
+}
+
+// Copy register nReg to nDest. A temporary that the last instruction computed is not copied,
+// that instruction writes to nDest instead.
+void ByteCode_MoveTo(int nDest, int nReg)
+{
+	BcInst *p;
+
+	if (nReg == nDest)
+		return;
+	if (ByteCode_IsTemp(nReg) && !g_oBcCode.empty()){
+		p = &g_oBcCode.back();
+		if (p->a == nReg && computes_a(p->nOp)){
+			p->a = nDest;
+			return;
+		}
+	}
+	ByteCode_Emit(kBcMove, nDest, nReg, 0);
+}
+
+// Convert the value of an int register to real in a new temporary.
+int ByteCode_IntToReal(int nReg)
+{
+	int n = ByteCode_NewTemp();
+
+	ByteCode_Emit(kBcIntToReal, n, nReg, 0);
+	return n;
+}
+
+// ----------------------------------------------------------------
+// Constants and arrays
+// ----------------------------------------------------------------
+
+int ByteCode_RealConst(double d)
+{
+	for(size_t i = 0; i < g_oBcReals.size(); i++){
+		if (memcmp(&g_oBcReals[i], &d, sizeof(double)) == 0)
+			return i;
+	}
+	g_oBcReals.push_back(d);
+	return g_oBcReals.size() - 1;
+}
+
+// Get the offset of a string interned by StrPool, adding it on first use.
+int ByteCode_StrConst(const char *psz)
+{
+	auto it = g_oBcStringOffsets.find(psz);
+	int n;
+
+	if (it != g_oBcStringOffsets.end())
+		return it->second;
+	n = g_oBcStrings.size();
+	g_oBcStrings.insert(g_oBcStrings.end(), psz, psz + strlen(psz) + 1);
+	g_oBcStringOffsets[psz] = n;
+	return n;
+}
+
+// Number of cells of an array type.
+int ByteCode_ArrayCells(TypeNode *pType)
+{
+	int n = 1;
+
+	for(AstNode *p = pType->pFirstIntNode; p; p = p->pNext)
+		n *= ((IntValueNode *)p->pBody)->nValue;
+	return n;
+}
+
+// Emit the address of an array variable into a new temporary. Every array declared in the function
+// gets cells of its own, the global ones in the global array memory.
+int ByteCode_ArrayAddress(AstNode *pTypeNode, int nLevel, int nSlot)
+{
+	int n = ByteCode_NewTemp(), nCells = ByteCode_ArrayCells((TypeNode *)pTypeNode->pBody);
+
+	if (nLevel == 0){
+		auto it = g_oBcGlobalArrays.find(nSlot);
+		if (it == g_oBcGlobalArrays.end()){
+			it = g_oBcGlobalArrays.insert(std::make_pair(nSlot, g_nBcGlobalCells)).first;
+			g_nBcGlobalCells += nCells;
+		}
+		ByteCode_EmitImm(kBcGlobalArray, n, it->second);
+	}
+	else{
+		auto it = g_oBcLocalArrays.find(std::make_pair(pTypeNode, nSlot));
+		if (it == g_oBcLocalArrays.end()){
+			it = g_oBcLocalArrays.insert(std::make_pair(std::make_pair(pTypeNode, nSlot), g_pBcFunc->nArrayCells)).first;
+			g_pBcFunc->nArrayCells += nCells;
+		}
+		ByteCode_EmitImm(kBcLocalArray, n, it->second);
+	}
+	return n;
+}
+
+// ----------------------------------------------------------------
+// Output
+// ----------------------------------------------------------------
+
+// Get the generated program as the parts of a bytecode file, valid until ByteCode_Release().
+void ByteCode_GetImage(BcImage *pImage)
+{
+	BcHeader *pHeader = &pImage->oHeader;
+
+	memcpy(pHeader->pszMagic, BC_MAGIC, 4);
+	pHeader->nVersion = BC_VERSION;
+	pHeader->nFuncs = g_oBcFuncs.size();
+	pHeader->nGlobals = g_nBcGlobals;
+	pHeader->nGlobalCells = g_nBcGlobalCells;
+	pHeader->nReals = g_oBcReals.size();
+	pHeader->nStringBytes = g_oBcStrings.size();
+	pHeader->nInsts = g_oBcCode.size();
+	pImage->pFuncs = g_oBcFuncs.data();
+	pImage->pReals = g_oBcReals.data();
+	pImage->pStrings = g_oBcStrings.data();
+	pImage->pCode = g_oBcCode.data();
+	pImage->pLines = g_oBcLines.data();
+}
+
+// fwrite() that also takes the NULL data of an empty vector.
+static bool write_all(const void *p, size_t nSize, size_t nCount, FILE *fp)
+{
+	return nCount == 0 || fwrite(p, nSize, nCount, fp) == nCount;
+}
+
+// Write the generated program to a bytecode file, return 0 on success, -1 on failure.
+int ByteCode_Save(const char *pszFile)
+{
+	FILE *fp = fopen(pszFile, "wb");
+	BcImage oImage;
+	bool bOk;
+
+	ByteCode_GetImage(&oImage);
+	bOk = fp && write_all(&oImage.oHeader, sizeof(oImage.oHeader), 1, fp)
+		&& write_all(g_oBcFuncs.data(), sizeof(BcFunction), g_oBcFuncs.size(), fp)
+		&& write_all(g_oBcReals.data(), sizeof(double), g_oBcReals.size(), fp)
+		&& write_all(g_oBcStrings.data(), 1, g_oBcStrings.size(), fp)
+		&& write_all(g_oBcCode.data(), sizeof(BcInst), g_oBcCode.size(), fp)
+		&& write_all(g_oBcLines.data(), sizeof(int32_t), g_oBcLines.size(), fp);
+	if (fp && fclose(fp) != 0)
+		bOk = false;
+	if (!bOk){
+		OutBuf_ErrPrintf("Cannot write bytecode file %s\n", pszFile);
+		return -1;
+	}
+	return 0;
+}
+
+// Print a listing of the generated program.
+void ByteCode_Dump()
+{
+	const BcInst *p;
+	size_t i, j;
+
+	OutBuf_Printf("; %zu functions, %d globals, %d global array cells, %zu instructions\n",
+		g_oBcFuncs.size(), g_nBcGlobals, g_nBcGlobalCells, g_oBcCode.size());
+	for(j = 0; j < g_oBcFuncs.size(); j++){
+		const BcFunction *pFunc = &g_oBcFuncs[j];
+		size_t nEnd = (j + 1 < g_oBcFuncs.size()) ? (size_t)g_oBcFuncs[j + 1].nEntry : g_oBcCode.size();
+
+		OutBuf_Printf("\nfunction %zu %s: %d params, %d registers, %d array cells, returns %s\n", j, &g_oBcStrings[pFunc->nName],
+			pFunc->nParams, pFunc->nRegs, pFunc->nArrayCells, GetSymbolString((SymbolValue_t)pFunc->nReturnType));
+		for(i = pFunc->nEntry; i < nEnd; i++){
+			p = &g_oBcCode[i];
+			OutBuf_Printf("%6zu  %4d  %-7s", i, g_oBcLines[i], k_ppszBcOps[p->nOp]);
+			switch(p->nOp){
+			case kBcNop: case kBcHalt: case kBcReturnVoid:
+				break;
+			case kBcLoadInt: case kBcGetGlobal: case kBcSetGlobal: case kBcLocalArray: case kBcGlobalArray:
+			case kBcClearArray: case kBcCheckIndex:
+				OutBuf_Printf(" r%d, %d", p->a, p->imm);
+				break;
+			case kBcLoadReal:
+				OutBuf_Printf(" r%d, %g", p->a, g_oBcReals[p->imm]);
+				break;
+			case kBcLoadStr:
+				OutBuf_Printf(" r%d, \"%s\"", p->a, &g_oBcStrings[p->imm]);
+				break;
+			case kBcJump:
+				OutBuf_Printf(" %zd", (ssize_t)i + 1 + p->imm);
+				break;
+			case kBcJumpTrue: case kBcJumpFalse:
+				OutBuf_Printf(" r%d, %zd", p->a, (ssize_t)i + 1 + p->imm);
+				break;
+			case kBcAddIntK:
+				OutBuf_Printf(" r%d, r%d, %d", p->a, p->b, (int16_t)p->c);
+				break;
+			case kBcCall:
+				OutBuf_Printf(" r%d, %s, %d", p->a, &g_oBcStrings[g_oBcFuncs[p->b].nName], p->c);
+				break;
+			case kBcMove: case kBcNegInt: case kBcNegReal: case kBcIntToReal: case kBcNot:
+				OutBuf_Printf(" r%d, r%d", p->a, p->b);
+				break;
+			case kBcReturn: case kBcPrintInt: case kBcPrintReal: case kBcPrintBool: case kBcPrintStr:
+			case kBcReadInt: case kBcReadReal: case kBcReadBool: case kBcReadStr:
+				OutBuf_Printf(" r%d", p->a);
+				break;
+			default:
+				OutBuf_Printf(" r%d, r%d, r%d", p->a, p->b, p->c);
+				break;
+			}
+			OutBuf_Printf("\n");
+		}
+	}
+}
+
+// Release the generated program.
+void ByteCode_Release()
+{
+	release_program();
+}
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "JAST/jast_internal.h"
+
+// extern from scanner.l
+extern const char *LexGetSourceCode(int nLine, int *pnLeng);
+
+#define DIAG_MAX_ARGS		3
+
+// Diagnostics: every error is recorded as its location, code and string arguments while a file is
+// compiled, and Diag_Flush() sorts the records by location, drops duplicates and writes them all
+// to stderr with one write, as the usual text or as JSON lines with --diag-json.
+// Records go to a byte stream per thread, so the records of a piece of work can be taken out,
+// cached and appended again like captured output: a DiagHead, then its arguments, each '\0' terminated.
+struct DiagHead {
+	uint32_t nLine;
+	uint32_t nCol;
+	uint16_t nCode;
+	uint16_t nArgBytes;
+};
+
+struct DiagInfo {
+	const char *pszName;		// stable code name for tools.
+	const char *pszFormat;		// message, with one %s per argument.
+	int nArgs;
+};
+
+static const DiagInfo k_pDiagInfo[kDiagCodes] = {
+	{"syntax-error",				"unmatched token '%s'", 2},		// the token, and the line up to it for the text box.
+	{"print-not-scalar",			"expression of print statement must be scalar type", 0},
+	{"undeclared-symbol",			"use of undeclared symbol '%s'", 1},
+	{"non-variable-symbol",			"use of non-variable symbol '%s'", 1},
+	{"index-not-integer",			"index of array reference must be an integer", 0},
+	{"over-subscript",				"there is an over array subscript on '%s'", 1},
+	{"array-assignment",			"array assignment is not allowed", 0},
+	{"assign-to-constant",			"cannot assign to variable '%s' which is a constant", 1},
+	{"assign-to-loop-variable",		"the value of loop variable cannot be modified inside the loop body", 0},
+	{"assign-incompatible-type",	"assigning to '%s' from incompatible type '%s'", 2},
+	{"read-not-scalar",				"variable reference of read statement must be scalar type", 0},
+	{"read-constant",				"variable reference of read statement cannot be a constant or loop variable", 0},
+	{"redeclared-symbol",			"symbol '%s' is redeclared", 1},
+	{"array-index-not-positive",	"%s declared as an array with an index that is not greater than 0", 1},
+	{"unary-operand",				"invalid operand to unary operator '%s' ('%s')", 2},
+	{"binary-operands",				"invalid operands to binary operator '%s' ('%s' and '%s')", 3},
+	{"call-non-function",			"call of non-function symbol '%s'", 1},
+	{"argument-count",				"too few/much arguments provided for function '%s'", 1},
+	{"argument-type",				"incompatible type passing '%s' to parameter of type '%s'", 2},
+	{"condition-not-boolean",		"the expression of condition must be boolean type", 0},
+	{"return-from-procedure",		"program/procedure should not return a value", 0},
+	{"return-type",					"return '%s' from a function with return type '%s'", 2},
+	{"loop-bounds",					"the lower bound and upper bound of iteration count must be in the incremental order", 0},
+	{"bad-character",				"bad character \"%s\"", 1},
+};
+
+thread_local char *g_pDiag = NULL;		// record stream of the file being compiled on this thread.
+thread_local size_t g_nDiagUsed = 0;
+thread_local size_t g_nDiagSize = 0;
+thread_local const char *g_pszDiagFile = "";
+thread_local char *g_pDiagOut = NULL;	// formatting space of Diag_Flush().
+thread_local size_t g_nDiagOutUsed = 0;
+thread_local size_t g_nDiagOutSize = 0;
+bool g_bDiagJson = false;
+
+// Grow *ppBuf to at least nNeed bytes, doubling its size.
+static void grow_buffer(char **ppBuf, size_t *pnSize, size_t nNeed)
+{
+	size_t nSize = *pnSize ? *pnSize : 1024;
+
+	if (nNeed <= *pnSize)
+		return;
+	while(nSize < nNeed)
+		nSize *= 2;
+	*ppBuf = (char *)realloc(*ppBuf, nSize);
+	if (!*ppBuf){
+		fprintf(stderr, "Out of memory for %zu bytes of diagnostics\n", nSize);
+		exit(-1);
+	}
+	*pnSize = nSize;
+}
+
+// Write diagnostics as JSON lines instead of text.
+void Diag_SetJson(bool bJson)
+{
+	g_bDiagJson = bJson;
+}
+
+// Name the file the diagnostics of this thread belong to, for JSON output; the string must outlive them.
+void Diag_SetFile(const char *pszFile)
+{
+	g_pszDiagFile = pszFile ? pszFile : "";
+}
+
+// Record a diagnostic at a location with the string arguments its code takes.
+void Diag_VReport(int nLine, int nCol, DiagCode_t nCode, va_list args)
+{
+	const char *ppszArgs[DIAG_MAX_ARGS];
+	size_t pnLeng[DIAG_MAX_ARGS], nArgBytes = 0;
+	DiagHead oHead;
+	char *p;
+	int i, nArgs = k_pDiagInfo[nCode].nArgs;
+
+	for(i = 0; i < nArgs; i++){
+		ppszArgs[i] = va_arg(args, const char *);
+		if (!ppszArgs[i])
+			ppszArgs[i] = "(null)";	// as printf() wrote it, e.g. the type string of kUnknown.
+		pnLeng[i] = strlen(ppszArgs[i]);
+		// Keep the record size in its 16 bits, with room left for the '\0' of every argument.
+		if (nArgBytes + pnLeng[i] + (nArgs - i) > UINT16_MAX)
+			pnLeng[i] = UINT16_MAX - nArgBytes - (nArgs - i);
+		nArgBytes += pnLeng[i] + 1;
+	}
+	oHead.nLine = nLine;
+	oHead.nCol = nCol;
+	oHead.nCode = nCode;
+	oHead.nArgBytes = nArgBytes;
+	grow_buffer(&g_pDiag, &g_nDiagSize, g_nDiagUsed + sizeof(DiagHead) + nArgBytes);
+	p = g_pDiag + g_nDiagUsed;
+	memcpy(p, &oHead, sizeof(DiagHead));
+	p += sizeof(DiagHead);
+	for(i = 0; i < nArgs; i++){
+		memcpy(p, ppszArgs[i], pnLeng[i]);
+		p[pnLeng[i]] = '\0';
+		p += pnLeng[i] + 1;
+	}
+	g_nDiagUsed += sizeof(DiagHead) + nArgBytes;
+}
+
+void Diag_Report(int nLine, int nCol, DiagCode_t nCode, ...)
+{
+	va_list args;
+
+	va_start(args, nCode);
+	Diag_VReport(nLine, nCol, nCode, args);
+	va_end(args);
+}
+
+// Get the position in the record stream, to take the records from there on later.
+size_t Diag_Mark()
+{
+	return g_nDiagUsed;
+}
+
+// Get the records since nMark, valid until the next Diag_ call; Diag_Truncate(nMark) drops them.
+const char *Diag_Since(size_t nMark, size_t *pnBytes)
+{
+	*pnBytes = g_nDiagUsed - nMark;
+	return g_pDiag + nMark;
+}
+
+void Diag_Truncate(size_t nMark)
+{
+	g_nDiagUsed = nMark;
+}
+
+// Append records taken with Diag_Since(), possibly on another thread or in an earlier run.
+// Return false and append nothing if they are not well formed.
+bool Diag_Append(const char *p, size_t nBytes)
+{
+	DiagHead oHead;
+	const char *pArgs;
+	size_t i, j;
+	int nTerms;
+
+	for(i = 0; i < nBytes; i += sizeof(DiagHead) + oHead.nArgBytes){
+		if (nBytes - i < sizeof(DiagHead))
+			return false;
+		memcpy(&oHead, p + i, sizeof(DiagHead));
+		if (oHead.nCode >= kDiagCodes || oHead.nArgBytes > nBytes - i - sizeof(DiagHead))
+			return false;
+		// The arguments must be exactly the strings the code takes, the last one ending the record.
+		pArgs = p + i + sizeof(DiagHead);
+		for(j = 0, nTerms = 0; j < oHead.nArgBytes; j++)
+			nTerms += pArgs[j] == '\0';
+		if (nTerms != k_pDiagInfo[oHead.nCode].nArgs || (oHead.nArgBytes && pArgs[oHead.nArgBytes - 1] != '\0'))
+			return false;
+	}
+	if (nBytes == 0)
+		return true;	// there may be no buffer yet.
+	grow_buffer(&g_pDiag, &g_nDiagSize, g_nDiagUsed + nBytes);
+	memcpy(g_pDiag + g_nDiagUsed, p, nBytes);
+	g_nDiagUsed += nBytes;
+	return true;
+}
+
+// ----------------------------------------------------------------
+// Emission
+// ----------------------------------------------------------------
+
+// Append printf() formatted output to the formatting space.
+static void out_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void out_printf(const char *format, ...)
+{
+	va_list args;
+	int n;
+
+	grow_buffer(&g_pDiagOut, &g_nDiagOutSize, g_nDiagOutUsed + 256);
+	va_start(args, format);
+	n = vsnprintf(g_pDiagOut + g_nDiagOutUsed, g_nDiagOutSize - g_nDiagOutUsed, format, args);
+	va_end(args);
+	if (n < 0)
+		return;
+	if ((size_t)n >= g_nDiagOutSize - g_nDiagOutUsed){
+		grow_buffer(&g_pDiagOut, &g_nDiagOutSize, g_nDiagOutUsed + n + 1);
+		va_start(args, format);
+		vsnprintf(g_pDiagOut + g_nDiagOutUsed, g_nDiagOutSize - g_nDiagOutUsed, format, args);
+		va_end(args);
+	}
+	g_nDiagOutUsed += n;
+}
+
+// Append a JSON string literal.
+static void out_json_string(const char *psz)
+{
+	grow_buffer(&g_pDiagOut, &g_nDiagOutSize, g_nDiagOutUsed + strlen(psz) * 6 + 3);
+	char *p = g_pDiagOut + g_nDiagOutUsed;
+
+	*p++ = '"';
+	for(; *psz; psz++){
+		unsigned char c = *psz;
+		if (c == '"' || c == '\\'){
+			*p++ = '\\';
+			*p++ = c;
+		}
+		else if (c == '\n'){
+			*p++ = '\\';
+			*p++ = 'n';
+		}
+		else if (c == '\t'){
+			*p++ = '\\';
+			*p++ = 't';
+		}
+		else if (c < 0x20)
+			p += sprintf(p, "\\u%04x", c);
+		else
+			*p++ = c;
+	}
+	*p++ = '"';
+	g_nDiagOutUsed = p - g_pDiagOut;
+}
+
+// Write one record as the compiler always printed it, quoting the source line with a caret.
+static void out_text(const DiagHead *pHead, const char **ppszArgs)
+{
+	const char *pszLine;
+	int nLeng = 0;
+
+	if (pHead->nCode == kDiagSyntax){
+		out_printf("\n"
+			"|--------------------------------------------------------------------------\n"
+			"| Error found in Line #%d: %s\n"
+			"|\n"
+			"| Unmatched token: %s\n"
+			"|--------------------------------------------------------------------------\n",
+			pHead->nLine, ppszArgs[1], ppszArgs[0]);
+		return;
+	}
+	out_printf("<Error> Found in line %d, column %d: ", pHead->nLine, pHead->nCol);
+	out_printf(k_pDiagInfo[pHead->nCode].pszFormat, ppszArgs[0], ppszArgs[1], ppszArgs[2]);
+	pszLine = LexGetSourceCode(pHead->nLine - 1, &nLeng);
+	out_printf("\n%.*s\n", nLeng, pszLine ? pszLine : "");
+	out_printf("%*s^\n", pHead->nCol > 1 ? (int)pHead->nCol - 1 : 0, "");
+}
+
+// Write one record as a JSON object on a line of its own.
+static void out_json(const DiagHead *pHead, const char **ppszArgs)
+{
+	const DiagInfo *pInfo = &k_pDiagInfo[pHead->nCode];
+	char *pszMessage;
+	size_t nMark;
+	int i;
+
+	out_printf("{\"file\":");
+	out_json_string(g_pszDiagFile);
+	out_printf(",\"line\":%u,\"column\":%u,\"severity\":\"error\",\"code\":\"%s\",\"message\":", pHead->nLine, pHead->nCol, pInfo->pszName);
+	// Format the message at the end of the space, then move it into a JSON string.
+	nMark = g_nDiagOutUsed;
+	out_printf(pInfo->pszFormat, ppszArgs[0], ppszArgs[1], ppszArgs[2]);
+	pszMessage = strdup(g_pDiagOut + nMark);
+	g_nDiagOutUsed = nMark;
+	out_json_string(pszMessage);
+	free(pszMessage);
+	out_printf(",\"args\":[");
+	for(i = 0; i < pInfo->nArgs; i++){
+		if (i)
+			out_printf(",");
+		out_json_string(ppszArgs[i]);
+	}
+	out_printf("]}\n");
+}
+
+// Tell whether record nRecord of oRecords repeats one of those from nFirst on, the earlier records
+// at its location; the same message may come between others there.
+static bool is_repeated(const std::vector<size_t> &oRecords, size_t nFirst, size_t nRecord)
+{
+	DiagHead oHead, oOther;
+	size_t i;
+
+	memcpy(&oHead, g_pDiag + oRecords[nRecord], sizeof(DiagHead));
+	for(i = nFirst; i < nRecord; i++){
+		memcpy(&oOther, g_pDiag + oRecords[i], sizeof(DiagHead));
+		if (memcmp(&oHead, &oOther, sizeof(DiagHead)) == 0
+		 && memcmp(g_pDiag + oRecords[nRecord] + sizeof(DiagHead), g_pDiag + oRecords[i] + sizeof(DiagHead), oHead.nArgBytes) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Write all recorded diagnostics of this thread sorted by location, each distinct one once,
+// with a single write to stderr, and clear them. Records at the same location keep their order.
+void Diag_Flush()
+{
+	std::vector<size_t> oRecords;
+	const char *ppszArgs[DIAG_MAX_ARGS];
+	DiagHead oHead, oFirst;
+	size_t i, nFirst = 0;
+	const char *p;
+	int j;
+
+	if (g_nDiagUsed == 0)
+		return;
+	for(i = 0; i < g_nDiagUsed; i += sizeof(DiagHead) + oHead.nArgBytes){
+		memcpy(&oHead, g_pDiag + i, sizeof(DiagHead));
+		oRecords.push_back(i);
+	}
+	std::stable_sort(oRecords.begin(), oRecords.end(), [](size_t a, size_t b){
+		DiagHead oA, oB;
+		memcpy(&oA, g_pDiag + a, sizeof(DiagHead));
+		memcpy(&oB, g_pDiag + b, sizeof(DiagHead));
+		return oA.nLine != oB.nLine ? oA.nLine < oB.nLine : oA.nCol < oB.nCol;
+	});
+
+	g_nDiagOutUsed = 0;
+	for(i = 0; i < oRecords.size(); i++){
+		memcpy(&oHead, g_pDiag + oRecords[i], sizeof(DiagHead));
+		memcpy(&oFirst, g_pDiag + oRecords[nFirst], sizeof(DiagHead));
+		if (oHead.nLine != oFirst.nLine || oHead.nCol != oFirst.nCol)
+			nFirst = i;
+		else if (is_repeated(oRecords, nFirst, i))
+			continue;	// the same message at the same place.
+
+		p = g_pDiag + oRecords[i] + sizeof(DiagHead);
+		for(j = 0; j < DIAG_MAX_ARGS; j++){
+			ppszArgs[j] = "";
+			if (j < k_pDiagInfo[oHead.nCode].nArgs){
+				ppszArgs[j] = p;
+				p += strlen(p) + 1;
+			}
+		}
+		if (g_bDiagJson)
+			out_json(&oHead, ppszArgs);
+		else
+			out_text(&oHead, ppszArgs);
+	}
+	OutBuf_ErrWrite(g_pDiagOut, g_nDiagOutUsed);
+	g_nDiagUsed = 0;
+}
+
+// Drop the recorded diagnostics and release the buffers of this thread.
+void Diag_Release()
+{
+	free(g_pDiag);
+	free(g_pDiagOut);
+	g_pDiag = g_pDiagOut = NULL;
+	g_nDiagUsed = g_nDiagSize = 0;
+	g_nDiagOutUsed = g_nDiagOutSize = 0;
+}
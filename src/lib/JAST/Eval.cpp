@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <unordered_map>
+#include <vector>
+
+#include "JAST/jast_api.h"
+#include "JAST/jast_internal.h"
+
+// Tree-walking interpreter: the eval callbacks of the nodes run a checked program straight from the AST,
+// reading and writing variables at the slots semantic analysis bound them to.
+// Locals live in frames on one stack of values, a frame is as large as the slots of its function,
+// and the arguments of a call are evaluated into the bottom of the callee's frame.
+// Arrays are cells of their own, owned by the frame of the function that declared them.
+
+#define EVAL_STACK_SLOTS	(1 << 22)	// values of all frames.
+#define EVAL_C_STACK_SPARE	(1 << 20)	// bytes of C stack left for the rest of the parser and the C library.
+#define EVAL_C_STACK_MAX	(256 << 20)	// bytes of C stack nested calls may take without a stack limit.
+
+struct EvalArray {
+	AstNode *pTypeNode;			// declaration and slot of the array variable.
+	int nSlot;
+	int nDepth;					// call depth of the frame that owns it.
+	EvalValue *pCells;
+};
+
+EvalValue *g_pEvalGlobals = NULL;
+EvalValue *g_pEvalStack = NULL;
+int g_nEvalBase = 0;			// frame of the running function.
+int g_nEvalTop = 0;				// first free value of the stack.
+int g_nEvalDepth = 0;
+char *g_pEvalCStack = NULL;		// C stack at Eval_Run(), calls recurse in C below it.
+size_t g_nEvalCStack = 0;		// bytes of C stack below it nested calls may take.
+AstNode *g_pEvalFunc = NULL;	// FunctionNode running, NULL in the program body.
+std::vector<EvalArray> g_oEvalArrays;
+std::unordered_map<AstNode *, int> g_oEvalFrameSizes;
+bool g_bEvalReturning = false;	// a return statement ran, statements are skipped up to the call.
+EvalValue g_oEvalResult;
+jmp_buf g_oEvalAbort;
+
+// ----------------------------------------------------------------
+// Running a program
+// ----------------------------------------------------------------
+
+static void release_eval()
+{
+	for(size_t i = 0; i < g_oEvalArrays.size(); i++)
+		free(g_oEvalArrays[i].pCells);
+	std::vector<EvalArray>().swap(g_oEvalArrays);
+	g_oEvalFrameSizes.clear();
+	free(g_pEvalGlobals);
+	free(g_pEvalStack);
+	g_pEvalGlobals = g_pEvalStack = NULL;
+	g_pEvalFunc = NULL;
+	g_bEvalReturning = false;
+}
+
+// Run a program that passed semantic analysis without errors, its output goes through OutBuf.
+// Return 0, or 1 after a runtime error.
+int Eval_Run(AstNode *pRoot)
+{
+	ProgramNode *pProgram = (ProgramNode *)pRoot->pBody;
+	struct rlimit oLimit;
+	int nRet = 0;
+
+	// calloc() leaves the pages untouched until a deep call reaches them.
+	g_pEvalGlobals = (EvalValue *)calloc(CountSlots(pRoot, true) + 1, sizeof(EvalValue));
+	g_pEvalStack = (EvalValue *)calloc(EVAL_STACK_SLOTS, sizeof(EvalValue));
+	g_nEvalBase = g_nEvalDepth = 0;
+	g_pEvalCStack = (char *)__builtin_frame_address(0);
+	g_nEvalCStack = EVAL_C_STACK_MAX;
+	if (getrlimit(RLIMIT_STACK, &oLimit) == 0 && oLimit.rlim_cur != RLIM_INFINITY && oLimit.rlim_cur < EVAL_C_STACK_MAX)
+		g_nEvalCStack = (oLimit.rlim_cur > 2 * EVAL_C_STACK_SPARE) ? oLimit.rlim_cur - EVAL_C_STACK_SPARE : oLimit.rlim_cur / 2;
+	g_nEvalTop = CountSlots(pProgram->pCompoundStatementNode, false);
+	if (setjmp(g_oEvalAbort) == 0){
+		if (g_nEvalTop > EVAL_STACK_SLOTS)
+			Eval_Error(pRoot, "stack overflow");
+		EvalAstNode(pRoot);
+	}
+	else
+		nRet = 1;
+	OutBuf_Flush();
+	release_eval();
+	return nRet;
+}
+
+// Stop the program at a runtime error of a node.
+void Eval_Error(AstNode *pAst, const char *format, ...)
+{
+	va_list args;
+
+	OutBuf_ErrPrintf("Runtime error in line %d, column %d: ", pAst->location.line, pAst->location.col);
+	va_start(args, format);
+	OutBuf_ErrVPrintf(format, args);
+	va_end(args);
+	OutBuf_ErrPrintf("\n");
+	longjmp(g_oEvalAbort, 1);
+}
+
+// ----------------------------------------------------------------
+// Variables and calls
+// ----------------------------------------------------------------
+
+// Get the value of a variable bound to a level and slot, a global or a local of the running function.
+EvalValue *Eval_Variable(int nLevel, int nSlot)
+{
+	return (nLevel > 0) ? &g_pEvalStack[g_nEvalBase + nSlot] : &g_pEvalGlobals[nSlot];
+}
+
+// Get zeroed cells for an array variable reaching its declaration. The cells of a declaration
+// in a loop are reused by every iteration, they go away when the declaring function returns.
+EvalValue *Eval_NewArray(AstNode *pTypeNode, int nSlot)
+{
+	EvalArray oArray;
+	size_t nCells = 1;
+
+	for(AstNode *p = ((TypeNode *)pTypeNode->pBody)->pFirstIntNode; p; p = p->pNext)
+		nCells *= ((IntValueNode *)p->pBody)->nValue;
+	for(size_t i = g_oEvalArrays.size(); i > 0 && g_oEvalArrays[i - 1].nDepth == g_nEvalDepth; i--){
+		if (g_oEvalArrays[i - 1].pTypeNode == pTypeNode && g_oEvalArrays[i - 1].nSlot == nSlot){
+			memset(g_oEvalArrays[i - 1].pCells, 0, nCells * sizeof(EvalValue));
+			return g_oEvalArrays[i - 1].pCells;
+		}
+	}
+	oArray.pTypeNode = pTypeNode;
+	oArray.nSlot = nSlot;
+	oArray.nDepth = g_nEvalDepth;
+	oArray.pCells = (EvalValue *)calloc(nCells, sizeof(EvalValue));
+	g_oEvalArrays.push_back(oArray);
+	return oArray.pCells;
+}
+
+// Get room for the arguments of a call on top of the stack, they become the first locals of the callee.
+EvalValue *Eval_PushArgs(AstNode *pCall, int nArgs)
+{
+	EvalValue *pArgs = &g_pEvalStack[g_nEvalTop];
+
+	if (g_nEvalTop + nArgs > EVAL_STACK_SLOTS)
+		Eval_Error(pCall, "stack overflow");
+	g_nEvalTop += nArgs;
+	return pArgs;
+}
+
+// Call a function with the arguments from Eval_PushArgs(), return its result.
+EvalValue Eval_Call(AstNode *pCall, AstNode *pFunc, EvalValue *pArgs)
+{
+	FunctionNode *pNode = (FunctionNode *)pFunc->pBody;
+	int nBase = pArgs - g_pEvalStack, nOldBase = g_nEvalBase, nSize;
+	AstNode *pOldFunc = g_pEvalFunc;
+	EvalValue oResult;
+
+	auto it = g_oEvalFrameSizes.find(pFunc);
+	if (it == g_oEvalFrameSizes.end()){
+		// A function without a body has no parameter slots, its frame still holds the arguments.
+		nSize = CountSlots(pFunc, false);
+		if (nSize < AstLinkLength(pNode->pFirstArgTypeNode))
+			nSize = AstLinkLength(pNode->pFirstArgTypeNode);
+		it = g_oEvalFrameSizes.insert(std::make_pair(pFunc, nSize)).first;
+	}
+	if ((size_t)(g_pEvalCStack - (char *)__builtin_frame_address(0)) > g_nEvalCStack || nBase + it->second > EVAL_STACK_SLOTS)
+		Eval_Error(pCall, "stack overflow");
+
+	g_nEvalDepth++;
+	g_nEvalBase = nBase;
+	g_nEvalTop = nBase + it->second;
+	g_pEvalFunc = pFunc;
+	EvalAstNode(pFunc);
+	if (g_bEvalReturning)
+		oResult = g_oEvalResult;
+	else
+		memset(&oResult, 0, sizeof(oResult));		// falling off the end returns zero.
+	g_bEvalReturning = false;
+	while(!g_oEvalArrays.empty() && g_oEvalArrays.back().nDepth == g_nEvalDepth){
+		free(g_oEvalArrays.back().pCells);
+		g_oEvalArrays.pop_back();
+	}
+	g_nEvalDepth--;
+	g_nEvalBase = nOldBase;
+	g_nEvalTop = nBase;
+	g_pEvalFunc = pOldFunc;
+	return oResult;
+}
+
+// Return type of the running function, kVoid in the program body.
+SymbolValue_t Eval_GetReturnType()
+{
+	return g_pEvalFunc ? ((FunctionNode *)g_pEvalFunc->pBody)->nReturnType : kVoid;
+}
+
+// Leave the running function with a value.
+void Eval_Return(EvalValue oValue)
+{
+	g_oEvalResult = oValue;
+	g_bEvalReturning = true;
+}
+
+bool Eval_IsReturning()
+{
+	return g_bEvalReturning;
+}
+
+// ----------------------------------------------------------------
+// Strings, input and output
+// ----------------------------------------------------------------
+
+// Concatenate two strings into the arena of the compilation.
+const char *Eval_Concat(const char *pszLeft, const char *pszRight)
+{
+	size_t nLeft = pszLeft ? strlen(pszLeft) : 0, nRight = pszRight ? strlen(pszRight) : 0;
+	char *psz = Arena_AllocChars(nLeft + nRight + 1);
+
+	if (nLeft)
+		memcpy(psz, pszLeft, nLeft);
+	if (nRight)
+		memcpy(psz + nLeft, pszRight, nRight);
+	psz[nLeft + nRight] = '\0';
+	return psz;
+}
+
+// Print a value of a scalar type and a newline.
+void Eval_Print(SymbolValue_t nType, EvalValue oValue)
+{
+	switch(nType){
+	case kReal:		OutBuf_Printf("%f\n", oValue.d);	break;
+	case kBoolean:	OutBuf_Puts(oValue.n ? "true\n" : "false\n");	break;
+	case kString:	OutBuf_Printf("%s\n", oValue.psz ? oValue.psz : "");	break;
+	default:		OutBuf_Printf("%d\n", oValue.n);	break;
+	}
+}
+
+// Read a value of a scalar type from stdin, booleans and strings are words separated by white space.
+EvalValue Eval_Read(AstNode *pAst, SymbolValue_t nType)
+{
+	EvalValue oValue;
+	char *psz = NULL;
+	bool bOk;
+
+	OutBuf_Flush();
+	switch(nType){
+	case kReal:
+		bOk = scanf("%lf", &oValue.d) == 1;
+		break;
+	case kInteger:
+		bOk = scanf("%d", &oValue.n) == 1;
+		break;
+	default:
+		if ((bOk = scanf("%ms", &psz) == 1)){
+			if (nType == kBoolean){
+				bOk = strcmp(psz, "true") == 0 || strcmp(psz, "false") == 0;
+				oValue.n = strcmp(psz, "true") == 0;
+			}
+			else
+				oValue.psz = Eval_Concat(psz, NULL);
+		}
+		free(psz);
+		break;
+	}
+	if (!bOk)
+		Eval_Error(pAst, "cannot read a value of type %s", GetSymbolString(nType));
+	return oValue;
+}
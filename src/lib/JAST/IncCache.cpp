@@ -0,0 +1,676 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "JAST/jast_api.h"
+#include "JAST/jast_internal.h"
+
+// extern from scanner.l
+extern const char *LexGetSourceCode(int nLine, int *pnLeng);
+
+// Incremental cache: the semantic results of every function body, keyed by a 128-bit hash of
+//   - the function subtree as serialized by AstBin, names and locations included,
+//   - the source lines it spans, which error messages quote,
+//   - every symbol its names resolve to before the body is visited (so a changed callee or global
+//     invalidates its users), or the whole symbol table when //&D+ dumps it on pop.
+// The cached results are the error count, the stdout and stderr bytes and diagnostics of the visit, and the types
+// the visit fills into expression, variable-reference and invocation nodes, in pre-order, with their bindings.
+// Cache file: "JINC", version, number of entries, then for each entry its key, error count,
+// byte counts and data, all native-endian; only the entries used by the last run are kept.
+#define INC_CACHE_MAGIC		"JINC"
+#define INC_CACHE_VERSION	5
+#define MIN_INC_SLOTS		256
+#define MIN_INC_TYPES		1024
+
+struct IncEntry {
+	uint64_t pnKey[2];
+	int nErr;
+	bool bUsed;
+	char *pOut;					// captured stdout bytes.
+	int nOut;
+	char *pErr;					// captured stderr records, see OutBuf_ErrWrite().
+	int nErrBytes;
+	char *pDiag;				// diagnostic records, see Diag_Since().
+	int nDiag;
+	int *pnTypes;				// filled types in pre-order.
+	int nTypes;
+};
+
+const char *g_pszIncFile = NULL;	// NULL when the cache is off.
+IncEntry **g_ppIncSlots = NULL;		// open addressing by key.
+int g_nIncSlots = 0;				// always a power of 2.
+int g_nIncUsed = 0;
+
+// Key of the function being visited between IncCache_Replay() and IncCache_End().
+uint64_t g_pnIncKey[2];
+size_t g_nIncDiagMark = 0;			// diagnostics before the visit.
+
+// Types gathered from or written back to a function subtree.
+int *g_pnIncTypes = NULL;
+int g_nIncTypes = 0;
+int g_nIncTypesCap = 0;
+
+// ----------------------------------------------------------------
+// Hashing
+// ----------------------------------------------------------------
+
+// Two independent 64-bit lanes: FNV-1a, and a multiply-xorshift over the same bytes.
+static void hash_bytes(uint64_t pnHash[2], const void *p, size_t n)
+{
+	const unsigned char *pc = (const unsigned char *)p;
+
+	while(n-- > 0){
+		pnHash[0] = (pnHash[0] ^ *pc) * 1099511628211ull;
+		pnHash[1] = (pnHash[1] + *pc + 1) * 0x9e3779b97f4a7c15ull;
+		pnHash[1] ^= pnHash[1] >> 29;
+		pc++;
+	}
+}
+
+static void hash_int(uint64_t pnHash[2], int n)
+{
+	hash_bytes(pnHash, &n, sizeof(n));
+}
+
+// Hash a string with its terminating '\0', so consecutive strings cannot run into each other.
+static void hash_string(uint64_t pnHash[2], const char *psz)
+{
+	hash_bytes(pnHash, psz ? psz : "", psz ? strlen(psz) + 1 : 1);
+}
+
+// Hash the symbol a name resolves to now, or that it resolves to nothing.
+static void hash_symbol(uint64_t pnHash[2], const char *pszName)
+{
+	int n = SymTab_Lookup(pszName);
+
+	hash_string(pnHash, pszName);
+	hash_int(pnHash, n < 0 ? -1 : SymTab_GetLevel(n));
+	if (n < 0)
+		return;
+	hash_int(pnHash, SymTab_GetSlot(n));		// bound into the references.
+	hash_int(pnHash, SymTab_GetKindValue(n));
+	hash_int(pnHash, SymTab_GetTypeValue(n));
+	hash_string(pnHash, SymTab_GetTypeStr(n));
+	hash_string(pnHash, SymTab_GetAttr(n));
+}
+
+struct KeyWalk {
+	uint64_t *pnHash;
+	int nLastLine;
+};
+
+// Hash the symbols of the names used in a node and track the last source line of the subtree.
+static void key_node(AstNode *pAst, void *pArg)
+{
+	KeyWalk *pWalk = (KeyWalk *)pArg;
+
+	if (pAst->location.line > pWalk->nLastLine)
+		pWalk->nLastLine = pAst->location.line;
+	switch(pAst->nKind){
+	case kAstId:
+		hash_symbol(pWalk->pnHash, ((IdNode *)pAst->pBody)->pszName);
+		break;
+	case kAstVariableRef:
+		hash_symbol(pWalk->pnHash, ((VariableRefNode *)pAst->pBody)->pszVarName);
+		break;
+	case kAstFunctionInvocation:
+		hash_symbol(pWalk->pnHash, ((FunctionInvocationNode *)pAst->pBody)->pszFuncName);
+		break;
+	case kAstFunction:
+		hash_symbol(pWalk->pnHash, ((FunctionNode *)pAst->pBody)->pszFuncName);
+		break;
+	default:
+		break;
+	}
+}
+
+// Compute the key of a function node in the current symbol table.
+static void make_key(AstNode *pFunc, uint64_t pnKey[2])
+{
+	KeyWalk oWalk;
+	const char *p;
+	size_t nSize;
+	int i, n, nLeng;
+
+	pnKey[0] = 14695981039346656037ull;
+	pnKey[1] = 0x243f6a8885a308d3ull;
+	p = AstBin_Serialize(pFunc, &nSize);
+	hash_bytes(pnKey, p, nSize);
+
+	oWalk.pnHash = pnKey;
+	oWalk.nLastLine = pFunc->location.line;
+	ForEachAstNode(pFunc, key_node, &oWalk);
+
+	// Every pop dumps the whole table, so the output depends on all symbols visible now.
+	hash_int(pnKey, SymTab_IsDumpEnabled());
+	if (SymTab_IsDumpEnabled()){
+		n = SymTab_GetCount();
+		for(i = 0; i < n; i++){
+			hash_string(pnKey, SymTab_GetName(i));
+			hash_int(pnKey, SymTab_GetLevel(i));
+			hash_string(pnKey, SymTab_GetKind(i));
+			hash_string(pnKey, SymTab_GetTypeStr(i));
+			hash_string(pnKey, SymTab_GetAttr(i));
+		}
+	}
+
+	for(i = pFunc->location.line; i <= oWalk.nLastLine; i++){
+		p = LexGetSourceCode(i - 1, &nLeng);
+		hash_int(pnKey, p ? nLeng : -1);
+		if (p)
+			hash_bytes(pnKey, p, nLeng);
+	}
+}
+
+// ----------------------------------------------------------------
+// Filled types
+// ----------------------------------------------------------------
+
+static void put_type(int n)
+{
+	if (g_nIncTypes == g_nIncTypesCap){
+		g_nIncTypesCap = g_nIncTypesCap ? g_nIncTypesCap * 2 : MIN_INC_TYPES;
+		g_pnIncTypes = (int *)realloc(g_pnIncTypes, g_nIncTypesCap * sizeof(int));
+	}
+	g_pnIncTypes[g_nIncTypes++] = n;
+}
+
+// Bindings are stored without pointers: a local variable as the ordinal of its declaration among the
+// declarations of the function in pre-order, which come before their uses, and a global variable or a
+// function as found by its name again when the entry is replayed. kBindNone marks an unbound reference.
+#define kBindNone			-2
+#define kBindByName			-1
+
+// Declarations of the function walked by gather_types() or restore_types(), in pre-order.
+struct TypeWalk {
+	std::unordered_map<AstNode*, int> oDeclOrdinals;	// TypeNode of a declaration to its ordinal.
+	AstNode **ppDecls;
+	int nDecls;
+	int nDeclsCap;
+	int *pn;											// next type to restore.
+};
+
+static void add_declaration(TypeWalk *pWalk, AstNode *pDecl)
+{
+	if (pWalk->nDecls == pWalk->nDeclsCap){
+		pWalk->nDeclsCap = pWalk->nDeclsCap ? pWalk->nDeclsCap * 2 : 64;
+		pWalk->ppDecls = (AstNode **)realloc(pWalk->ppDecls, pWalk->nDeclsCap * sizeof(AstNode *));
+	}
+	pWalk->ppDecls[pWalk->nDecls++] = pDecl;
+}
+
+// Get the declaration node of the symbol a global name resolves to now.
+static AstNode *lookup_node(const char *pszName)
+{
+	int n = SymTab_Lookup(pszName);
+	return n < 0 ? NULL : SymTab_GetAstNode(n);
+}
+
+// Gather the types filled by visit() into g_pnIncTypes.
+static void gather_types(AstNode *pAst, void *pArg)
+{
+	TypeWalk *pWalk = (TypeWalk *)pArg;
+	VariableRefNode *pVarRef;
+
+	switch(pAst->nKind){
+	case kAstDeclaration:
+		pWalk->oDeclOrdinals[((DeclarationNode *)pAst->pBody)->pTypeNode] = pWalk->nDecls++;
+		break;
+	case kAstId:
+		put_type(((IdNode *)pAst->pBody)->nLevel);
+		put_type(((IdNode *)pAst->pBody)->nSlot);
+		break;
+	case kAstExpression:
+		put_type(((ExpressionNode *)pAst->pBody)->nResultType);
+		put_type(((ExpressionNode *)pAst->pBody)->nOp);
+		break;
+	case kAstVariableRef:
+		pVarRef = (VariableRefNode *)pAst->pBody;
+		put_type(pVarRef->nVarType);
+		put_type(pVarRef->nLevel);
+		put_type(pVarRef->nSlot);
+		if (!pVarRef->pTypeNode)
+			put_type(kBindNone);
+		else if (pVarRef->nLevel == 0)
+			put_type(kBindByName);
+		else{
+			auto it = pWalk->oDeclOrdinals.find(pVarRef->pTypeNode);
+			put_type(it != pWalk->oDeclOrdinals.end() ? it->second : kBindNone);
+		}
+		break;
+	case kAstFunctionInvocation:
+		put_type(((FunctionInvocationNode *)pAst->pBody)->nReturnType);
+		put_type(((FunctionInvocationNode *)pAst->pBody)->pFuncNode ? kBindByName : kBindNone);
+		break;
+	default:
+		break;
+	}
+}
+
+// What a function subtree allows in its cache entry, counted by count_types().
+struct TypeBounds {
+	int nTypes;			// types gathered by gather_types().
+	int nMaxLevel;		// deepest scope: the function and each compound statement or for loop in it.
+	int nMaxSlot;		// locals of the frame, at most one per declared identifier.
+};
+
+static void count_types(AstNode *pAst, void *pArg)
+{
+	TypeBounds *pBounds = (TypeBounds *)pArg;
+
+	if (pAst->nKind == kAstExpression || pAst->nKind == kAstFunctionInvocation || pAst->nKind == kAstId)
+		pBounds->nTypes += 2;
+	else if (pAst->nKind == kAstVariableRef)
+		pBounds->nTypes += 4;
+	if (pAst->nKind == kAstId)
+		pBounds->nMaxSlot++;
+	else if (pAst->nKind == kAstCompoundStatement || pAst->nKind == kAstFor)
+		pBounds->nMaxLevel++;
+}
+
+// A type, or kUnknown after an error.
+static bool is_type_value(int n)
+{
+	return n == kUnknown || (n >= kInteger && n <= kVoid);
+}
+
+// An operator, or kUnknown for an expression without one.
+static bool is_operator_value(int n)
+{
+	return n == kUnknown || (n >= kADD && n <= kSTRCAT);
+}
+
+// A check of the types of a cache entry against the function before restore_types() writes them.
+struct TypeCheck {
+	const TypeBounds *pBounds;
+	AstNode **ppDeclTypes;	// TypeNode of each declaration so far, in pre-order.
+	int nDecls;
+	int nDeclsCap;
+	bool bBound;			// the entry has no errors, so every name in it is bound.
+	const int *pn;			// next type to check.
+	bool bOk;
+};
+
+// Check the level and slot of a local, -1 for one that is not bound.
+static bool is_local(const TypeCheck *pCheck, int nLevel, int nSlot)
+{
+	if (nLevel == -1)
+		return nSlot == -1 && !pCheck->bBound;
+	return nLevel >= 1 && nLevel <= pCheck->pBounds->nMaxLevel && nSlot >= 0 && nSlot < pCheck->pBounds->nMaxSlot;
+}
+
+// Check the type of a variable reference against the declaration it is bound to: the scalar type,
+// or kUnknown when the reference leaves dimensions of an array.
+static bool is_var_type(AstNode *pTypeNode, int nVarType)
+{
+	return pTypeNode && pTypeNode->nKind == kAstType
+		&& (nVarType == kUnknown || nVarType == ((TypeNode *)pTypeNode->pBody)->nScalerType);
+}
+
+// Check the types of a cache entry in the order of gather_types(): every level, slot and binding must
+// be one the function can have in the current symbol table, or the entry is stale or corrupt.
+static void check_types(AstNode *pAst, void *pArg)
+{
+	TypeCheck *pCheck = (TypeCheck *)pArg;
+	const int *pn = pCheck->pn;
+	AstNode *pNode;
+	int n;
+
+	switch(pAst->nKind){
+	case kAstDeclaration:
+		if (pCheck->nDecls == pCheck->nDeclsCap){
+			pCheck->nDeclsCap = pCheck->nDeclsCap ? pCheck->nDeclsCap * 2 : 64;
+			pCheck->ppDeclTypes = (AstNode **)realloc(pCheck->ppDeclTypes, pCheck->nDeclsCap * sizeof(AstNode *));
+		}
+		pCheck->ppDeclTypes[pCheck->nDecls++] = ((DeclarationNode *)pAst->pBody)->pTypeNode;
+		break;
+	case kAstId:
+		pCheck->bOk &= is_local(pCheck, pn[0], pn[1]);
+		pCheck->pn += 2;
+		break;
+	case kAstExpression:
+		pCheck->bOk &= is_type_value(pn[0]) && is_operator_value(pn[1]);
+		pCheck->pn += 2;
+		break;
+	case kAstVariableRef:
+		if (pn[3] == kBindByName){
+			// A global, found by its name again at the same slot.
+			n = SymTab_Lookup(((VariableRefNode *)pAst->pBody)->pszVarName);
+			pCheck->bOk &= pn[1] == 0 && n >= 0 && SymTab_GetLevel(n) == 0 && SymTab_GetSlot(n) == pn[2]
+				&& is_var_type(SymTab_GetAstNode(n), pn[0]);
+		}
+		else if (pn[3] == kBindNone)
+			pCheck->bOk &= !pCheck->bBound && is_type_value(pn[0]) && (pn[1] == -1 || is_local(pCheck, pn[1], pn[2]));
+		else
+			pCheck->bOk &= pn[3] >= 0 && pn[3] < pCheck->nDecls && is_local(pCheck, pn[1], pn[2])
+				&& is_var_type(pCheck->ppDeclTypes[pn[3]], pn[0]);
+		pCheck->pn += 4;
+		break;
+	case kAstFunctionInvocation:
+		if (pn[1] == kBindByName){
+			pNode = lookup_node(((FunctionInvocationNode *)pAst->pBody)->pszFuncName);
+			pCheck->bOk &= pNode && pNode->nKind == kAstFunction && pn[0] == ((FunctionNode *)pNode->pBody)->nReturnType;
+		}
+		else
+			pCheck->bOk &= pn[1] == kBindNone && !pCheck->bBound && is_type_value(pn[0]);
+		pCheck->pn += 2;
+		break;
+	default:
+		break;
+	}
+}
+
+// Write the types of a cache entry back, in the order of gather_types().
+static void restore_types(AstNode *pAst, void *pArg)
+{
+	TypeWalk *pWalk = (TypeWalk *)pArg;
+	VariableRefNode *pVarRef;
+	FunctionInvocationNode *pCall;
+	int nBind;
+
+	switch(pAst->nKind){
+	case kAstDeclaration:
+		add_declaration(pWalk, pAst);
+		break;
+	case kAstId:
+		((IdNode *)pAst->pBody)->nLevel = *pWalk->pn++;
+		((IdNode *)pAst->pBody)->nSlot = *pWalk->pn++;
+		break;
+	case kAstExpression:
+		((ExpressionNode *)pAst->pBody)->nResultType = (SymbolValue_t)*pWalk->pn++;
+		((ExpressionNode *)pAst->pBody)->nOp = (SymbolValue_t)*pWalk->pn++;
+		break;
+	case kAstVariableRef:
+		pVarRef = (VariableRefNode *)pAst->pBody;
+		pVarRef->nVarType = (SymbolValue_t)*pWalk->pn++;
+		pVarRef->nLevel = *pWalk->pn++;
+		pVarRef->nSlot = *pWalk->pn++;
+		nBind = *pWalk->pn++;
+		pVarRef->pTypeNode = NULL;
+		if (nBind == kBindByName)
+			pVarRef->pTypeNode = lookup_node(pVarRef->pszVarName);
+		else if (nBind >= 0 && nBind < pWalk->nDecls)
+			pVarRef->pTypeNode = ((DeclarationNode *)pWalk->ppDecls[nBind]->pBody)->pTypeNode;
+		break;
+	case kAstFunctionInvocation:
+		pCall = (FunctionInvocationNode *)pAst->pBody;
+		pCall->nReturnType = (SymbolValue_t)*pWalk->pn++;
+		nBind = *pWalk->pn++;
+		pCall->pFuncNode = (nBind == kBindByName) ? lookup_node(pCall->pszFuncName) : NULL;
+		break;
+	default:
+		break;
+	}
+}
+
+// ----------------------------------------------------------------
+// Entries
+// ----------------------------------------------------------------
+
+// Find the slot of a key, or the empty slot where it should be placed.
+static IncEntry **find_slot(const uint64_t pnKey[2])
+{
+	unsigned int i, nMask = g_nIncSlots - 1;
+	IncEntry **pp;
+
+	for(i = (unsigned int)pnKey[0] & nMask; ; i = (i + 1) & nMask){
+		pp = &g_ppIncSlots[i];
+		if (!*pp || ((*pp)->pnKey[0] == pnKey[0] && (*pp)->pnKey[1] == pnKey[1]))
+			return pp;
+	}
+}
+
+// Add an entry, replacing the one with the same key.
+static void add_entry(IncEntry *pEntry)
+{
+	int i, nOld = g_nIncSlots;
+	IncEntry **ppOld = g_ppIncSlots, **pp;
+
+	if ((g_nIncUsed + 1) * 2 > g_nIncSlots){
+		g_nIncSlots = nOld ? nOld * 2 : MIN_INC_SLOTS;
+		g_ppIncSlots = (IncEntry **)calloc(g_nIncSlots, sizeof(IncEntry *));
+		for(i = 0; i < nOld; i++){
+			if (ppOld[i])
+				*find_slot(ppOld[i]->pnKey) = ppOld[i];
+		}
+		free(ppOld);
+	}
+	pp = find_slot(pEntry->pnKey);
+	if (*pp){
+		free(*pp);
+		g_nIncUsed--;
+	}
+	*pp = pEntry;
+	g_nIncUsed++;
+}
+
+// Allocate an entry with its data in the same block.
+static IncEntry *new_entry(int nOut, int nErrBytes, int nDiag, int nTypes)
+{
+	IncEntry *p = (IncEntry *)malloc(sizeof(IncEntry) + nTypes * sizeof(int) + nOut + nErrBytes + nDiag);
+
+	if (!p){
+		fprintf(stderr, "Out of memory for the incremental cache\n");
+		exit(-1);
+	}
+	p->pnTypes = (int *)(p + 1);
+	p->pOut = (char *)(p->pnTypes + nTypes);
+	p->pErr = p->pOut + nOut;
+	p->pDiag = p->pErr + nErrBytes;
+	p->nOut = nOut;
+	p->nErrBytes = nErrBytes;
+	p->nDiag = nDiag;
+	p->nTypes = nTypes;
+	p->bUsed = false;
+	return p;
+}
+
+// ----------------------------------------------------------------
+// Cache file
+// ----------------------------------------------------------------
+
+// Read one entry, return NULL at the end of the file or on a short or invalid record.
+static IncEntry *read_entry(FILE *fp)
+{
+	uint64_t pnKey[2];
+	int pnHead[5];		// error count, stdout bytes, stderr bytes, diagnostic bytes, types.
+	IncEntry *p;
+
+	if (fread(pnKey, sizeof(pnKey), 1, fp) != 1 || fread(pnHead, sizeof(pnHead), 1, fp) != 1)
+		return NULL;
+	if (pnHead[1] < 0 || pnHead[2] < 0 || pnHead[3] < 0 || pnHead[4] < 0
+	 || pnHead[1] > (1 << 30) || pnHead[2] > (1 << 30) || pnHead[3] > (1 << 30) || pnHead[4] > (1 << 28))
+		return NULL;
+	p = new_entry(pnHead[1], pnHead[2], pnHead[3], pnHead[4]);
+	p->pnKey[0] = pnKey[0];
+	p->pnKey[1] = pnKey[1];
+	p->nErr = pnHead[0];
+	if (fread(p->pnTypes, sizeof(int), p->nTypes, fp) != (size_t)p->nTypes
+	 || fread(p->pOut, 1, p->nOut, fp) != (size_t)p->nOut
+	 || fread(p->pErr, 1, p->nErrBytes, fp) != (size_t)p->nErrBytes
+	 || fread(p->pDiag, 1, p->nDiag, fp) != (size_t)p->nDiag){
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+// Turn the cache on and load the entries of an earlier run from pszFile, if it exists.
+// A missing, foreign or truncated file just gives fewer cached functions.
+void IncCache_Open(const char *pszFile)
+{
+	FILE *fp;
+	char pszMagic[4];
+	int nVersion, nEntries, i;
+	IncEntry *p;
+
+	g_pszIncFile = pszFile;
+	fp = fopen(pszFile, "rb");
+	if (!fp)
+		return;
+	if (fread(pszMagic, 4, 1, fp) == 1 && memcmp(pszMagic, INC_CACHE_MAGIC, 4) == 0
+	 && fread(&nVersion, sizeof(int), 1, fp) == 1 && nVersion == INC_CACHE_VERSION
+	 && fread(&nEntries, sizeof(int), 1, fp) == 1){
+		for(i = 0; i < nEntries && (p = read_entry(fp)); i++)
+			add_entry(p);
+	}
+	fclose(fp);
+}
+
+// Write the entries used in this run to the cache file, return 0 on success, -1 on failure.
+int IncCache_Save()
+{
+	FILE *fp;
+	int i, nEntries = 0, nVersion = INC_CACHE_VERSION;
+	int pnHead[5];
+	IncEntry *p;
+	bool bOk;
+
+	if (!g_pszIncFile)
+		return 0;
+	for(i = 0; i < g_nIncSlots; i++){
+		if (g_ppIncSlots[i] && g_ppIncSlots[i]->bUsed)
+			nEntries++;
+	}
+	fp = fopen(g_pszIncFile, "wb");
+	bOk = fp && fwrite(INC_CACHE_MAGIC, 4, 1, fp) == 1 && fwrite(&nVersion, sizeof(int), 1, fp) == 1
+		&& fwrite(&nEntries, sizeof(int), 1, fp) == 1;
+	for(i = 0; bOk && i < g_nIncSlots; i++){
+		p = g_ppIncSlots[i];
+		if (!p || !p->bUsed)
+			continue;
+		pnHead[0] = p->nErr;
+		pnHead[1] = p->nOut;
+		pnHead[2] = p->nErrBytes;
+		pnHead[3] = p->nDiag;
+		pnHead[4] = p->nTypes;
+		bOk = fwrite(p->pnKey, sizeof(p->pnKey), 1, fp) == 1 && fwrite(pnHead, sizeof(pnHead), 1, fp) == 1
+			&& fwrite(p->pnTypes, sizeof(int), p->nTypes, fp) == (size_t)p->nTypes
+			&& fwrite(p->pOut, 1, p->nOut, fp) == (size_t)p->nOut
+			&& fwrite(p->pErr, 1, p->nErrBytes, fp) == (size_t)p->nErrBytes
+			&& fwrite(p->pDiag, 1, p->nDiag, fp) == (size_t)p->nDiag;
+	}
+	if (fp && fclose(fp) != 0)
+		bOk = false;
+	if (!bOk){
+		fprintf(stderr, "Cannot write incremental cache file %s\n", g_pszIncFile);
+		return -1;
+	}
+	return 0;
+}
+
+// Release all entries and turn the cache off.
+void IncCache_Release()
+{
+	for(int i = 0; i < g_nIncSlots; i++)
+		free(g_ppIncSlots[i]);
+	free(g_ppIncSlots);
+	free(g_pnIncTypes);
+	g_ppIncSlots = NULL;
+	g_pnIncTypes = NULL;
+	g_nIncSlots = g_nIncUsed = 0;
+	g_nIncTypes = g_nIncTypesCap = 0;
+	g_pszIncFile = NULL;
+}
+
+// ----------------------------------------------------------------
+// Visit hooks
+// ----------------------------------------------------------------
+
+// Whether --incremental turned the cache on.
+bool IncCache_IsOpen()
+{
+	return g_pszIncFile != NULL;
+}
+
+// Replay the cached results of a function body, called where its body would be visited.
+// Return false if the cache is off or has no results for the body in the current symbol table,
+// then the body has to be visited between IncCache_Begin() and IncCache_End().
+bool IncCache_Replay(AstNode *pFunc, int *pnErr)
+{
+	IncEntry **pp, *p;
+	TypeWalk oWalk;
+	TypeBounds oBounds = {0, 1, 0};
+	TypeCheck oCheck;
+
+	if (!g_pszIncFile)
+		return false;
+	make_key(pFunc, g_pnIncKey);
+	if (!g_ppIncSlots || !*(pp = find_slot(g_pnIncKey)))
+		return false;
+	p = *pp;
+	ForEachAstNode(pFunc, count_types, &oBounds);
+	if (oBounds.nTypes != p->nTypes)
+		return false;
+	oCheck.pBounds = &oBounds;
+	oCheck.ppDeclTypes = NULL;
+	oCheck.nDecls = oCheck.nDeclsCap = 0;
+	oCheck.bBound = p->nErr == 0;
+	oCheck.pn = p->pnTypes;
+	oCheck.bOk = true;
+	ForEachAstNode(pFunc, check_types, &oCheck);
+	free(oCheck.ppDeclTypes);
+	if (!oCheck.bOk)
+		return false;
+	g_nIncDiagMark = Diag_Mark();
+	if (!Diag_Append(p->pDiag, p->nDiag))
+		return false;
+	if (!OutBuf_Replay(p->pOut, p->nOut, p->pErr, p->nErrBytes)){
+		Diag_Truncate(g_nIncDiagMark);
+		return false;
+	}
+	oWalk.ppDecls = NULL;
+	oWalk.nDecls = oWalk.nDeclsCap = 0;
+	oWalk.pn = p->pnTypes;
+	ForEachAstNode(pFunc, restore_types, &oWalk);
+	free(oWalk.ppDecls);
+	p->bUsed = true;
+	*pnErr = p->nErr;
+	return true;
+}
+
+// Start capturing the output of a function body visit.
+void IncCache_Begin(AstNode *pFunc)
+{
+	if (g_pszIncFile){
+		g_nIncDiagMark = Diag_Mark();
+		OutBuf_BeginCapture();
+	}
+}
+
+// Store the results of the function body visit under the key computed by IncCache_Replay().
+void IncCache_End(AstNode *pFunc, int nErr)
+{
+	const char *pOut, *pErr, *pDiag;
+	size_t nOut, nErrBytes, nDiag;
+	IncEntry *p;
+	TypeWalk oWalk;
+
+	if (!g_pszIncFile)
+		return;
+	OutBuf_EndCapture(&pOut, &nOut, &pErr, &nErrBytes);
+	pDiag = Diag_Since(g_nIncDiagMark, &nDiag);	// they stay recorded for this run too.
+	g_nIncTypes = 0;
+	oWalk.ppDecls = NULL;
+	oWalk.nDecls = oWalk.nDeclsCap = 0;
+	ForEachAstNode(pFunc, gather_types, &oWalk);
+	p = new_entry(nOut, nErrBytes, nDiag, g_nIncTypes);
+	p->pnKey[0] = g_pnIncKey[0];
+	p->pnKey[1] = g_pnIncKey[1];
+	p->nErr = nErr;
+	p->bUsed = true;
+	// Empty parts may have no buffer at all, and memcpy() takes no NULL even for 0 bytes.
+	if (g_nIncTypes)
+		memcpy(p->pnTypes, g_pnIncTypes, g_nIncTypes * sizeof(int));
+	if (nOut)
+		memcpy(p->pOut, pOut, nOut);
+	if (nErrBytes)
+		memcpy(p->pErr, pErr, nErrBytes);
+	if (nDiag)
+		memcpy(p->pDiag, pDiag, nDiag);
+	OutBuf_DropCapture();
+	add_entry(p);
+	OutBuf_Replay(p->pOut, p->nOut, p->pErr, p->nErrBytes);
+}
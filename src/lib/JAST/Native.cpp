@@ -0,0 +1,815 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <vector>
+
+#include "JAST/jast_api.h"
+#include "JAST/jast_internal.h"
+
+// Native code: the bytecode the codegen callbacks of the nodes generated is lowered, one instruction
+// at a time, to x86-64 assembly for GNU as, which the system C compiler assembles and links with the
+// C library into a standalone executable.
+//
+// Every function keeps the registers of its bytecode frame in its machine stack frame, register r at
+// -8 * (r + 1)(%rbp), except the few used most in its loops, which live in machine registers, and
+// works on them with %rax, %rcx, %rdx, %xmm0 and %xmm1. Those pinned to caller-saved registers are
+// stored to their frame slots around the instructions that call out. A call passes the address
+// of its first argument register in %rdi, the callee copies the arguments into its frame and returns
+// the result in %rax. The local arrays of all frames live on one array stack apart from the machine
+// stack, like in pvm. An int compare followed by a conditional jump on its result becomes one
+// compare and branch. Runtime errors stop the program like pvm's, with the source line.
+
+#define NATIVE_STACK_CELLS	(1 << 22)		// cells of the local arrays of all frames, as in pvm.
+#define NATIVE_PINNED		9				// bytecode registers of a function kept in machine registers,
+#define NATIVE_SAVED		5				// the first of them in callee-saved ones.
+
+// Routines the generated code calls, written against the C library of the system.
+static const char *k_pszRuntime = R"asm(
+# Stop at a runtime error: line %edi, printf format %rsi with the ints %edx and %ecx.
+.Lerror:
+	pushq	%rbx
+	pushq	%r12
+	pushq	%r13
+	pushq	%r14
+	subq	$8, %rsp
+	movl	%edi, %ebx
+	movq	%rsi, %r12
+	movl	%edx, %r13d
+	movl	%ecx, %r14d
+	call	.Lflush
+	movq	stderr@GOTPCREL(%rip), %rax
+	movq	(%rax), %rdi
+	leaq	.Lfmt_where(%rip), %rsi
+	movq	.Lprogname(%rip), %rdx
+	movl	%ebx, %ecx
+	xorl	%eax, %eax
+	call	fprintf@PLT
+	movq	stderr@GOTPCREL(%rip), %rax
+	movq	(%rax), %rdi
+	movq	%r12, %rsi
+	movl	%r13d, %edx
+	movl	%r14d, %ecx
+	xorl	%eax, %eax
+	call	fprintf@PLT
+	movq	stderr@GOTPCREL(%rip), %rax
+	movq	(%rax), %rsi
+	movl	$10, %edi
+	call	fputc@PLT
+	movl	$1, %edi
+	call	exit@PLT
+
+.Lflush:
+	subq	$8, %rsp
+	movq	stdout@GOTPCREL(%rip), %rax
+	movq	(%rax), %rdi
+	call	fflush@PLT
+	addq	$8, %rsp
+	ret
+
+# %rax = %rdi followed by %rsi, a new string that lives until the program ends.
+.Lconcat:
+	pushq	%rbx
+	pushq	%r12
+	pushq	%r13
+	pushq	%r14
+	pushq	%r15
+	leaq	.Lempty(%rip), %rax
+	testq	%rdi, %rdi
+	cmoveq	%rax, %rdi
+	testq	%rsi, %rsi
+	cmoveq	%rax, %rsi
+	movq	%rdi, %rbx
+	movq	%rsi, %r12
+	call	strlen@PLT
+	movq	%rax, %r13
+	movq	%r12, %rdi
+	call	strlen@PLT
+	movq	%rax, %r14
+	leaq	1(%r13,%r14), %rdi
+	call	malloc@PLT
+	movq	%rax, %r15
+	movq	%rax, %rdi
+	movq	%rbx, %rsi
+	movq	%r13, %rdx
+	call	memcpy@PLT
+	leaq	(%r15,%r13), %rdi
+	movq	%r12, %rsi
+	leaq	1(%r14), %rdx
+	call	memcpy@PLT
+	movq	%r15, %rax
+	popq	%r15
+	popq	%r14
+	popq	%r13
+	popq	%r12
+	popq	%rbx
+	ret
+
+# Read from stdin for the statement at line %edi.
+.Lread_int:
+	pushq	%rbx
+	subq	$16, %rsp
+	movl	%edi, %ebx
+	call	.Lflush
+	leaq	.Lfmt_scan_int(%rip), %rdi
+	movq	%rsp, %rsi
+	xorl	%eax, %eax
+	call	scanf@PLT
+	cmpl	$1, %eax
+	jne	1f
+	movl	(%rsp), %eax
+	addq	$16, %rsp
+	popq	%rbx
+	ret
+1:	movl	%ebx, %edi
+	leaq	.Lmsg_read_int(%rip), %rsi
+	call	.Lerror
+
+.Lread_real:
+	pushq	%rbx
+	subq	$16, %rsp
+	movl	%edi, %ebx
+	call	.Lflush
+	leaq	.Lfmt_scan_real(%rip), %rdi
+	movq	%rsp, %rsi
+	xorl	%eax, %eax
+	call	scanf@PLT
+	cmpl	$1, %eax
+	jne	1f
+	movsd	(%rsp), %xmm0
+	addq	$16, %rsp
+	popq	%rbx
+	ret
+1:	movl	%ebx, %edi
+	leaq	.Lmsg_read_real(%rip), %rsi
+	call	.Lerror
+
+# A word separated by white space, or the error %rsi at the end of input.
+.Lread_word:
+	pushq	%rbx
+	pushq	%r12
+	subq	$24, %rsp
+	movl	%edi, %ebx
+	movq	%rsi, %r12
+	call	.Lflush
+	leaq	.Lfmt_scan_word(%rip), %rdi
+	movq	%rsp, %rsi
+	xorl	%eax, %eax
+	call	scanf@PLT
+	cmpl	$1, %eax
+	jne	1f
+	movq	(%rsp), %rax
+	addq	$24, %rsp
+	popq	%r12
+	popq	%rbx
+	ret
+1:	movl	%ebx, %edi
+	movq	%r12, %rsi
+	call	.Lerror
+
+.Lread_bool:
+	pushq	%rbx
+	pushq	%r12
+	subq	$8, %rsp
+	movl	%edi, %ebx
+	leaq	.Lmsg_read_bool(%rip), %rsi
+	call	.Lread_word
+	movq	%rax, %r12
+	movq	%rax, %rdi
+	leaq	.Ltrue(%rip), %rsi
+	call	strcmp@PLT
+	testl	%eax, %eax
+	je	1f
+	movq	%r12, %rdi
+	leaq	.Lfalse(%rip), %rsi
+	call	strcmp@PLT
+	testl	%eax, %eax
+	jne	2f
+	movq	%r12, %rdi
+	call	free@PLT
+	xorl	%eax, %eax
+	jmp	3f
+1:	movq	%r12, %rdi
+	call	free@PLT
+	movl	$1, %eax
+3:	addq	$8, %rsp
+	popq	%r12
+	popq	%rbx
+	ret
+2:	movl	%ebx, %edi
+	leaq	.Lmsg_read_bool(%rip), %rsi
+	call	.Lerror
+
+	.section .rodata
+.Lfmt_where:		.string "%s: line %d: "
+.Lfmt_int:			.string "%d\n"
+.Lfmt_real:			.string "%f\n"
+.Lfmt_scan_int:		.string "%d"
+.Lfmt_scan_real:	.string "%lf"
+.Lfmt_scan_word:	.string "%ms"
+.Ltrue:				.string "true"
+.Lfalse:			.string "false"
+.Lempty:			.string ""
+.Lmsg_div:			.string "division by zero"
+.Lmsg_index:		.string "array index %d out of range [0, %d)"
+.Lmsg_overflow:		.string "stack overflow"
+.Lmsg_memory:		.string "out of memory"
+.Lmsg_read_int:		.string "cannot read an integer"
+.Lmsg_read_real:	.string "cannot read a real"
+.Lmsg_read_bool:	.string "cannot read a boolean"
+.Lmsg_read_str:		.string "cannot read a string"
+)asm";
+
+// Condition codes of the int compares, kBcLtInt .. kBcNeInt, and of their negation.
+static const char *k_ppszIntCc[6] = { "l", "le", "e", "ge", "g", "ne" };
+static const char *k_ppszIntNotCc[6] = { "ge", "g", "ne", "l", "le", "e" };
+
+// Machine registers the most used bytecode registers of a function are pinned to, the callee-saved first.
+static const char *k_ppszPin64[NATIVE_PINNED] = { "%rbx", "%r12", "%r13", "%r14", "%r15", "%r8", "%r9", "%r10", "%r11" };
+static const char *k_ppszPin32[NATIVE_PINNED] = { "%ebx", "%r12d", "%r13d", "%r14d", "%r15d", "%r8d", "%r9d", "%r10d", "%r11d" };
+
+// The function being emitted.
+std::vector<int> g_oNativePin;		// bytecode register to its pinned machine register, -1 in the frame.
+int g_pNativePinned[NATIVE_PINNED];	// machine register to the bytecode register pinned to it.
+int g_nNativePinned = 0;
+
+// ----------------------------------------------------------------
+// Frames and operands
+// ----------------------------------------------------------------
+
+// Offset of a frame slot from %rbp: the bytecode registers, the base of the function's arrays
+// on the array stack, then the saved callee-saved registers.
+static int reg(int r)
+{
+	return -8 * (r + 1);
+}
+
+static int array_base(const BcFunction *pFunc)
+{
+	return reg(pFunc->nRegs);
+}
+
+static int pin_save(const BcFunction *pFunc, int k)
+{
+	return reg(pFunc->nRegs + 1 + k);
+}
+
+// Bytes of a machine stack frame below the saved %rbp, kept 16-byte aligned for calls.
+static int frame_bytes(const BcFunction *pFunc, int nPinned)
+{
+	int nSaved = (nPinned < NATIVE_SAVED) ? nPinned : NATIVE_SAVED;
+
+	return (8 * (pFunc->nRegs + 1 + nSaved) + 15) & ~15;
+}
+
+// Number of register operands a, b, c of an instruction that reads or writes them, see bytecode.h.
+// A call's arguments are a block of registers and counted apart.
+static int register_operands(int nOp)
+{
+	switch(nOp){
+	case kBcNop: case kBcHalt: case kBcJump: case kBcReturnVoid: case kBcCall:
+		return 0;
+	case kBcLoadInt: case kBcLoadReal: case kBcLoadStr: case kBcGetGlobal: case kBcSetGlobal:
+	case kBcLocalArray: case kBcGlobalArray: case kBcClearArray: case kBcCheckIndex:
+	case kBcJumpTrue: case kBcJumpFalse: case kBcReturn:
+	case kBcPrintInt: case kBcPrintReal: case kBcPrintBool: case kBcPrintStr:
+	case kBcReadInt: case kBcReadReal: case kBcReadBool: case kBcReadStr:
+		return 1;
+	case kBcMove: case kBcNegInt: case kBcNegReal: case kBcIntToReal: case kBcNot: case kBcAddIntK:
+		return 2;
+	default:
+		return 3;
+	}
+}
+
+// Pin the bytecode registers of function j used most, an instruction in a loop counting 8 times
+// per level of nesting, into g_oNativePin. Registers passed to a call stay in the frame, the callee
+// reads them from there. Return the number of pinned registers.
+static int choose_pinned(const BcImage *pImage, int j)
+{
+	const BcFunction *pFunc = &pImage->pFuncs[j];
+	int nEnd = (j + 1 < pImage->oHeader.nFuncs) ? pImage->pFuncs[j + 1].nEntry : pImage->oHeader.nInsts;
+	int nInsts = nEnd - pFunc->nEntry, i, k, n, nDepth, nTarget, nBest, nPinned;
+	std::vector<int> oDepth(nInsts + 1, 0);
+	std::vector<int64_t> oUses(pFunc->nRegs, 0);
+	const BcInst *p;
+	int64_t nWeight;
+
+	g_oNativePin.assign(pFunc->nRegs, -1);
+	for(i = 0; i < nInsts; i++){
+		p = &pImage->pCode[pFunc->nEntry + i];
+		nTarget = i + 1 + p->imm;
+		if ((p->nOp == kBcJump || p->nOp == kBcJumpTrue || p->nOp == kBcJumpFalse) && nTarget <= i){
+			oDepth[nTarget]++;
+			oDepth[i + 1]--;
+		}
+	}
+	for(i = 0, nDepth = 0; i < nInsts; i++){
+		p = &pImage->pCode[pFunc->nEntry + i];
+		nDepth += oDepth[i];
+		nWeight = (int64_t)1 << (3 * (nDepth < 6 ? nDepth : 6));
+		n = register_operands(p->nOp);
+		if (n > 0)	oUses[p->a] += nWeight;
+		if (n > 1)	oUses[p->b] += nWeight;
+		if (n > 2)	oUses[p->c] += nWeight;
+	}
+	for(i = 0; i < nInsts; i++){
+		p = &pImage->pCode[pFunc->nEntry + i];
+		if (p->nOp == kBcCall){
+			for(k = p->a; k < p->a + (p->c ? p->c : 1); k++)
+				oUses[k] = -1;
+		}
+	}
+	for(nPinned = 0; nPinned < NATIVE_PINNED; nPinned++){
+		nBest = -1;
+		for(k = 0; k < pFunc->nRegs; k++){
+			if (oUses[k] > 0 && g_oNativePin[k] < 0 && (nBest < 0 || oUses[k] > oUses[nBest]))
+				nBest = k;
+		}
+		if (nBest < 0)
+			break;
+		g_oNativePin[nBest] = nPinned;
+		g_pNativePinned[nPinned] = nBest;
+	}
+	g_nNativePinned = nPinned;
+	return nPinned;
+}
+
+// Operand of a bytecode register as 8 or 4 bytes, its pinned machine register or its frame slot.
+static const char *operand(int r, bool b64)
+{
+	static char s_ppszOperands[8][16];
+	static int s_nNext = 0;
+	char *psz;
+
+	if (g_oNativePin[r] >= 0)
+		return (b64 ? k_ppszPin64 : k_ppszPin32)[g_oNativePin[r]];
+	psz = s_ppszOperands[s_nNext++ & 7];
+	snprintf(psz, sizeof(s_ppszOperands[0]), "%d(%%rbp)", reg(r));
+	return psz;
+}
+
+static const char *op64(int r)
+{
+	return operand(r, true);
+}
+
+static const char *op32(int r)
+{
+	return operand(r, false);
+}
+
+static void emit_move(FILE *fp, int nDest, int nSrc)
+{
+	if (g_oNativePin[nDest] >= 0 || g_oNativePin[nSrc] >= 0)
+		fprintf(fp, "\tmovq\t%s, %s\n", op64(nSrc), op64(nDest));
+	else
+		fprintf(fp, "\tmovq\t%s, %%rax\n\tmovq\t%%rax, %s\n", op64(nSrc), op64(nDest));
+}
+
+// Store the bytecode registers pinned to caller-saved machine registers to their frame slots
+// before a call, or load them back after it, except nKeep, which the call set.
+static void emit_spill(FILE *fp, bool bReload, int nKeep)
+{
+	for(int k = NATIVE_SAVED; k < g_nNativePinned; k++){
+		if (g_pNativePinned[k] == nKeep)
+			continue;
+		if (bReload)
+			fprintf(fp, "\tmovq\t%d(%%rbp), %s\n", reg(g_pNativePinned[k]), k_ppszPin64[k]);
+		else
+			fprintf(fp, "\tmovq\t%s, %d(%%rbp)\n", k_ppszPin64[k], reg(g_pNativePinned[k]));
+	}
+}
+
+// Whether an instruction calls out of the function, see the runtime.
+static bool calls_out(int nOp)
+{
+	switch(nOp){
+	case kBcCall: case kBcConcat:
+	case kBcPrintInt: case kBcPrintReal: case kBcPrintBool: case kBcPrintStr:
+	case kBcReadInt: case kBcReadReal: case kBcReadBool: case kBcReadStr:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Reals in pinned registers go through %xmm1 to the SSE instructions, which take no general register.
+static void emit_load_real(FILE *fp, int r)
+{
+	fprintf(fp, "\t%s\t%s, %%xmm0\n", (g_oNativePin[r] >= 0) ? "movq" : "movsd", op64(r));
+}
+
+static const char *real_source(FILE *fp, int r)
+{
+	if (g_oNativePin[r] < 0)
+		return op64(r);
+	fprintf(fp, "\tmovq\t%s, %%xmm1\n", op64(r));
+	return "%xmm1";
+}
+
+static void emit_store_real(FILE *fp, int r)
+{
+	fprintf(fp, "\t%s\t%%xmm0, %s\n", (g_oNativePin[r] >= 0) ? "movq" : "movsd", op64(r));
+}
+
+// ----------------------------------------------------------------
+// Instructions
+// ----------------------------------------------------------------
+
+// Emit a real compare, return the condition code that is true for it, or NULL for eq and ne,
+// which need the parity flag too and are not fused with a jump.
+static const char *emit_real_compare(FILE *fp, const BcInst *p)
+{
+	// ucomisd sets the flags of an unsigned compare of %xmm0 with its operand, unordered is below or equal.
+	switch(p->nOp){
+	case kBcLtReal:
+	case kBcLeReal:
+		emit_load_real(fp, p->c);
+		fprintf(fp, "\tucomisd\t%s, %%xmm0\n", real_source(fp, p->b));
+		return (p->nOp == kBcLtReal) ? "a" : "ae";
+	case kBcGeReal:
+	case kBcGtReal:
+		emit_load_real(fp, p->b);
+		fprintf(fp, "\tucomisd\t%s, %%xmm0\n", real_source(fp, p->c));
+		return (p->nOp == kBcGtReal) ? "a" : "ae";
+	default:
+		emit_load_real(fp, p->b);
+		fprintf(fp, "\tucomisd\t%s, %%xmm0\n", real_source(fp, p->c));
+		if (p->nOp == kBcEqReal)
+			fprintf(fp, "\tsete\t%%al\n\tsetnp\t%%cl\n\tandb\t%%cl, %%al\n");
+		else
+			fprintf(fp, "\tsetne\t%%al\n\tsetp\t%%cl\n\torb\t%%cl, %%al\n");
+		fprintf(fp, "\tmovzbl\t%%al, %%eax\n\tmovl\t%%eax, %s\n", op32(p->a));
+		return NULL;
+	}
+}
+
+static const char *negate_real_cc(const char *pszCc)
+{
+	return strcmp(pszCc, "a") == 0 ? "be" : "b";
+}
+
+static void emit_int_op(FILE *fp, const BcInst *p, const char *pszOp)
+{
+	fprintf(fp, "\tmovl\t%s, %%eax\n\t%s\t%s, %%eax\n\tmovl\t%%eax, %s\n", op32(p->b), pszOp, op32(p->c), op32(p->a));
+}
+
+static void emit_real_op(FILE *fp, const BcInst *p, const char *pszOp)
+{
+	emit_load_real(fp, p->b);
+	fprintf(fp, "\t%s\t%s, %%xmm0\n", pszOp, real_source(fp, p->c));
+	emit_store_real(fp, p->a);
+}
+
+// Division by -1 is negation, and the remainder 0, like pvm, so INT_MIN / -1 does not trap.
+static void emit_divide(FILE *fp, const BcInst *p, int i)
+{
+	fprintf(fp, "\tmovl\t%s, %%ecx\n\ttestl\t%%ecx, %%ecx\n\tje\t.Le%d\n", op32(p->c), i);
+	fprintf(fp, "\tmovl\t%s, %%eax\n\tcmpl\t$-1, %%ecx\n\tje\t.Ln%d\n\tcltd\n\tidivl\t%%ecx\n", op32(p->b), i);
+	fprintf(fp, "\tmovl\t%s, %s\n\tjmp\t.Ld%d\n.Ln%d:\n", (p->nOp == kBcDivInt) ? "%eax" : "%edx", op32(p->a), i, i);
+	if (p->nOp == kBcDivInt)
+		fprintf(fp, "\tnegl\t%%eax\n\tmovl\t%%eax, %s\n.Ld%d:\n", op32(p->a), i);
+	else
+		fprintf(fp, "\tmovl\t$0, %s\n.Ld%d:\n", op32(p->a), i);
+}
+
+// Check that a call to pCallee, with a frame of nFrame bytes, fits the machine stack and the array stack.
+static void emit_call_check(FILE *fp, const BcFunction *pCallee, int nFrame, int i)
+{
+	fprintf(fp, "\tleaq\t-%d(%%rsp), %%rax\n\tcmpq\t.Lstack_limit(%%rip), %%rax\n\tjb\t.Le%d\n", nFrame + 16, i);
+	if (pCallee->nArrayCells)
+		fprintf(fp, "\tmovq\t.Larray_end(%%rip), %%rax\n\tsubq\t.Larray_sp(%%rip), %%rax\n\tshrq\t$3, %%rax\n"
+			"\tcmpq\t$%d, %%rax\n\tjb\t.Le%d\n", pCallee->nArrayCells, i);
+}
+
+// Emit the function j of the program, oTargets marks the instructions jumps go to and
+// oFrames has the frame bytes of every function.
+static void emit_function(FILE *fp, const BcImage *pImage, int j, const std::vector<bool> &oTargets, const std::vector<int> &oFrames)
+{
+	const BcFunction *pFunc = &pImage->pFuncs[j];
+	int nEnd = (j + 1 < pImage->oHeader.nFuncs) ? pImage->pFuncs[j + 1].nEntry : pImage->oHeader.nInsts;
+	int nPinned = choose_pinned(pImage, j);
+	const BcInst *p, *pNext;
+	const char *pszCc;
+	int i, k, nCmp = 0;
+
+	fprintf(fp, "\n# function %d %s\n.Lf%d:\n", j, pImage->pStrings + pFunc->nName, j);
+	fprintf(fp, "\tpushq\t%%rbp\n\tmovq\t%%rsp, %%rbp\n\tsubq\t$%d, %%rsp\n", oFrames[j]);
+	for(k = 0; k < nPinned && k < NATIVE_SAVED; k++)
+		fprintf(fp, "\tmovq\t%s, %d(%%rbp)\n", k_ppszPin64[k], pin_save(pFunc, k));
+	for(k = 0; k < pFunc->nParams; k++){
+		if (g_oNativePin[k] >= 0)
+			fprintf(fp, "\tmovq\t%d(%%rdi), %s\n", -8 * k, op64(k));
+		else
+			fprintf(fp, "\tmovq\t%d(%%rdi), %%rax\n\tmovq\t%%rax, %s\n", -8 * k, op64(k));
+	}
+	if (pFunc->nArrayCells)
+		fprintf(fp, "\tmovq\t.Larray_sp(%%rip), %%rax\n\tmovq\t%%rax, %d(%%rbp)\n\tmovq\t$%d, %%rcx\n"
+			"\tleaq\t(%%rax,%%rcx,8), %%rcx\n\tmovq\t%%rcx, .Larray_sp(%%rip)\n", array_base(pFunc), pFunc->nArrayCells);
+
+	for(i = pFunc->nEntry; i < nEnd; i++){
+		p = &pImage->pCode[i];
+		if (oTargets[i])
+			fprintf(fp, ".Li%d:\n", i);
+		if (calls_out(p->nOp))
+			emit_spill(fp, false, -1);
+		switch(p->nOp){
+		case kBcNop:
+			break;
+		case kBcHalt:
+		case kBcReturnVoid:
+			fprintf(fp, "\txorl\t%%eax, %%eax\n\tjmp\t.Lr%d\n", j);
+			break;
+		case kBcReturn:
+			fprintf(fp, "\tmovq\t%s, %%rax\n\tjmp\t.Lr%d\n", op64(p->a), j);
+			break;
+		case kBcMove:
+			emit_move(fp, p->a, p->b);
+			break;
+		case kBcLoadInt:
+			fprintf(fp, "\tmovq\t$%d, %s\n", p->imm, op64(p->a));
+			break;
+		case kBcLoadReal:
+			fprintf(fp, "\tmovq\t.Lreals+%d(%%rip), %%rax\n\tmovq\t%%rax, %s\n", 8 * p->imm, op64(p->a));
+			break;
+		case kBcLoadStr:
+			fprintf(fp, "\tleaq\t.Lstrings+%d(%%rip), %%rax\n\tmovq\t%%rax, %s\n", p->imm, op64(p->a));
+			break;
+		case kBcGetGlobal:
+			fprintf(fp, "\tmovq\t.Lglobals+%d(%%rip), %%rax\n\tmovq\t%%rax, %s\n", 8 * p->imm, op64(p->a));
+			break;
+		case kBcSetGlobal:
+			fprintf(fp, "\tmovq\t%s, %%rax\n\tmovq\t%%rax, .Lglobals+%d(%%rip)\n", op64(p->a), 8 * p->imm);
+			break;
+		case kBcLocalArray:
+			if (p->imm < (1 << 28))
+				fprintf(fp, "\tmovq\t%d(%%rbp), %%rax\n\tleaq\t%d(%%rax), %%rax\n\tmovq\t%%rax, %s\n", array_base(pFunc), 8 * p->imm, op64(p->a));
+			else
+				fprintf(fp, "\tmovq\t%d(%%rbp), %%rax\n\tmovq\t$%d, %%rcx\n\tleaq\t(%%rax,%%rcx,8), %%rax\n\tmovq\t%%rax, %s\n",
+					array_base(pFunc), p->imm, op64(p->a));
+			break;
+		case kBcGlobalArray:
+			fprintf(fp, "\tleaq\t.Lglobal_cells+%lld(%%rip), %%rax\n\tmovq\t%%rax, %s\n", 8LL * p->imm, op64(p->a));
+			break;
+		case kBcClearArray:
+			fprintf(fp, "\tmovq\t%s, %%rdi\n\tmovq\t$%d, %%rcx\n\txorl\t%%eax, %%eax\n\trep stosq\n", op64(p->a), p->imm);
+			break;
+		case kBcCheckIndex:
+			fprintf(fp, "\tcmpl\t$%d, %s\n\tjae\t.Le%d\n", p->imm, op32(p->a), i);
+			break;
+		case kBcLoadElem:
+			fprintf(fp, "\tmovq\t%s, %%rax\n\tmovslq\t%s, %%rcx\n\tmovq\t(%%rax,%%rcx,8), %%rax\n\tmovq\t%%rax, %s\n",
+				op64(p->b), op32(p->c), op64(p->a));
+			break;
+		case kBcStoreElem:
+			fprintf(fp, "\tmovq\t%s, %%rax\n\tmovslq\t%s, %%rcx\n\tmovq\t%s, %%rdx\n\tmovq\t%%rdx, (%%rax,%%rcx,8)\n",
+				op64(p->a), op32(p->b), op64(p->c));
+			break;
+		case kBcAddInt:		emit_int_op(fp, p, "addl");		break;
+		case kBcSubInt:		emit_int_op(fp, p, "subl");		break;
+		case kBcMulInt:		emit_int_op(fp, p, "imull");	break;
+		case kBcAnd:		emit_int_op(fp, p, "andl");		break;
+		case kBcOr:			emit_int_op(fp, p, "orl");		break;
+		case kBcDivInt:
+		case kBcModInt:
+			emit_divide(fp, p, i);
+			break;
+		case kBcNegInt:
+			fprintf(fp, "\tmovl\t%s, %%eax\n\tnegl\t%%eax\n\tmovl\t%%eax, %s\n", op32(p->b), op32(p->a));
+			break;
+		case kBcAddIntK:
+			fprintf(fp, "\tmovl\t%s, %%eax\n\taddl\t$%d, %%eax\n\tmovl\t%%eax, %s\n", op32(p->b), (int16_t)p->c, op32(p->a));
+			break;
+		case kBcAddReal:	emit_real_op(fp, p, "addsd");	break;
+		case kBcSubReal:	emit_real_op(fp, p, "subsd");	break;
+		case kBcMulReal:	emit_real_op(fp, p, "mulsd");	break;
+		case kBcDivReal:	emit_real_op(fp, p, "divsd");	break;
+		case kBcNegReal:
+			fprintf(fp, "\tmovq\t%s, %%rax\n\tbtcq\t$63, %%rax\n\tmovq\t%%rax, %s\n", op64(p->b), op64(p->a));
+			break;
+		case kBcIntToReal:
+			fprintf(fp, "\tpxor\t%%xmm0, %%xmm0\n\tcvtsi2sdl\t%s, %%xmm0\n", op32(p->b));
+			emit_store_real(fp, p->a);
+			break;
+		case kBcLtInt: case kBcLeInt: case kBcEqInt: case kBcGeInt: case kBcGtInt: case kBcNeInt:
+		case kBcLtReal: case kBcLeReal: case kBcEqReal: case kBcGeReal: case kBcGtReal: case kBcNeReal:
+			if (p->nOp <= kBcNeInt){
+				nCmp = p->nOp - kBcLtInt;
+				pszCc = k_ppszIntCc[nCmp];
+				fprintf(fp, "\tmovl\t%s, %%eax\n\tcmpl\t%s, %%eax\n", op32(p->b), op32(p->c));
+			}
+			else if (!(pszCc = emit_real_compare(fp, p)))
+				break;
+			fprintf(fp, "\tset%s\t%%al\n\tmovzbl\t%%al, %%eax\n\tmovl\t%%eax, %s\n", pszCc, op32(p->a));
+			// The result is still stored, the flags are left for a conditional jump on it.
+			pNext = p + 1;
+			if (i + 1 < nEnd && !oTargets[i + 1] && pNext->a == p->a && (pNext->nOp == kBcJumpTrue || pNext->nOp == kBcJumpFalse)){
+				if (pNext->nOp == kBcJumpFalse)
+					pszCc = (p->nOp <= kBcNeInt) ? k_ppszIntNotCc[nCmp] : negate_real_cc(pszCc);
+				fprintf(fp, "\tj%s\t.Li%d\n", pszCc, i + 2 + pNext->imm);
+				i++;
+			}
+			break;
+		case kBcNot:
+			fprintf(fp, "\txorl\t%%eax, %%eax\n\tcmpl\t$0, %s\n\tsete\t%%al\n\tmovl\t%%eax, %s\n", op32(p->b), op32(p->a));
+			break;
+		case kBcConcat:
+			fprintf(fp, "\tmovq\t%s, %%rdi\n\tmovq\t%s, %%rsi\n\tcall\t.Lconcat\n\tmovq\t%%rax, %s\n", op64(p->b), op64(p->c), op64(p->a));
+			break;
+		case kBcJump:
+			fprintf(fp, "\tjmp\t.Li%d\n", i + 1 + p->imm);
+			break;
+		case kBcJumpTrue:
+		case kBcJumpFalse:
+			fprintf(fp, "\tcmpl\t$0, %s\n\t%s\t.Li%d\n", op32(p->a), (p->nOp == kBcJumpTrue) ? "jne" : "je", i + 1 + p->imm);
+			break;
+		case kBcCall:
+			emit_call_check(fp, &pImage->pFuncs[p->b], oFrames[p->b], i);
+			fprintf(fp, "\tleaq\t%d(%%rbp), %%rdi\n\tcall\t.Lf%d\n\tmovq\t%%rax, %d(%%rbp)\n", reg(p->a), p->b, reg(p->a));
+			break;
+		case kBcPrintInt:
+			fprintf(fp, "\tmovl\t%s, %%esi\n\tleaq\t.Lfmt_int(%%rip), %%rdi\n\txorl\t%%eax, %%eax\n\tcall\tprintf@PLT\n", op32(p->a));
+			break;
+		case kBcPrintReal:
+			emit_load_real(fp, p->a);
+			fprintf(fp, "\tleaq\t.Lfmt_real(%%rip), %%rdi\n\tmovl\t$1, %%eax\n\tcall\tprintf@PLT\n");
+			break;
+		case kBcPrintBool:
+			fprintf(fp, "\tleaq\t.Ltrue(%%rip), %%rdi\n\tleaq\t.Lfalse(%%rip), %%rax\n\tcmpl\t$0, %s\n\tcmoveq\t%%rax, %%rdi\n"
+				"\tcall\tputs@PLT\n", op32(p->a));
+			break;
+		case kBcPrintStr:
+			fprintf(fp, "\tmovq\t%s, %%rdi\n\tleaq\t.Lempty(%%rip), %%rax\n\ttestq\t%%rdi, %%rdi\n\tcmoveq\t%%rax, %%rdi\n"
+				"\tcall\tputs@PLT\n", op64(p->a));
+			break;
+		case kBcReadInt:
+			fprintf(fp, "\tmovl\t$%d, %%edi\n\tcall\t.Lread_int\n\tmovl\t%%eax, %s\n", pImage->pLines[i], op32(p->a));
+			break;
+		case kBcReadReal:
+			fprintf(fp, "\tmovl\t$%d, %%edi\n\tcall\t.Lread_real\n", pImage->pLines[i]);
+			emit_store_real(fp, p->a);
+			break;
+		case kBcReadBool:
+			fprintf(fp, "\tmovl\t$%d, %%edi\n\tcall\t.Lread_bool\n\tmovl\t%%eax, %s\n", pImage->pLines[i], op32(p->a));
+			break;
+		case kBcReadStr:
+			fprintf(fp, "\tmovl\t$%d, %%edi\n\tleaq\t.Lmsg_read_str(%%rip), %%rsi\n\tcall\t.Lread_word\n\tmovq\t%%rax, %s\n",
+				pImage->pLines[i], op64(p->a));
+			break;
+		}
+		if (calls_out(p->nOp))
+			emit_spill(fp, true, (p->nOp == kBcConcat || p->nOp >= kBcReadInt) ? p->a : -1);		// concat and reads set a.
+	}
+
+	fprintf(fp, ".Lr%d:\n", j);
+	if (pFunc->nArrayCells)
+		fprintf(fp, "\tmovq\t%d(%%rbp), %%rcx\n\tmovq\t%%rcx, .Larray_sp(%%rip)\n", array_base(pFunc));
+	for(k = 0; k < nPinned && k < NATIVE_SAVED; k++)
+		fprintf(fp, "\tmovq\t%d(%%rbp), %s\n", pin_save(pFunc, k), k_ppszPin64[k]);
+	fprintf(fp, "\tleave\n\tret\n");
+
+	// Runtime errors, out of the way of the code that runs.
+	for(i = pFunc->nEntry; i < nEnd; i++){
+		p = &pImage->pCode[i];
+		switch(p->nOp){
+		case kBcCheckIndex:
+			fprintf(fp, ".Le%d:\n\tmovl\t$%d, %%edi\n\tleaq\t.Lmsg_index(%%rip), %%rsi\n\tmovl\t%s, %%edx\n\tmovl\t$%d, %%ecx\n\tcall\t.Lerror\n",
+				i, pImage->pLines[i], op32(p->a), p->imm);
+			break;
+		case kBcDivInt:
+		case kBcModInt:
+			fprintf(fp, ".Le%d:\n\tmovl\t$%d, %%edi\n\tleaq\t.Lmsg_div(%%rip), %%rsi\n\tcall\t.Lerror\n", i, pImage->pLines[i]);
+			break;
+		case kBcCall:
+			fprintf(fp, ".Le%d:\n\tmovl\t$%d, %%edi\n\tleaq\t.Lmsg_overflow(%%rip), %%rsi\n\tcall\t.Lerror\n", i, pImage->pLines[i]);
+			break;
+		}
+	}
+}
+
+// ----------------------------------------------------------------
+// Program
+// ----------------------------------------------------------------
+
+// Start the program: remember its name for errors, buffer stdout like pvm, leave the C library
+// 1MB of the machine stack, allocate the array stack and run the program body.
+static void emit_main(FILE *fp, const BcImage *pImage)
+{
+	const BcFunction *pBody = &pImage->pFuncs[0];
+
+	fprintf(fp, "\n\t.globl\tmain\n\t.type\tmain, @function\nmain:\n"
+		"\tpushq\t%%rbp\n\tmovq\t%%rsp, %%rbp\n\tsubq\t$16, %%rsp\n"
+		"\tmovq\t(%%rsi), %%rax\n\tmovq\t%%rax, .Lprogname(%%rip)\n"
+		"\tmovq\tstdout@GOTPCREL(%%rip), %%rax\n\tmovq\t(%%rax), %%rdi\n\txorl\t%%esi, %%esi\n\txorl\t%%edx, %%edx\n"
+		"\tmovl\t$65536, %%ecx\n\tcall\tsetvbuf@PLT\n");
+	fprintf(fp, "\tmovq\t$8388608, (%%rsp)\n\tmovl\t$3, %%edi\n\tmovq\t%%rsp, %%rsi\n\tcall\tgetrlimit@PLT\n"
+		"\tmovq\t(%%rsp), %%rax\n\tmovq\t$268435456, %%rcx\n\tcmpq\t%%rcx, %%rax\n\tcmovaq\t%%rcx, %%rax\n"
+		"\tmovq\t%%rax, %%rcx\n\tshrq\t%%rcx\n\tsubq\t$1048576, %%rax\n\tcmpq\t%%rcx, %%rax\n\tcmovlq\t%%rcx, %%rax\n"
+		"\tmovq\t%%rbp, %%rcx\n\tsubq\t%%rax, %%rcx\n\tmovq\t%%rcx, .Lstack_limit(%%rip)\n");
+	fprintf(fp, "\tmovl\t$%d, %%edi\n\tmovl\t$8, %%esi\n\tcall\tcalloc@PLT\n\ttestq\t%%rax, %%rax\n\tjne\t1f\n"
+		"\tmovl\t$%d, %%edi\n\tleaq\t.Lmsg_memory(%%rip), %%rsi\n\tcall\t.Lerror\n"
+		"1:\tmovq\t%%rax, .Larray_sp(%%rip)\n\tleaq\t%d(%%rax), %%rcx\n\tmovq\t%%rcx, .Larray_end(%%rip)\n",
+		NATIVE_STACK_CELLS, pImage->pLines[0], 8 * NATIVE_STACK_CELLS);
+	if (pBody->nArrayCells > NATIVE_STACK_CELLS)
+		fprintf(fp, "\tmovl\t$%d, %%edi\n\tleaq\t.Lmsg_overflow(%%rip), %%rsi\n\tcall\t.Lerror\n", pImage->pLines[0]);
+	fprintf(fp, "\tcall\t.Lf0\n\tcall\t.Lflush\n\txorl\t%%eax, %%eax\n\tleave\n\tret\n");
+}
+
+// Emit constants, strings byte by byte, and the zeroed globals.
+static void emit_data(FILE *fp, const BcImage *pImage)
+{
+	int i;
+
+	fprintf(fp, "\n\t.section .rodata\n\t.balign 8\n.Lreals:\n");
+	for(i = 0; i < pImage->oHeader.nReals; i++){
+		uint64_t n;
+
+		memcpy(&n, &pImage->pReals[i], sizeof(n));
+		fprintf(fp, "\t.quad\t0x%016llx\t# %g\n", (unsigned long long)n, pImage->pReals[i]);
+	}
+	fprintf(fp, ".Lstrings:");
+	for(i = 0; i < pImage->oHeader.nStringBytes; i++)
+		fprintf(fp, (i % 16) ? ", %d" : "\n\t.byte\t%d", (unsigned char)pImage->pStrings[i]);
+	fprintf(fp, "\n\n\t.bss\n\t.balign 8\n.Lprogname:\t.zero 8\n.Lstack_limit:\t.zero 8\n.Larray_sp:\t.zero 8\n.Larray_end:\t.zero 8\n");
+	fprintf(fp, ".Lglobals:\t.zero %lld\n", 8LL * pImage->oHeader.nGlobals + 8);
+	fprintf(fp, ".Lglobal_cells:\t.zero %lld\n", 8LL * pImage->oHeader.nGlobalCells + 8);
+	fprintf(fp, "\n\t.section .note.GNU-stack,\"\",@progbits\n");
+}
+
+static void emit_program(FILE *fp, const BcImage *pImage)
+{
+	std::vector<bool> oTargets(pImage->oHeader.nInsts + 1, false);
+	std::vector<int> oFrames(pImage->oHeader.nFuncs);
+	const BcInst *p;
+	int i;
+
+	for(i = 0; i < pImage->oHeader.nInsts; i++){
+		p = &pImage->pCode[i];
+		if (p->nOp == kBcJump || p->nOp == kBcJumpTrue || p->nOp == kBcJumpFalse)
+			oTargets[i + 1 + p->imm] = true;
+	}
+	// A call checks the frame of its callee, which may come later.
+	for(i = 0; i < pImage->oHeader.nFuncs; i++)
+		oFrames[i] = frame_bytes(&pImage->pFuncs[i], choose_pinned(pImage, i));
+	fprintf(fp, "# P program %s, x86-64 assembly for GNU as\n\t.text\n", pImage->pStrings + pImage->pFuncs[0].nName);
+	emit_main(fp, pImage);
+	for(i = 0; i < pImage->oHeader.nFuncs; i++)
+		emit_function(fp, pImage, i, oTargets, oFrames);
+	fputs(k_pszRuntime, fp);
+	emit_data(fp, pImage);
+	std::vector<int>().swap(g_oNativePin);
+}
+
+// Write the bytecode generated by ByteCode_Generate() as x86-64 assembly, return 0 on success, -1 on failure.
+int Native_EmitAsm(const char *pszFile)
+{
+	FILE *fp = fopen(pszFile, "w");
+	BcImage oImage;
+	bool bOk;
+
+	if (fp){
+		ByteCode_GetImage(&oImage);
+		emit_program(fp, &oImage);
+	}
+	bOk = fp && !ferror(fp);
+	if (fp && fclose(fp) != 0)
+		bOk = false;
+	if (!bOk){
+		OutBuf_ErrPrintf("Cannot write assembly file %s\n", pszFile);
+		return -1;
+	}
+	return 0;
+}
+
+// Build an executable from the bytecode generated by ByteCode_Generate(), with the C compiler
+// in $CC or cc. Return 0 on success, -1 on failure.
+int Native_Build(const char *pszExe)
+{
+	char pszAsm[] = "/tmp/pnativeXXXXXX.s";
+	const char *pszCc = getenv("CC") ? getenv("CC") : "cc";
+	char *ppArgv[] = { (char *)pszCc, (char *)"-o", (char *)pszExe, pszAsm, NULL };
+	int fd, nStatus, nRet = -1;
+	pid_t pid;
+
+	if ((fd = mkstemps(pszAsm, 2)) < 0){
+		OutBuf_ErrPrintf("native: cannot create a temporary file: %s\n", strerror(errno));
+		return -1;
+	}
+	close(fd);
+	if (Native_EmitAsm(pszAsm) == 0){
+		OutBuf_Flush();
+		if ((errno = posix_spawnp(&pid, pszCc, NULL, NULL, ppArgv, environ)) != 0)
+			OutBuf_ErrPrintf("native: cannot run %s: %s\n", pszCc, strerror(errno));
+		else if (waitpid(pid, &nStatus, 0) < 0 || !WIFEXITED(nStatus) || WEXITSTATUS(nStatus) != 0)
+			OutBuf_ErrPrintf("native: %s failed to build %s\n", pszCc, pszExe);
+		else
+			nRet = 0;
+	}
+	unlink(pszAsm);
+	return nRet;
+}
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <mutex>
+#include "JAST/jast_internal.h"
+
+#define OUTBUF_MIN_SIZE		(64 * 1024)
+#define OUTBUF_FLUSH_SIZE	(64 * 1024 * 1024)
+
+// Output buffer: everything the compiler prints to stdout is gathered here and written with one fwrite()
+// at exit, or earlier when it reaches OUTBUF_FLUSH_SIZE or before a message goes to stderr.
+// Messages to stderr go through OutBuf_ErrWrite() and OutBuf_ErrPrintf() so they can be captured too.
+// Worker threads have buffers of their own, which they only use to capture output for the main thread.
+thread_local char *g_pOutBuf = NULL;
+thread_local size_t g_nOutBufUsed = 0;
+thread_local size_t g_nOutBufSize = 0;
+std::once_flag g_oOutBufAtExit;
+
+// Capture: stdout bytes from g_nOutBufCaptureStart on stay in the buffer, and stderr bytes are
+// gathered in the error buffer instead of written, until OutBuf_EndCapture() hands both out.
+thread_local bool g_bOutBufCapture = false;
+thread_local size_t g_nOutBufCaptureStart = 0;
+thread_local char *g_pErrBuf = NULL;
+thread_local size_t g_nErrBufUsed = 0;
+thread_local size_t g_nErrBufSize = 0;
+thread_local size_t g_nErrRecord = 0;		// offset of the last record in the error buffer.
+thread_local char *g_pErrFormat = NULL;		// formatting space of OutBuf_ErrPrintf().
+thread_local size_t g_nErrFormatSize = 0;
+
+struct ErrRecord {
+	uint32_t nOutPos;		// captured stdout bytes before the stderr bytes.
+	uint32_t nLeng;
+};
+
+// Make room for nMore bytes plus a '\0' at the end of the buffer.
+static void reserve(size_t nMore)
+{
+	size_t nSize = g_nOutBufSize ? g_nOutBufSize : OUTBUF_MIN_SIZE;
+
+	if (g_nOutBufUsed + nMore + 1 <= g_nOutBufSize)
+		return;
+	std::call_once(g_oOutBufAtExit, [](){ atexit(OutBuf_Flush); });	// also flush on exit(-1) after an error.
+	while(nSize < g_nOutBufUsed + nMore + 1)
+		nSize *= 2;
+	g_pOutBuf = (char *)realloc(g_pOutBuf, nSize);
+	if (!g_pOutBuf){
+		g_nOutBufUsed = 0;
+		fprintf(stderr, "Out of memory for %zu bytes of output\n", nSize);
+		exit(-1);
+	}
+	g_nOutBufSize = nSize;
+}
+
+// Get a pointer to nMore writable bytes at the end of the buffer, commit them with OutBuf_Commit().
+char *OutBuf_Reserve(size_t nMore)
+{
+	reserve(nMore);
+	return g_pOutBuf + g_nOutBufUsed;
+}
+
+// Commit n bytes written to the pointer from OutBuf_Reserve().
+void OutBuf_Commit(size_t n)
+{
+	g_nOutBufUsed += n;
+	if (g_nOutBufUsed >= OUTBUF_FLUSH_SIZE && !g_bOutBufCapture)
+		OutBuf_Flush();
+}
+
+// Append n bytes to the buffer.
+void OutBuf_Write(const char *p, size_t n)
+{
+	memcpy(OutBuf_Reserve(n), p, n);
+	OutBuf_Commit(n);
+}
+
+// Append a '\0' terminated string to the buffer.
+void OutBuf_Puts(const char *psz)
+{
+	OutBuf_Write(psz, strlen(psz));
+}
+
+// Append printf() formatted output to the buffer.
+void OutBuf_Printf(const char *format, ...)
+{
+	va_list args;
+	int n;
+
+	reserve(256);
+	va_start(args, format);
+	n = vsnprintf(g_pOutBuf + g_nOutBufUsed, g_nOutBufSize - g_nOutBufUsed, format, args);
+	va_end(args);
+	if (n < 0)
+		return;
+	if ((size_t)n >= g_nOutBufSize - g_nOutBufUsed){
+		reserve(n);
+		va_start(args, format);
+		vsnprintf(g_pOutBuf + g_nOutBufUsed, g_nOutBufSize - g_nOutBufUsed, format, args);
+		va_end(args);
+	}
+	OutBuf_Commit(n);
+}
+
+// Write out the buffered output, except what is being captured.
+void OutBuf_Flush()
+{
+	size_t n = g_bOutBufCapture ? g_nOutBufCaptureStart : g_nOutBufUsed;
+
+	if (n){
+		fwrite(g_pOutBuf, 1, n, stdout);
+		memmove(g_pOutBuf, g_pOutBuf + n, g_nOutBufUsed - n);
+		g_nOutBufUsed -= n;
+		g_nOutBufCaptureStart = 0;
+	}
+	fflush(stdout);
+}
+
+// Grow *ppBuf to at least nNeed bytes, doubling its size.
+static void grow_buffer(char **ppBuf, size_t *pnSize, size_t nNeed)
+{
+	size_t nSize = *pnSize ? *pnSize : 1024;
+
+	if (nNeed <= *pnSize)
+		return;
+	while(nSize < nNeed)
+		nSize *= 2;
+	*ppBuf = (char *)realloc(*ppBuf, nSize);
+	if (!*ppBuf){
+		fprintf(stderr, "Out of memory for %zu bytes of output\n", nSize);
+		exit(-1);
+	}
+	*pnSize = nSize;
+}
+
+// Write n bytes to stderr after the buffered stdout output, or add them to the capture.
+// A capture keeps stderr bytes in records of the stdout position they came at, their length
+// and the bytes themselves, so OutBuf_Replay() can interleave both streams as they were.
+void OutBuf_ErrWrite(const char *p, size_t n)
+{
+	ErrRecord oRecord;
+
+	if (!g_bOutBufCapture){
+		OutBuf_Flush();		// keep stdout and stderr in order on a terminal.
+		fwrite(p, 1, n, stderr);
+		return;
+	}
+	oRecord.nOutPos = g_nOutBufUsed - g_nOutBufCaptureStart;
+	oRecord.nLeng = n;
+	if (g_nErrBufUsed >= g_nErrRecord + sizeof(ErrRecord)){
+		ErrRecord oLast;
+		memcpy(&oLast, g_pErrBuf + g_nErrRecord, sizeof(ErrRecord));
+		if (oLast.nOutPos == oRecord.nOutPos){
+			// No stdout in between, extend the last record.
+			oLast.nLeng += n;
+			memcpy(g_pErrBuf + g_nErrRecord, &oLast, sizeof(ErrRecord));
+			grow_buffer(&g_pErrBuf, &g_nErrBufSize, g_nErrBufUsed + n);
+			memcpy(g_pErrBuf + g_nErrBufUsed, p, n);
+			g_nErrBufUsed += n;
+			return;
+		}
+	}
+	grow_buffer(&g_pErrBuf, &g_nErrBufSize, g_nErrBufUsed + sizeof(ErrRecord) + n);
+	g_nErrRecord = g_nErrBufUsed;
+	memcpy(g_pErrBuf + g_nErrBufUsed, &oRecord, sizeof(ErrRecord));
+	memcpy(g_pErrBuf + g_nErrBufUsed + sizeof(ErrRecord), p, n);
+	g_nErrBufUsed += sizeof(ErrRecord) + n;
+}
+
+// Write vprintf() formatted output to stderr like OutBuf_ErrWrite().
+void OutBuf_ErrVPrintf(const char *format, va_list args)
+{
+	va_list args2;
+	int n;
+
+	grow_buffer(&g_pErrFormat, &g_nErrFormatSize, 256);
+	va_copy(args2, args);
+	n = vsnprintf(g_pErrFormat, g_nErrFormatSize, format, args);
+	if (n >= 0 && (size_t)n >= g_nErrFormatSize){
+		grow_buffer(&g_pErrFormat, &g_nErrFormatSize, n + 1);
+		vsnprintf(g_pErrFormat, g_nErrFormatSize, format, args2);
+	}
+	va_end(args2);
+	if (n > 0)
+		OutBuf_ErrWrite(g_pErrFormat, n);
+}
+
+// Write printf() formatted output to stderr like OutBuf_ErrWrite().
+void OutBuf_ErrPrintf(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	OutBuf_ErrVPrintf(format, args);
+	va_end(args);
+}
+
+// Start capturing stdout and stderr output, captures do not nest.
+void OutBuf_BeginCapture()
+{
+	g_bOutBufCapture = true;
+	g_nOutBufCaptureStart = g_nOutBufUsed;
+	g_nErrBufUsed = 0;
+	g_nErrRecord = 0;
+}
+
+// Stop capturing and get the captured bytes. The stdout bytes stay in the buffer to be written as usual,
+// the stderr records are not written; both pointers are valid until the next OutBuf_ call.
+void OutBuf_EndCapture(const char **ppOut, size_t *pnOut, const char **ppErr, size_t *pnErr)
+{
+	*ppOut = g_pOutBuf + g_nOutBufCaptureStart;
+	*pnOut = g_nOutBufUsed - g_nOutBufCaptureStart;
+	*ppErr = g_pErrBuf;
+	*pnErr = g_nErrBufUsed;
+	g_bOutBufCapture = false;
+	g_nErrBufUsed = 0;
+}
+
+// Write a copy of captured stdout bytes and stderr records out in the order they were captured.
+// Return false if the records do not fit the stdout bytes, and then write nothing.
+bool OutBuf_Replay(const char *pOut, size_t nOut, const char *pErr, size_t nErr)
+{
+	ErrRecord oRecord;
+	size_t i, nOutPos = 0;
+
+	for(i = 0; i < nErr; i += sizeof(ErrRecord) + oRecord.nLeng){
+		if (nErr - i < sizeof(ErrRecord))
+			return false;
+		memcpy(&oRecord, pErr + i, sizeof(ErrRecord));
+		if (oRecord.nOutPos < nOutPos || oRecord.nOutPos > nOut || oRecord.nLeng > nErr - i - sizeof(ErrRecord))
+			return false;
+		nOutPos = oRecord.nOutPos;
+	}
+	nOutPos = 0;
+	for(i = 0; i < nErr; i += sizeof(ErrRecord) + oRecord.nLeng){
+		memcpy(&oRecord, pErr + i, sizeof(ErrRecord));
+		OutBuf_Write(pOut + nOutPos, oRecord.nOutPos - nOutPos);
+		OutBuf_ErrWrite(pErr + i + sizeof(ErrRecord), oRecord.nLeng);
+		nOutPos = oRecord.nOutPos;
+	}
+	OutBuf_Write(pOut + nOutPos, nOut - nOutPos);
+	return true;
+}
+
+// Remove the stdout bytes of the last capture from the buffer, once the caller has its own copy.
+void OutBuf_DropCapture()
+{
+	g_nOutBufUsed = g_nOutBufCaptureStart;
+}
+
+// End a capture and keep a copy of its output in *pCapture, for OutBuf_EmitCapture() later.
+void OutBuf_TakeCapture(OutCapture *pCapture)
+{
+	const char *pOut, *pErr;
+
+	OutBuf_EndCapture(&pOut, &pCapture->nOut, &pErr, &pCapture->nErr);
+	pCapture->pOut = (char *)malloc(pCapture->nOut + pCapture->nErr + 1);
+	pCapture->pErr = pCapture->pOut + pCapture->nOut;
+	memcpy(pCapture->pOut, pOut, pCapture->nOut);
+	memcpy(pCapture->pErr, pErr, pCapture->nErr);
+	OutBuf_DropCapture();
+}
+
+// Write a copy from OutBuf_TakeCapture() out and release it.
+void OutBuf_EmitCapture(OutCapture *pCapture)
+{
+	OutBuf_Replay(pCapture->pOut, pCapture->nOut, pCapture->pErr, pCapture->nErr);
+	free(pCapture->pOut);
+	pCapture->pOut = pCapture->pErr = NULL;
+}
+
+// Flush and release the buffer.
+void OutBuf_Release()
+{
+	OutBuf_Flush();
+	free(g_pOutBuf);
+	free(g_pErrBuf);
+	free(g_pErrFormat);
+	g_pOutBuf = g_pErrBuf = g_pErrFormat = NULL;
+	g_nOutBufSize = g_nErrBufSize = g_nErrFormatSize = 0;
+}
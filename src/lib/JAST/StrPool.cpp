@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include "JAST/jast_internal.h"
+
+#define MIN_POOL_SLOTS		1024
+
+// String pool: every distinct string is stored once in the arena and handed out as a stable const char*,
+// so interned strings can be compared and hashed by pointer.
+struct PoolSlot {
+	const char *psz;
+	unsigned int nHash;
+};
+
+// Every thread compiles with a pool of its own, worker threads helping with one compilation use the pool
+// of the thread that owns it through StrPool_Use(); lookups and insertions are then serialized by its lock.
+struct StrPool {
+	PoolSlot *pSlots;
+	int nSlots;				// always a power of 2.
+	int nUsed;
+	bool bShared;			// other threads intern too, take the lock.
+	std::mutex oLock;
+};
+
+thread_local StrPool g_oPool;			// pool of the compilation on this thread.
+thread_local StrPool *g_pPool = NULL;	// pool of another thread in use, or NULL for g_oPool.
+
+static inline StrPool *current_pool()
+{
+	return g_pPool ? g_pPool : &g_oPool;
+}
+
+// FNV-1a hash of the first n characters of a string.
+static unsigned int hash_string(const char *psz, int n)
+{
+	unsigned int h = 2166136261u;
+
+	while(n-- > 0){
+		h ^= (unsigned char)*psz++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Find the slot of the input string, or the empty slot where it should be placed.
+static PoolSlot *find_slot(StrPool *pPool, const char *psz, int n, unsigned int nHash)
+{
+	unsigned int i, nMask = pPool->nSlots - 1;
+	PoolSlot *p;
+
+	for(i = nHash & nMask; ; i = (i + 1) & nMask){
+		p = &pPool->pSlots[i];
+		if (!p->psz || (p->nHash == nHash && strncmp(p->psz, psz, n) == 0 && p->psz[n] == '\0'))
+			return p;
+	}
+}
+
+// Double the pool slots and re-place all strings when the pool gets half full.
+static void grow_slots(StrPool *pPool)
+{
+	int i, nOld = pPool->nSlots;
+	PoolSlot *pOld = pPool->pSlots;
+
+	pPool->nSlots = nOld ? nOld * 2 : MIN_POOL_SLOTS;
+	pPool->pSlots = (PoolSlot *)calloc(pPool->nSlots, sizeof(PoolSlot));
+	for(i = 0; i < nOld; i++){
+		if (pOld[i].psz)
+			*find_slot(pPool, pOld[i].psz, strlen(pOld[i].psz), pOld[i].nHash) = pOld[i];
+	}
+	free(pOld);
+}
+
+// Copy n characters into the arena and terminate them with '\0'.
+static const char *store_string(const char *psz, int n)
+{
+	char *pszNew = Arena_AllocChars(n + 1);
+
+	memcpy(pszNew, psz, n);
+	pszNew[n] = '\0';
+	return pszNew;
+}
+
+// Find or add the interned copy of the first n characters of the input string.
+static const char *intern_n(StrPool *pPool, const char *psz, int n)
+{
+	unsigned int nHash;
+	PoolSlot *p;
+
+	n = strnlen(psz, n);
+	if ((pPool->nUsed + 1) * 2 > pPool->nSlots)
+		grow_slots(pPool);
+	nHash = hash_string(psz, n);
+	p = find_slot(pPool, psz, n, nHash);
+	if (!p->psz){
+		p->psz = store_string(psz, n);
+		p->nHash = nHash;
+		pPool->nUsed++;
+	}
+	return p->psz;
+}
+
+// Get the interned copy of the first n characters of the input string (or less if it ends earlier).
+const char *StrPool_InternN(const char *psz, int n)
+{
+	StrPool *pPool = current_pool();
+
+	if (pPool->bShared){
+		std::lock_guard<std::mutex> oLock(pPool->oLock);
+		return intern_n(pPool, psz, n);
+	}
+	return intern_n(pPool, psz, n);
+}
+
+// Get the pool this thread interns into, to hand it to worker threads.
+StrPool *StrPool_GetCurrent()
+{
+	return current_pool();
+}
+
+// Intern into the pool of another thread, or into the own one again with NULL.
+void StrPool_Use(StrPool *pPool)
+{
+	g_pPool = (pPool == &g_oPool) ? NULL : pPool;
+}
+
+// Turn the lock of the current pool on while more than one thread may intern strings.
+void StrPool_SetShared(bool bShared)
+{
+	current_pool()->bShared = bShared;
+}
+
+// Get the interned copy of the input string.
+const char *StrPool_Intern(const char *psz)
+{
+	return StrPool_InternN(psz, strlen(psz));
+}
+
+// Release the index of the own pool of this thread, the strings themselves go away with Arena_Release().
+void StrPool_Release()
+{
+	free(g_oPool.pSlots);
+	g_oPool.pSlots = NULL;
+	g_oPool.nSlots = 0;
+	g_oPool.nUsed = 0;
+}
@@ -1,119 +1,302 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "JAST/jast_internal.h"
 
-#define MAX_STACK_LEVELS	128
-#define MAX_TOTAL_SYMBOLS	65536
+#define MIN_STACK_LEVELS	128
+#define MIN_TOTAL_SYMBOLS	4096
+#define MIN_HASH_SLOTS		1024
 
-// Default not to dump the whole symbol table before pop.
-bool g_bDumpOnPop = false;
+// Default not to dump the whole symbol table before pop, set per thread by the file being compiled on it.
+thread_local bool g_bDumpOnPop = false;
 
 // Initialize the symbol table stack level with -1 and g_pnStackIndex[0] = 0 before adding anything.
-int g_nStackLevel = -1;		
-int g_pnStackIndex[MAX_STACK_LEVELS] = {0};
-struct Symbol g_oSymTab[MAX_TOTAL_SYMBOLS];
-
-int  SymTab_GetLevel(int n) { return g_oSymTab[n].nLevel; }
-const char *SymTab_GetName(int n) { return g_oSymTab[n].pszName; }
-const char *SymTab_GetKind(int n) { return g_oSymTab[n].pszKind; }
-const char *SymTab_GetScalerType(int n) { return g_oSymTab[n].pszScalerType; }
-const char *SymTab_GetTypeStr(int n) { return g_oSymTab[n].pszTypeStr; }
-const char *SymTab_GetAttr(int n) { return g_oSymTab[n].pszAttr; }
-SymbolValue_t SymTab_GetKindValue(int n) { return g_oSymTab[n].nSymKind; }
-SymbolValue_t SymTab_GetTypeValue(int n) { return g_oSymTab[n].nSymType; }
-AstNode *SymTab_GetAstNode(int n) { return g_oSymTab[n].pAst; }
+// Both arrays are contiguous and doubled on demand, so a symbol index stays valid but a Symbol* does not.
+// Every thread has its own symbol table, worker threads see the global scope through SymTab_SetGlobalView().
+thread_local int g_nStackLevel = -1;		
+thread_local int *g_pnStackIndex = NULL;
+thread_local int g_nStackIndexCap = 0;
+thread_local struct Symbol *g_oSymTab = NULL;
+thread_local int g_nSymTabCap = 0;
+
+// Global scope of the main thread, shared read-only with worker threads by SymTab_ShareGlobals().
+// A worker sees its first g_nSharedView symbols as its level 0 and keeps its own symbols from there on:
+// symbol n is g_pSharedSymbols[n] below g_nSharedView and g_oSymTab[n - g_nSharedView] above.
+const struct Symbol *g_pSharedSymbols = NULL;
+const struct HashSlot *g_pSharedSlots = NULL;
+int g_nSharedSlots = 0;
+thread_local int g_nSharedView = 0;		// always 0 in the main thread.
+
+// Hash index from an interned symbol name to the innermost visible symbol with that name.
+// Each name owns one slot (open addressing, linear probing) and keeps it for the whole run,
+// an outer symbol hidden by an inner one is chained through Symbol::nShadow and restored on pop.
+struct HashSlot {
+	const char *pszName;	// interned by StrPool, compared by pointer.
+	int nSym;				// innermost visible symbol index, -1 if the name is not visible now.
+};
+thread_local HashSlot *g_pHashSlots = NULL;
+thread_local int g_nHashSlots = 0;		// always a power of 2.
+thread_local int g_nHashUsed = 0;
+
+// Get symbol n, from the shared global scope in a worker thread.
+static inline const struct Symbol *sym(int n)
+{
+	return n < g_nSharedView ? &g_pSharedSymbols[n] : &g_oSymTab[n - g_nSharedView];
+}
+
+int  SymTab_GetLevel(int n) { return sym(n)->nLevel; }
+const char *SymTab_GetName(int n) { return sym(n)->pszName; }
+const char *SymTab_GetKind(int n) { return sym(n)->pszKind; }
+const char *SymTab_GetScalerType(int n) { return sym(n)->pszScalerType; }
+const char *SymTab_GetTypeStr(int n) { return sym(n)->pszTypeStr; }
+const char *SymTab_GetAttr(int n) { return sym(n)->pszAttr; }
+SymbolValue_t SymTab_GetKindValue(int n) { return sym(n)->nSymKind; }
+SymbolValue_t SymTab_GetTypeValue(int n) { return sym(n)->nSymType; }
+AstNode *SymTab_GetAstNode(int n) { return sym(n)->pAst; }
 
 void SymTab_EnableDump(bool bEnable) { g_bDumpOnPop = bEnable; }
+bool SymTab_IsDumpEnabled() { return g_bDumpOnPop; }
 int  SymTab_GetCurrStackLevel() {return g_nStackLevel; }
 
+// Get the storage slot of symbol n: its index for a global, or its offset from the first symbol of level 1
+// for a local, as the scope of a function body (or the program body) starts at level 1. Blocks that end
+// give their slots back, so a frame needs as many slots as the deepest nesting of its blocks holds.
+int  SymTab_GetSlot(int n) { return sym(n)->nLevel == 0 ? n : n - g_pnStackIndex[1]; }
+int  SymTab_GetCount() { return g_pnStackIndex[g_nStackLevel + 1]; }
+
+// ----------------------------------------------------------------
+// Hash index of symbol names.
+// ----------------------------------------------------------------
+
+// Hash of an interned symbol name by its address.
+static unsigned int hash_name(const char *pszName)
+{
+	uintptr_t n = (uintptr_t)pszName;
+	return (unsigned int)((n ^ (n >> 15)) * 2654435761u);
+}
+
+// Find the slot of the input name in a hash index, or the empty slot where it should be placed.
+static HashSlot *find_slot_in(HashSlot *pSlots, int nSlots, const char *pszName)
+{
+	unsigned int i, nMask = nSlots - 1;
+	HashSlot *p;
+
+	for(i = hash_name(pszName) & nMask; ; i = (i + 1) & nMask){
+		p = &pSlots[i];
+		if (!p->pszName || p->pszName == pszName)
+			return p;
+	}
+}
+
+// Find the slot of the input name in the hash index of this thread.
+static HashSlot *find_slot(const char *pszName)
+{
+	return find_slot_in(g_pHashSlots, g_nHashSlots, pszName);
+}
+
+// Double the hash slots and re-place all names when the table gets half full.
+static void grow_slots()
+{
+	int i, nOld = g_nHashSlots;
+	HashSlot *pOld = g_pHashSlots, *p;
+
+	g_nHashSlots = nOld ? nOld * 2 : MIN_HASH_SLOTS;
+	g_pHashSlots = (HashSlot *)calloc(g_nHashSlots, sizeof(HashSlot));
+	for(i = 0; i < nOld; i++){
+		if (pOld[i].pszName){
+			p = find_slot(pOld[i].pszName);
+			*p = pOld[i];
+		}
+	}
+	free(pOld);
+}
+
+// Get the slot of the input name, adding an empty entry for a new name.
+static HashSlot *get_slot(const char *pszName)
+{
+	HashSlot *p;
+
+	if ((g_nHashUsed + 1) * 2 > g_nHashSlots)
+		grow_slots();
+	p = find_slot(pszName);
+	if (!p->pszName){
+		p->pszName = pszName;
+		p->nSym = -1;
+		g_nHashUsed++;
+	}
+	return p;
+}
+
+// Release the hash index.
+static void release_slots()
+{
+	free(g_pHashSlots);
+	g_pHashSlots = NULL;
+	g_nHashSlots = 0;
+	g_nHashUsed = 0;
+}
+
+// ----------------------------------------------------------------
+// Symbol table stack.
+// ----------------------------------------------------------------
+
+// Grow the array pointed by *ppArray to hold at least nNeed items of nSize bytes, doubling its capacity.
+static void grow_array(void **ppArray, int *pnCap, int nNeed, int nMin, size_t nSize)
+{
+	int nCap = *pnCap ? *pnCap : nMin;
+	void *p;
+
+	if (nNeed <= *pnCap)
+		return;
+	while(nCap < nNeed)
+		nCap *= 2;
+	p = realloc(*ppArray, nCap * nSize);
+	if (!p){
+		fprintf(stderr, "Out of memory for %d symbol table entries\n", nCap);
+		exit(-1);
+	}
+	*ppArray = p;
+	*pnCap = nCap;
+}
+
 // Initialize the symbol table.
 void SymTab_Init()
 {
+	grow_array((void **)&g_pnStackIndex, &g_nStackIndexCap, MIN_STACK_LEVELS, MIN_STACK_LEVELS, sizeof(int));
+	grow_array((void **)&g_oSymTab, &g_nSymTabCap, MIN_TOTAL_SYMBOLS, MIN_TOTAL_SYMBOLS, sizeof(Symbol));
 	g_nStackLevel = -1;
 	g_pnStackIndex[0] = 0;
+	release_slots();
+	grow_slots();
 }
 
-// Release allocated string on releasing the symbol table.
+// Release the symbol table, its strings belong to the string pool.
 void SymTab_Release()
 {
-	int i;
-
-	for(i = g_pnStackIndex[g_nStackLevel + 1]; i >= 0; i--){
-		free(g_oSymTab[i].pszName);
-		free(g_oSymTab[i].pszKind);
-		free(g_oSymTab[i].pszScalerType);
-		free(g_oSymTab[i].pszTypeStr);
-		free(g_oSymTab[i].pszAttr);
-	}
+	release_slots();
+	free(g_pnStackIndex);
+	free(g_oSymTab);
+	g_pnStackIndex = NULL;
+	g_oSymTab = NULL;
+	g_nStackIndexCap = g_nSymTabCap = 0;
+	g_nStackLevel = -1;
+	g_nSharedView = 0;
 }
 
 // Dump the whole symbol table from stack bottom to top.
 void SymTab_Dump() 
 {
 	int i;
-	struct Symbol *s;
+	const struct Symbol *s;
 
-	for (i = 0; i < 110; ++i) printf("=");
-	printf("\n");
-	printf("%-33s%-11s%-11s%-17s%-11s\n", "Name", "Kind", "Level", "Type", "Attribute");
-	for (i = 0; i < 110; ++i) printf("-");
-	printf("\n");
+	for (i = 0; i < 110; ++i) OutBuf_Printf("=");
+	OutBuf_Printf("\n");
+	OutBuf_Printf("%-33s%-11s%-11s%-17s%-11s\n", "Name", "Kind", "Level", "Type", "Attribute");
+	for (i = 0; i < 110; ++i) OutBuf_Printf("-");
+	OutBuf_Printf("\n");
 	for(i = 0; i < g_pnStackIndex[g_nStackLevel + 1]; i++){
-		s = &g_oSymTab[i];
-		printf("%-33s%-11s%d%-10s%-17s%-11s\n", s->pszName, s->pszKind, s->nLevel, (s->nLevel == 0) ? "(global)" : "(local)", s->pszTypeStr, s->pszAttr);
+		s = sym(i);
+		OutBuf_Printf("%-33s%-11s%d%-10s%-17s%-11s\n", s->pszName, s->pszKind, s->nLevel, (s->nLevel == 0) ? "(global)" : "(local)", s->pszTypeStr, s->pszAttr);
 	}
-	for (i = 0; i < 110; ++i) printf("-");
-	printf("\n");
+	for (i = 0; i < 110; ++i) OutBuf_Printf("-");
+	OutBuf_Printf("\n");
 }
 
 // Push a symbol table to the stack by increasing stack level and init the table start and end indexes.
 int SymTab_Push()
 {
+	grow_array((void **)&g_pnStackIndex, &g_nStackIndexCap, g_nStackLevel + 3, MIN_STACK_LEVELS, sizeof(int));
 	g_nStackLevel++;
 	g_pnStackIndex[g_nStackLevel + 1] = g_pnStackIndex[g_nStackLevel];
 	return g_nStackLevel;
 }
 
-// Remove the symbol table on stack top by decreasing the stack level.
+// Remove the symbol table on stack top by decreasing the stack level,
+// and make the symbols hidden by the removed ones visible again in the hash index.
 int SymTab_Pop()
 {
+	int i;
+	const struct Symbol *s;
+
 	if (g_bDumpOnPop)
 		SymTab_Dump();
 
+	for(i = g_pnStackIndex[g_nStackLevel + 1] - 1; i >= g_pnStackIndex[g_nStackLevel]; i--){
+		s = sym(i);
+		find_slot(s->pszName)->nSym = s->nShadow;
+	}
 	g_nStackLevel--;
 	return g_nStackLevel;
 }
 
-// Insert the input symbol on the very top of the symbol table stack.
-int SymTab_Insert(const char *pszName, const char *pszKind, const char *pszScalerType, const char *pszTypeStr, const char *pszAttr, AstNode *pAst)
+// Make the new symbol n on the very top visible in the hash index, hiding an outer one with the same name.
+static void link_symbol(int n)
+{
+	struct Symbol *s = &g_oSymTab[n - g_nSharedView];
+	HashSlot *p = get_slot(s->pszName);
+
+	s->nShadow = p->nSym;
+	p->nSym = n;
+	g_pnStackIndex[g_nStackLevel + 1]++;
+}
+
+// Insert the input symbol on the very top of the symbol table stack, the strings are interned in the string pool.
+// nScalerType is kUnknown for the program symbol, which has no type.
+int SymTab_Insert(const char *pszName, SymbolValue_t nKind, SymbolValue_t nScalerType, const char *pszTypeStr, const char *pszAttr, AstNode *pAst)
 {
 	int n;
 	struct Symbol *s;
 
 	n = g_pnStackIndex[g_nStackLevel + 1];
-	s = &g_oSymTab[n];
+	grow_array((void **)&g_oSymTab, &g_nSymTabCap, n - g_nSharedView + 1, MIN_TOTAL_SYMBOLS, sizeof(Symbol));
+	s = &g_oSymTab[n - g_nSharedView];
 	s->nLevel = g_nStackLevel;
-	s->pszName = strdup(pszName);
-	s->pszKind = strdup(pszKind);
-	s->pszScalerType = strdup(pszScalerType);
-	s->pszTypeStr = strdup(pszTypeStr);
-	s->pszAttr = strdup(pszAttr);
-	s->nSymKind = GetSymbolValue(pszKind);
-	s->nSymType = GetSymbolValue(pszScalerType);
+	s->pszName = StrPool_Intern(pszName);
+	s->pszKind = GetSymbolString(nKind);
+	s->pszScalerType = (nScalerType != kUnknown) ? GetSymbolString(nScalerType) : "";
+	s->pszTypeStr = StrPool_Intern(pszTypeStr);
+	s->pszAttr = StrPool_Intern(pszAttr);
+	s->nSymKind = nKind;
+	s->nSymType = nScalerType;
 	s->pAst = pAst;
-	g_pnStackIndex[g_nStackLevel + 1]++;
+	link_symbol(n);
 	return n;
 }
 
-// Get the table index of the input symbol name, linearly searching from stack top to bottom.
+// Make the global scope of this thread, which has to be the main thread, visible to worker threads.
+// The main thread must not change its symbol table while workers use it.
+void SymTab_ShareGlobals()
+{
+	g_pSharedSymbols = g_oSymTab;
+	g_pSharedSlots = g_pHashSlots;
+	g_nSharedSlots = g_nHashSlots;
+}
+
+// In a worker thread at stack level 0, show the first nCount symbols of the shared global scope,
+// the scope as it was when the main thread had entered nCount symbols. Nothing is copied.
+void SymTab_SetGlobalView(int nCount)
+{
+	g_nSharedView = nCount;
+	g_pnStackIndex[1] = nCount;
+}
+
+// Get the table index of the innermost visible symbol with the input name, or -1 if not found.
+// The name has to be interned by the string pool, as all names in the AST are.
 int SymTab_Lookup(const char *pszName)
 {
-	int i;
+	HashSlot *p;
 
-	for(i = g_pnStackIndex[g_nStackLevel + 1] - 1; i >= 0; i--){
-		if (strcmp(g_oSymTab[i].pszName, pszName) == 0)
-			return i;
+	if (g_pHashSlots){
+		p = find_slot(pszName);
+		if (p->pszName && p->nSym >= 0)
+			return p->nSym;
+	}
+	// Names at level 0 of the main thread are unique, a visible one is the symbol in its slot.
+	if (g_nSharedView > 0){
+		p = find_slot_in((HashSlot *)g_pSharedSlots, g_nSharedSlots, pszName);
+		if (p->pszName && p->nSym >= 0 && p->nSym < g_nSharedView)
+			return p->nSym;
 	}
 	return -1;
 }
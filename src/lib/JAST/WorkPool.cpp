@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include "JAST/jast_internal.h"
+
+// Work-stealing pool: the items 0..nItems-1 are split into one contiguous range per worker thread.
+// A worker takes items from the front of its own range; when that runs dry it steals the back half
+// of the largest range left, so neighbouring items mostly stay on one thread.
+struct WorkRange {
+	std::mutex oLock;
+	int nBegin;
+	int nEnd;
+};
+
+int g_nWorkJobs = 1;
+thread_local bool g_bInWorker = false;	// a pool run from a worker thread runs on that thread alone.
+
+// Set the number of worker threads, 0 means one per hardware thread.
+void WorkPool_SetJobs(int nJobs)
+{
+	if (nJobs <= 0)
+		nJobs = std::thread::hardware_concurrency();
+	g_nWorkJobs = nJobs > 0 ? nJobs : 1;
+}
+
+int WorkPool_GetJobs()
+{
+	return g_bInWorker ? 1 : g_nWorkJobs;
+}
+
+// Take the next item of a range, or -1 if it is empty.
+static int take_item(WorkRange *pRange)
+{
+	std::lock_guard<std::mutex> oLock(pRange->oLock);
+
+	return pRange->nBegin < pRange->nEnd ? pRange->nBegin++ : -1;
+}
+
+// Move the back half of the largest other range into the empty range of worker nWorker.
+// Return false when there is nothing left to steal.
+static bool steal_items(WorkRange *pRanges, int nWorkers, int nWorker)
+{
+	int i, n, nVictim = -1, nMost = 0, nMid;
+
+	for(i = 0; i < nWorkers; i++){
+		if (i == nWorker)
+			continue;
+		std::lock_guard<std::mutex> oLock(pRanges[i].oLock);
+		n = pRanges[i].nEnd - pRanges[i].nBegin;
+		if (n > nMost){
+			nMost = n;
+			nVictim = i;
+		}
+	}
+	if (nVictim < 0)
+		return false;
+
+	// Both locks at once, two thieves stealing from each other's victims must not wait in a circle.
+	WorkRange *pVictim = &pRanges[nVictim], *pOwn = &pRanges[nWorker];
+	std::unique_lock<std::mutex> oVictimLock(pVictim->oLock, std::defer_lock), oOwnLock(pOwn->oLock, std::defer_lock);
+	std::lock(oVictimLock, oOwnLock);
+	if (pVictim->nBegin >= pVictim->nEnd)
+		return true;	// emptied meanwhile, look again.
+	nMid = pVictim->nBegin + (pVictim->nEnd - pVictim->nBegin) / 2;
+	pOwn->nBegin = nMid;
+	pOwn->nEnd = pVictim->nEnd;
+	pVictim->nEnd = nMid;
+	return true;
+}
+
+// Call funcItem(nItem, pArg) for every item on up to WorkPool_GetJobs() threads, and return when all are done.
+// Each thread calls funcThread(true, pArg) before its first item and funcThread(false, pArg) after its last,
+// to set up and release its thread-local state; funcThread may be NULL.
+void WorkPool_Run(int nItems, void (*funcItem)(int, void*), void (*funcThread)(bool, void*), void *pArg)
+{
+	int i, nJobs = WorkPool_GetJobs(), nWorkers = nJobs < nItems ? nJobs : nItems;
+	std::vector<WorkRange> oRanges(nWorkers > 0 ? nWorkers : 1);
+	std::vector<std::thread> oThreads;
+	WorkRange *pRanges = oRanges.data();
+
+	if (nWorkers <= 0)
+		return;
+	for(i = 0; i < nWorkers; i++){
+		pRanges[i].nBegin = (long long)nItems * i / nWorkers;
+		pRanges[i].nEnd = (long long)nItems * (i + 1) / nWorkers;
+	}
+	for(i = 0; i < nWorkers; i++){
+		oThreads.emplace_back([=](){
+			int nItem;
+
+			g_bInWorker = true;
+			if (funcThread)
+				funcThread(true, pArg);
+			do {
+				while((nItem = take_item(&pRanges[i])) >= 0)
+					funcItem(nItem, pArg);
+			} while(steal_items(pRanges, nWorkers, i));
+			if (funcThread)
+				funcThread(false, pArg);
+		});
+	}
+	for(auto &oThread : oThreads)
+		oThread.join();
+}
@@ -10,8 +10,7 @@
 int PrintCompoundStatementNode(AstNode *pAst, int nLevel)
 {
 	CompoundStatementNode *pNode = (CompoundStatementNode *)pAst->pBody;
-	PrintLeadingTabs(nLevel);
-	printf("compound statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "compound statement", pAst->location.line, pAst->location.col);
 	PrintAstList(pNode->pFirstDeclarationNode, nLevel + 1);
 	PrintAstList(pNode->pFirstStatementNode, nLevel + 1);
 	return 0;
@@ -20,8 +19,7 @@ int PrintCompoundStatementNode(AstNode *pAst, int nLevel)
 int PrintPrintNode(AstNode *pAst, int nLevel)
 {
 	PrintNode *pNode = (PrintNode *)pAst->pBody;
-	PrintLeadingTabs(nLevel);
-	printf("print statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "print statement", pAst->location.line, pAst->location.col);
 	PrintAstNode(pNode->pExpressionNode, nLevel + 1);
 	return 0;
 }
@@ -29,8 +27,7 @@ int PrintPrintNode(AstNode *pAst, int nLevel)
 int PrintVariableRefNode(AstNode *pAst, int nLevel)
 {
 	VariableRefNode *pNode = (VariableRefNode *)pAst->pBody;
-	PrintLeadingTabs(nLevel);
-	printf("variable reference <line: %d, col: %d> %s\n", pAst->location.line, pAst->location.col, pNode->pszVarName);
+	PrintNodeLine(nLevel, "variable reference", pAst->location.line, pAst->location.col, pNode->pszVarName);
 	PrintAstList(pNode->pFirstArrRefNode, nLevel + 1);
 	return 0;
 }
@@ -39,8 +36,7 @@ int PrintAssignNode(AstNode *pAst, int nLevel)
 {
 	AssignNode *pNode = (AssignNode *)pAst->pBody;
 
-	PrintLeadingTabs(nLevel);
-	printf("assignment statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "assignment statement", pAst->location.line, pAst->location.col);
 	PrintAstNode(pNode->pVariableRefNode, nLevel + 1);
 	PrintAstNode(pNode->pExpressionNode, nLevel + 1);
 
@@ -51,8 +47,7 @@ int PrintReadNode(AstNode *pAst, int nLevel)
 {
 	ReadNode *pNode = (ReadNode *)pAst->pBody;
 
-	PrintLeadingTabs(nLevel);
-	printf("read statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "read statement", pAst->location.line, pAst->location.col);
 	PrintAstNode(pNode->pVariableRefNode, nLevel + 1);		
 	
 	return 0;
@@ -83,7 +78,7 @@ int VisitPrintNode(AstNode *pAst)
 		// Check whether the type of the expression (target) is scalar type.
 		nResultType = ((ExpressionNode *)(pNode->pExpressionNode)->pBody)->nResultType;
 		if(nResultType != kInteger && nResultType != kReal && nResultType != kBoolean && nResultType != kString){
-			ErrorMessage(pNode->pExpressionNode, "expression of print statement must be scalar type\n");
+			ErrorMessage(pNode->pExpressionNode, kDiagPrintNotScalar);
 			nErr++;
 		}
 	}
@@ -98,14 +93,14 @@ int VisitVariableRefNode(AstNode *pAst)
 
 	// 1. The identifier has to be in symbol tables.
 	if ((n = SymTab_Lookup(pNode->pszVarName)) < 0){
-		ErrorMessage(pAst, "use of undeclared symbol '%s'\n", pNode->pszVarName);
+		ErrorMessage(pAst, kDiagUndeclared, pNode->pszVarName);
 		return 1;
 	}
 
 	// 2. The kind of symbol has to be a parameter, variable, loop_var, or constant.
 	nKind = SymTab_GetKindValue(n);
 	if (nKind != kParameter && nKind != kVariable && nKind != kLoopVar && nKind != kConstant){
-		ErrorMessage(pAst, "use of non-variable symbol '%s'\n", pNode->pszVarName);
+		ErrorMessage(pAst, kDiagNotVariable, pNode->pszVarName);
 		return 1;
 	}
 
@@ -117,7 +112,7 @@ int VisitVariableRefNode(AstNode *pAst)
 	p = pNode->pFirstArrRefNode;
 	while(p){
 		if (((ExpressionNode *)p->pBody)->nResultType != kInteger){
-			ErrorMessage(p, "index of array reference must be an integer\n");
+			ErrorMessage(p, kDiagIndexNotInteger);
 			return 1;
 		}
 		p = p->pNext;
@@ -129,13 +124,18 @@ int VisitVariableRefNode(AstNode *pAst)
 	nDimRef = AstLinkLength(pNode->pFirstArrRefNode);
 	nDimDecl = AstLinkLength(((TypeNode *)p->pBody)->pFirstIntNode);
 	if (nDimRef > nDimDecl){
-		ErrorMessage(pAst, "there is an over array subscript on '%s'\n", pNode->pszVarName);
+		ErrorMessage(pAst, kDiagOverSubscript, pNode->pszVarName);
 		return 1;
 	}
 
 	// After passing all checks, obtain the var type from symbol table when there is no under array subscript.
 	pNode->nVarType = (nDimRef == nDimDecl) ? SymTab_GetTypeValue(n) : kUnknown;
 
+	// Bind the reference to its declaration.
+	pNode->pTypeNode = p;
+	pNode->nLevel = SymTab_GetLevel(n);
+	pNode->nSlot = SymTab_GetSlot(n);
+
 	return 0;
 }
 
@@ -158,17 +158,17 @@ int VisitAssignNode(AstNode *pAst)
 	 	nDimRef = AstLinkLength(pVarRefNode->pFirstArrRefNode);
 	 	nDimDecl = AstLinkLength(((TypeNode *)p->pBody)->pFirstIntNode);
 		if (nDimRef < nDimDecl){
-			ErrorMessage(pNode->pVariableRefNode, "array assignment is not allowed\n");
+			ErrorMessage(pNode->pVariableRefNode, kDiagArrayAssign);
 			return 1;
 		}
 		// 2. Make sure variable reference is not an constant.
 		else if (nKind == kConstant){
-			ErrorMessage(pNode->pVariableRefNode, "cannot assign to variable '%s' which is a constant\n", pVarRefNode->pszVarName);
+			ErrorMessage(pNode->pVariableRefNode, kDiagAssignConstant, pVarRefNode->pszVarName);
 			return 1;
 		}
 		// 3. Make sure variable reference is not a loop variable when the context is within a loop body.
 		else if (nKind == kLoopVar){
-			ErrorMessage(pNode->pVariableRefNode, "the value of loop variable cannot be modified inside the loop body\n", pVarRefNode->pszVarName);
+			ErrorMessage(pNode->pVariableRefNode, kDiagAssignLoopVar);
 			return 1;
 		}
 		// 4. Make sure the result expression type in assignment.
@@ -177,12 +177,12 @@ int VisitAssignNode(AstNode *pAst)
 			nResultType = ((ExpressionNode *)(pNode->pExpressionNode)->pBody)->nResultType;
 			// Check if the result type of expression is array type.
 			if(nResultType == kUnknown){
-				ErrorMessage(pNode->pExpressionNode, "array assignment is not allowed\n");
+				ErrorMessage(pNode->pExpressionNode, kDiagArrayAssign);
 				return 1;
 			}
 			// Check if the variable reference type is the same the result type of expression after type coercion.
 			else if(!((nResultType == kInteger && nVarType == kReal) || nVarType == nResultType)){
-				ErrorMessage(pAst, "assigning to '%s' from incompatible type '%s'\n", GetSymbolString(nVarType), GetSymbolString(nResultType));
+				ErrorMessage(pAst, kDiagAssignIncompatible, GetSymbolString(nVarType), GetSymbolString(nResultType));
 				return 1;
 			}
 		}
@@ -206,66 +206,268 @@ int VisitReadNode(AstNode *pAst)
 		nVarType = ((VariableRefNode *)(pNode->pVariableRefNode)->pBody)->nVarType;
 		// 1. Make sure that variable reference is a scalar type.
 		if (nKind == kVariable && (nVarType != kInteger && nVarType != kReal && nVarType != kString && nVarType != kBoolean)){
-			ErrorMessage(pNode->pVariableRefNode, "variable reference of read statement must be scalar type\n");
+			ErrorMessage(pNode->pVariableRefNode, kDiagReadNotScalar);
 			return 1;
 		}
 		// 2. Make sure that variable reference is not a constant or loop variable.
 		else if (nKind == kConstant || nKind == kLoopVar){
-			ErrorMessage(pNode->pVariableRefNode, "variable reference of read statement cannot be a constant or loop variable\n");
+			ErrorMessage(pNode->pVariableRefNode, kDiagReadConstant);
 			return 1;
 		}
 	}
 	return nErr;
 }
 
+// ----------------------------------------------------------------
+// CodeGen CompoundStatement related Node.
+// ----------------------------------------------------------------
+int CodeGenCompoundStatementNode(AstNode *pAst)
+{
+	CompoundStatementNode *pNode = (CompoundStatementNode *)pAst->pBody;
+
+	CodeGenAstList(pNode->pFirstDeclarationNode);
+	CodeGenAstList(pNode->pFirstStatementNode);
+	return 0;
+}
+
+int CodeGenPrintNode(AstNode *pAst)
+{
+	PrintNode *pNode = (PrintNode *)pAst->pBody;
+	int nTop = ByteCode_GetTop(), n;
+
+	ByteCode_SetLine(pAst->location.line);
+	n = CodeGenAstNode(pNode->pExpressionNode);
+	switch(((ExpressionNode *)pNode->pExpressionNode->pBody)->nResultType){
+	case kReal:		ByteCode_Emit(kBcPrintReal, n, 0, 0);	break;
+	case kBoolean:	ByteCode_Emit(kBcPrintBool, n, 0, 0);	break;
+	case kString:	ByteCode_Emit(kBcPrintStr, n, 0, 0);	break;
+	default:		ByteCode_Emit(kBcPrintInt, n, 0, 0);	break;
+	}
+	ByteCode_SetTop(nTop);
+	return 0;
+}
+
+// Emit the address of the array of an element reference and its index in the array's cells,
+// each index checked against its dimension. Return the register of the address, *pnIndex gets the one of the index.
+static int codegen_element(VariableRefNode *pNode, int *pnIndex)
+{
+	AstNode *p, *q;
+	int nAddr, nIndex, nDim, n, k;
+
+	nAddr = ByteCode_ArrayAddress(pNode->pTypeNode, pNode->nLevel, pNode->nSlot);
+	nIndex = ByteCode_NewTemp();
+	q = ((TypeNode *)pNode->pTypeNode->pBody)->pFirstIntNode;
+	for(p = pNode->pFirstArrRefNode; p; p = p->pNext, q = q->pNext){
+		nDim = ((IntValueNode *)q->pBody)->nValue;
+		n = CodeGenAstNode(p);
+		if (p == pNode->pFirstArrRefNode){
+			ByteCode_MoveTo(nIndex, n);
+			ByteCode_EmitImm(kBcCheckIndex, nIndex, nDim);
+		}
+		else{
+			ByteCode_EmitImm(kBcCheckIndex, n, nDim);
+			k = ByteCode_NewTemp();
+			ByteCode_EmitImm(kBcLoadInt, k, nDim);
+			ByteCode_Emit(kBcMulInt, nIndex, nIndex, k);
+			ByteCode_Emit(kBcAddInt, nIndex, nIndex, n);
+		}
+		ByteCode_SetTop(nIndex + 1);
+	}
+	*pnIndex = nIndex;
+	return nAddr;
+}
+
+// Read a variable, a local scalar is its own register, anything else is loaded into a new temporary.
+int CodeGenVariableRefNode(AstNode *pAst)
+{
+	VariableRefNode *pNode = (VariableRefNode *)pAst->pBody;
+	int nTop = ByteCode_GetTop(), nAddr, nIndex, n;
+
+	if (!pNode->pFirstArrRefNode){
+		if (pNode->nLevel > 0)
+			return pNode->nSlot;
+		n = ByteCode_NewTemp();
+		ByteCode_EmitImm(kBcGetGlobal, n, pNode->nSlot);
+		return n;
+	}
+	nAddr = codegen_element(pNode, &nIndex);
+	ByteCode_SetTop(nTop);
+	n = ByteCode_NewTemp();
+	ByteCode_Emit(kBcLoadElem, n, nAddr, nIndex);
+	return n;
+}
+
+int CodeGenAssignNode(AstNode *pAst)
+{
+	AssignNode *pNode = (AssignNode *)pAst->pBody;
+	VariableRefNode *pRef = (VariableRefNode *)pNode->pVariableRefNode->pBody;
+	bool bToReal = (pRef->nVarType == kReal && ((ExpressionNode *)pNode->pExpressionNode->pBody)->nResultType == kInteger);
+	int nTop = ByteCode_GetTop(), nAddr, nIndex, n;
+
+	ByteCode_SetLine(pAst->location.line);
+	nAddr = pRef->pFirstArrRefNode ? codegen_element(pRef, &nIndex) : -1;
+	n = CodeGenAstNode(pNode->pExpressionNode);
+	if (bToReal)
+		n = ByteCode_IntToReal(n);
+	if (nAddr >= 0)
+		ByteCode_Emit(kBcStoreElem, nAddr, nIndex, n);
+	else if (pRef->nLevel > 0)
+		ByteCode_MoveTo(pRef->nSlot, n);
+	else
+		ByteCode_EmitImm(kBcSetGlobal, n, pRef->nSlot);
+	ByteCode_SetTop(nTop);
+	return 0;
+}
+
+int CodeGenReadNode(AstNode *pAst)
+{
+	ReadNode *pNode = (ReadNode *)pAst->pBody;
+	VariableRefNode *pRef = (VariableRefNode *)pNode->pVariableRefNode->pBody;
+	int nTop = ByteCode_GetTop(), nAddr, nIndex, n;
+	BcOp_t nOp;
+
+	switch(pRef->nVarType){
+	case kReal:		nOp = kBcReadReal;	break;
+	case kBoolean:	nOp = kBcReadBool;	break;
+	case kString:	nOp = kBcReadStr;	break;
+	default:		nOp = kBcReadInt;	break;
+	}
+	ByteCode_SetLine(pAst->location.line);
+	if (pRef->pFirstArrRefNode){
+		nAddr = codegen_element(pRef, &nIndex);
+		n = ByteCode_NewTemp();
+		ByteCode_Emit(nOp, n, 0, 0);
+		ByteCode_Emit(kBcStoreElem, nAddr, nIndex, n);
+	}
+	else if (pRef->nLevel > 0)
+		ByteCode_Emit(nOp, pRef->nSlot, 0, 0);
+	else{
+		n = ByteCode_NewTemp();
+		ByteCode_Emit(nOp, n, 0, 0);
+		ByteCode_EmitImm(kBcSetGlobal, n, pRef->nSlot);
+	}
+	ByteCode_SetTop(nTop);
+	return 0;
+}
+
+// ----------------------------------------------------------------
+// Eval CompoundStatement related Node.
+// ----------------------------------------------------------------
+EvalValue EvalCompoundStatementNode(AstNode *pAst)
+{
+	CompoundStatementNode *pNode = (CompoundStatementNode *)pAst->pBody;
+
+	EvalAstList(pNode->pFirstDeclarationNode);
+	EvalAstList(pNode->pFirstStatementNode);
+	return EvalValue();
+}
+
+EvalValue EvalPrintNode(AstNode *pAst)
+{
+	PrintNode *pNode = (PrintNode *)pAst->pBody;
+
+	Eval_Print(((ExpressionNode *)pNode->pExpressionNode->pBody)->nResultType, EvalAstNode(pNode->pExpressionNode));
+	return EvalValue();
+}
+
+// Get the variable of a reference, or its array element with every index checked against its dimension.
+static EvalValue *eval_variable(AstNode *pAst)
+{
+	VariableRefNode *pNode = (VariableRefNode *)pAst->pBody;
+	AstNode *p, *q;
+	int nIndex = 0, n, nDim;
+
+	if (!pNode->pFirstArrRefNode)
+		return Eval_Variable(pNode->nLevel, pNode->nSlot);
+	q = ((TypeNode *)pNode->pTypeNode->pBody)->pFirstIntNode;
+	for(p = pNode->pFirstArrRefNode; p; p = p->pNext, q = q->pNext){
+		nDim = ((IntValueNode *)q->pBody)->nValue;
+		n = EvalAstNode(p).n;
+		if (n < 0 || n >= nDim)
+			Eval_Error(p, "array index %d out of range [0, %d)", n, nDim);
+		nIndex = nIndex * nDim + n;
+	}
+	return Eval_Variable(pNode->nLevel, pNode->nSlot)->p + nIndex;
+}
+
+EvalValue EvalVariableRefNode(AstNode *pAst)
+{
+	return *eval_variable(pAst);
+}
+
+EvalValue EvalAssignNode(AstNode *pAst)
+{
+	AssignNode *pNode = (AssignNode *)pAst->pBody;
+	VariableRefNode *pRef = (VariableRefNode *)pNode->pVariableRefNode->pBody;
+	EvalValue oValue = EvalAstNode(pNode->pExpressionNode);
+
+	if (pRef->nVarType == kReal && ((ExpressionNode *)pNode->pExpressionNode->pBody)->nResultType == kInteger)
+		oValue.d = oValue.n;
+	*eval_variable(pNode->pVariableRefNode) = oValue;
+	return EvalValue();
+}
+
+EvalValue EvalReadNode(AstNode *pAst)
+{
+	ReadNode *pNode = (ReadNode *)pAst->pBody;
+	VariableRefNode *pRef = (VariableRefNode *)pNode->pVariableRefNode->pBody;
+	EvalValue *pVar = eval_variable(pNode->pVariableRefNode);
+
+	*pVar = Eval_Read(pAst, pRef->nVarType);
+	return EvalValue();
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
 AstNode *NewCompoundStatementNode(int nLine, int nCol, AstNode *pFirstDeclarationNode, AstNode *pFirstStatementNode)
 {
 	// Filling in body contents.
-	CompoundStatementNode *pBody = new CompoundStatementNode;
+	CompoundStatementNode *pBody = Arena_New<CompoundStatementNode>();
 	pBody->pFirstDeclarationNode = pFirstDeclarationNode;
 	pBody->pFirstStatementNode = pFirstStatementNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintCompoundStatementNode, VisitCompoundStatementNode, NULL);
+	return NewAstNode(nLine, nCol, kAstCompoundStatement, pBody, PrintCompoundStatementNode, VisitCompoundStatementNode, CodeGenCompoundStatementNode, EvalCompoundStatementNode);
 }
 
 AstNode *NewPrintNode(int nLine, int nCol, AstNode *pExpressionNode)
 {
 	// Filling in body contents.
-	PrintNode *pBody = new PrintNode;
+	PrintNode *pBody = Arena_New<PrintNode>();
 	pBody->pExpressionNode = pExpressionNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintPrintNode, VisitPrintNode, NULL);
+	return NewAstNode(nLine, nCol, kAstPrint, pBody, PrintPrintNode, VisitPrintNode, CodeGenPrintNode, EvalPrintNode);
 }
 
 AstNode *NewVariableRefNode(int nLine, int nCol, const char *pszVarName, AstNode *pFirstArrRefNode)
 {
 	// Filling in body contents.
-	VariableRefNode *pBody = new VariableRefNode;
-	pBody->pszVarName = pszVarName;
+	VariableRefNode *pBody = Arena_New<VariableRefNode>();
+	pBody->pszVarName = StrPool_Intern(pszVarName);
 	pBody->pFirstArrRefNode = pFirstArrRefNode;
 	pBody->nVarType = kUnknown;
+	pBody->pTypeNode = NULL;
+	pBody->nLevel = -1;
+	pBody->nSlot = -1;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintVariableRefNode, VisitVariableRefNode, NULL);
+	return NewAstNode(nLine, nCol, kAstVariableRef, pBody, PrintVariableRefNode, VisitVariableRefNode, CodeGenVariableRefNode, EvalVariableRefNode);
 }
 
 AstNode *NewAssignNode(int nLine, int nCol, AstNode *pVariableRefNode, AstNode *pExpressionNode)
 {
 	// Filling in body contents.
-	AssignNode *pBody = new AssignNode;
+	AssignNode *pBody = Arena_New<AssignNode>();
 	pBody->pVariableRefNode = pVariableRefNode;
 	pBody->pExpressionNode = pExpressionNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintAssignNode, VisitAssignNode, NULL);
+	return NewAstNode(nLine, nCol, kAstAssign, pBody, PrintAssignNode, VisitAssignNode, CodeGenAssignNode, EvalAssignNode);
 }
 
 AstNode *NewReadNode(int nLine, int nCol, AstNode *pVariableRefNode)
 {
 	// Filling in body contents.
-	ReadNode *pBody = new ReadNode;
+	ReadNode *pBody = Arena_New<ReadNode>();
 	pBody->pVariableRefNode = pVariableRefNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintReadNode, VisitReadNode, NULL);
+	return NewAstNode(nLine, nCol, kAstRead, pBody, PrintReadNode, VisitReadNode, CodeGenReadNode, EvalReadNode);
 }
\ No newline at end of file
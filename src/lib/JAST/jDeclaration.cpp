@@ -4,7 +4,7 @@
 
 #include "JAST/jast_internal.h"
 
-extern AstNode *NewScalerTypeNode(int nLine, int nCol, const char *pszType);
+extern AstNode *NewScalerTypeNode(int nLine, int nCol, SymbolValue_t nType);
 
 // ----------------------------------------------------------------
 // Print Declaration related Node.
@@ -15,12 +15,10 @@ int PrintDeclarationNode(AstNode *pAst, int nLevel)
 	DeclarationNode *pNode = (DeclarationNode *)pAst->pBody;
 	TypeNode *pType = (TypeNode *)pNode->pTypeNode->pBody;
 
-	PrintLeadingTabs(nLevel);
-	printf("declaration <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "declaration", pAst->location.line, pAst->location.col);
 	p = pNode->pFirstIdNode;
 	while(p){
-		PrintLeadingTabs(nLevel + 1);
-		printf("variable <line: %d, col: %d> %s %s\n", p->location.line, p->location.col, ((IdNode *)p->pBody)->pszName, pType->pszTypeStr);
+		PrintNodeLine(nLevel + 1, "variable", p->location.line, p->location.col, ((IdNode *)p->pBody)->pszName, pType->pszTypeStr);
 		if (pNode->pLiteralNode)
 			PrintAstNode(pNode->pLiteralNode, nLevel + 2);
 		p = p->pNext;
@@ -45,15 +43,17 @@ int VisitDeclarationNode(AstNode *pAst)
 		pszName = ((IdNode *)p->pBody)->pszName;
 		n = SymTab_Lookup(pszName);
 		if (n >= 0 && SymTab_GetLevel(n) == SymTab_GetCurrStackLevel()){
-			ErrorMessage(p, "symbol '%s' is redeclared\n", pszName);
+			ErrorMessage(p, kDiagRedeclared, pszName);
 			nErr++;
 		}
 		else if (n >= 0 && SymTab_GetKindValue(n) == kLoopVar){
-			ErrorMessage(p, "symbol '%s' is redeclared\n", pszName);
+			ErrorMessage(p, kDiagRedeclared, pszName);
 			nErr++;
 		}
 		else{
-			SymTab_Insert(pszName, pNode->pszKind, pType->pszScalerType, pType->pszTypeStr, pLiteral ? pLiteral->pszStr : "", pNode->pTypeNode);
+			n = SymTab_Insert(pszName, pNode->nKind, pType->nScalerType, pType->pszTypeStr, pLiteral ? pLiteral->pszStr : "", pNode->pTypeNode);
+			((IdNode *)p->pBody)->nLevel = SymTab_GetLevel(n);
+			((IdNode *)p->pBody)->nSlot = SymTab_GetSlot(n);
 		}
 		p = p->pNext;
 	}
@@ -63,7 +63,7 @@ int VisitDeclarationNode(AstNode *pAst)
 	p = pNode->pFirstIdNode;
 	while(q){
 		if(((IntValueNode *)q->pBody)->nValue <= 0){
-			ErrorMessage(p, "%s declared as an array with an index that is not greater than 0\n", ((IdNode *)p->pBody)->pszName);
+			ErrorMessage(p, kDiagArrayIndexNotPositive, ((IdNode *)p->pBody)->pszName);
 			nErr++;
 			break;
 		}
@@ -73,31 +73,91 @@ int VisitDeclarationNode(AstNode *pAst)
 	return nErr;
 }
 
+// ----------------------------------------------------------------
+// CodeGen Declaration Node.
+// ----------------------------------------------------------------
+// Constants get their value, local variables are zeroed each time the declaration is reached,
+// globals are zero when the program starts, parameters come with the call and loop variables with the loop.
+int CodeGenDeclarationNode(AstNode *pAst)
+{
+	DeclarationNode *pNode = (DeclarationNode *)pAst->pBody;
+	TypeNode *pType = (TypeNode *)pNode->pTypeNode->pBody;
+	IdNode *pId;
+	AstNode *p;
+	int nTop = ByteCode_GetTop(), n;
+
+	if (pNode->nKind != kConstant && pNode->nKind != kVariable)
+		return 0;
+	ByteCode_SetLine(pAst->location.line);
+	for(p = pNode->pFirstIdNode; p; p = p->pNext){
+		pId = (IdNode *)p->pBody;
+		if (pNode->nKind == kConstant){
+			n = CodeGenAstNode(pNode->pLiteralNode);
+			if (pId->nLevel > 0)
+				ByteCode_MoveTo(pId->nSlot, n);
+			else
+				ByteCode_EmitImm(kBcSetGlobal, n, pId->nSlot);
+		}
+		else if (pId->nLevel > 0 && pType->pFirstIntNode){
+			n = ByteCode_ArrayAddress(pNode->pTypeNode, pId->nLevel, pId->nSlot);
+			ByteCode_EmitImm(kBcClearArray, n, ByteCode_ArrayCells(pType));
+		}
+		else if (pId->nLevel > 0)
+			ByteCode_EmitImm(kBcLoadInt, pId->nSlot, 0);
+		ByteCode_SetTop(nTop);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------
+// Eval Declaration Node, like CodeGenDeclarationNode() a variable starts at zero every time it is declared.
+// ----------------------------------------------------------------
+EvalValue EvalDeclarationNode(AstNode *pAst)
+{
+	DeclarationNode *pNode = (DeclarationNode *)pAst->pBody;
+	EvalValue *pVar;
+	IdNode *pId;
+
+	if (pNode->nKind != kConstant && pNode->nKind != kVariable)
+		return EvalValue();
+	for(AstNode *p = pNode->pFirstIdNode; p; p = p->pNext){
+		pId = (IdNode *)p->pBody;
+		pVar = Eval_Variable(pId->nLevel, pId->nSlot);
+		if (pNode->nKind == kConstant)
+			*pVar = EvalAstNode(pNode->pLiteralNode);
+		else if (((TypeNode *)pNode->pTypeNode->pBody)->pFirstIntNode)
+			pVar->p = Eval_NewArray(pNode->pTypeNode, pId->nSlot);
+		else
+			memset(pVar, 0, sizeof(*pVar));
+	}
+	return EvalValue();
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
-AstNode *NewDeclarationNode_Type(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pTypeNode, const char *pszKind)
+AstNode *NewDeclarationNode_Type(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pTypeNode, SymbolValue_t nKind)
 {
 	// Filling in body contents.
-	DeclarationNode *pBody = new DeclarationNode;
-	pBody->pszKind = pszKind;
-	pBody->nKind = GetSymbolValue(pszKind);
+	DeclarationNode *pBody = Arena_New<DeclarationNode>();
+	pBody->pszKind = GetSymbolString(nKind);
+	pBody->nKind = nKind;
 	pBody->pFirstIdNode = pFirstIdNode;
 	pBody->pTypeNode = pTypeNode;
 	pBody->pLiteralNode = NULL;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintDeclarationNode, VisitDeclarationNode, NULL);
+	return NewAstNode(nLine, nCol, kAstDeclaration, pBody, PrintDeclarationNode, VisitDeclarationNode, CodeGenDeclarationNode, EvalDeclarationNode);
 }
 
 AstNode *NewDeclarationNode_LiteralConstant(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pLiteralNode)
 {
 	// Filling in body contents.
-	DeclarationNode *pBody = new DeclarationNode;
+	DeclarationNode *pBody = Arena_New<DeclarationNode>();
 	pBody->pszKind = "constant";
 	pBody->nKind = kConstant;
 	pBody->pFirstIdNode = pFirstIdNode;
-	pBody->pTypeNode = NewScalerTypeNode(nLine, nCol, ((LiteralNode *)pLiteralNode->pBody)->pszType);
+	pBody->pTypeNode = NewScalerTypeNode(nLine, nCol, ((LiteralNode *)pLiteralNode->pBody)->nType);
 	pBody->pLiteralNode = pLiteralNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintDeclarationNode, VisitDeclarationNode, NULL);
+	return NewAstNode(nLine, nCol, kAstDeclaration, pBody, PrintDeclarationNode, VisitDeclarationNode, CodeGenDeclarationNode, EvalDeclarationNode);
 }
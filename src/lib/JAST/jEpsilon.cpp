@@ -13,16 +13,15 @@ struct EpsilonNode {
 int PrintEpsilonNode(AstNode *pAst, int nLevel)
 {
 	EpsilonNode *pNode = (EpsilonNode *)pAst->pBody;
-	PrintLeadingTabs(nLevel);
-	printf("%s <line: %d, col: %d> %s\n", pNode->pszPrefix, pAst->location.line, pAst->location.col, pNode->pszPostfix);
+	PrintNodeLine(nLevel, pNode->pszPrefix, pAst->location.line, pAst->location.col, pNode->pszPostfix);
 	return 0;
 }
 
 AstNode *NewEpsilonNode(int nLine, int nCol, const char *pszPrefix, const char *pszPostfix)
 {
-	EpsilonNode *p = new EpsilonNode;
+	EpsilonNode *p = Arena_New<EpsilonNode>();
 
-	p->pszPrefix = strdup(pszPrefix);
-	p->pszPostfix = strdup(pszPostfix);
-	return NewAstNode(nLine, nCol, p, PrintEpsilonNode, NULL, NULL);
+	p->pszPrefix = StrPool_Intern(pszPrefix);
+	p->pszPostfix = StrPool_Intern(pszPostfix);
+	return NewAstNode(nLine, nCol, kAstEpsilon, p, PrintEpsilonNode, NULL, NULL, NULL);
 }
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "JAST/jast_internal.h"
 
@@ -10,102 +11,133 @@
 int PrintExpressionNode(AstNode *pAst, int nLevel)
 {
 	ExpressionNode *pNode = (ExpressionNode *)pAst->pBody;
-	const char *kTerminalOps[] = {"constant", "VariableReference", "FunctionInvocation", NULL};
-	int n;
 	
-	if (!pNode->pLeftNode){
-		PrintLeadingTabs(nLevel);
-		printf("unary operator <line: %d, col: %d> %s\n", pAst->location.line, pAst->location.col, pNode->pszOp);
+	switch(pNode->nKind){
+	case kExprUnary:
+		PrintNodeLine(nLevel, "unary operator", pAst->location.line, pAst->location.col, pNode->pszOp);
 		PrintAstNode(pNode->pRightNode, nLevel + 1);
-	}
-	else if (!pNode->pRightNode){
-		n = SearchStringItem(pNode->pszOp, kTerminalOps);
-		if (kTerminalOps[n])
-			PrintAstNode(pNode->pLeftNode, nLevel);
-	}
-	else{
-		PrintLeadingTabs(nLevel);
-		printf("binary operator <line: %d, col: %d> %s\n", pAst->location.line, pAst->location.col, pNode->pszOp);
+		break;
+	case kExprBinary:
+		PrintNodeLine(nLevel, "binary operator", pAst->location.line, pAst->location.col, pNode->pszOp);
 		PrintAstNode(pNode->pLeftNode, nLevel + 1);
 		PrintAstNode(pNode->pRightNode, nLevel + 1);
+		break;
+	default:
+		PrintAstNode(pNode->pLeftNode, nLevel);
+		break;
 	}
 	return 0;
 }
 
+// ----------------------------------------------------------------
+//  Type rules of operators: result type indexed by operator x left type x right type.
+// ----------------------------------------------------------------
+#define N_RULE_OPS		(kSTRCAT - kADD + 1)
+#define N_RULE_TYPES	(kString - kInteger + 2)	// no/invalid operand, integer, real, boolean, string.
+
+struct OpRule {
+	SymbolValue_t nResult;			// kUnknown if the operands are invalid for the operator.
+	SymbolValue_t nOp;				// operator after the rule, e.g. kADD on two strings turns into kSTRCAT.
+};
+
+// Row or column of an operand type in the rule table, 0 for no operand (unary) or a non-scalar type.
+static constexpr int rule_type_index(SymbolValue_t n)
+{
+	return (n >= kInteger && n <= kString) ? n - kInteger + 1 : 0;
+}
+
+static constexpr bool is_int_real(SymbolValue_t n)
+{
+	return n == kInteger || n == kReal;
+}
+
+// The type rules of all operators, only evaluated at compile time to fill the rule table.
+static constexpr OpRule op_rule(SymbolValue_t nOp, SymbolValue_t nLeft, SymbolValue_t nRight)
+{
+	switch(nOp){
+	case kADD:
+		if (nLeft == kString && nRight == kString)
+			return {kString, kSTRCAT};
+		// fall through: numeric addition.
+	case kMINUS:
+	case kMULTIPLY:
+	case kDIVIDE:
+		if (is_int_real(nLeft) && is_int_real(nRight))
+			return {(nLeft == kReal || nRight == kReal) ? kReal : kInteger, nOp};
+		break;
+	case kMOD:
+		if (nLeft == kInteger && nRight == kInteger)
+			return {kInteger, nOp};
+		break;
+	case kLT: case kLE: case kEQ: case kGE: case kGT: case kNE:
+		if (is_int_real(nLeft) && is_int_real(nRight))
+			return {kBoolean, nOp};
+		break;
+	case kAND:
+	case kOR:
+		if (nLeft == kBoolean && nRight == kBoolean)
+			return {kBoolean, nOp};
+		break;
+	case kNEG:
+		if (nLeft == kUnknown && is_int_real(nRight))
+			return {nRight, nOp};
+		break;
+	case kNOT:
+		if (nLeft == kUnknown && nRight == kBoolean)
+			return {kBoolean, nOp};
+		break;
+	default:
+		break;
+	}
+	return {kUnknown, nOp};
+}
+
+struct OpRuleTable {
+	OpRule pRules[N_RULE_OPS][N_RULE_TYPES][N_RULE_TYPES];
+
+	constexpr OpRuleTable() : pRules()
+	{
+		for(int i = 0; i < N_RULE_OPS; i++)
+			for(int j = 0; j < N_RULE_TYPES; j++)
+				for(int k = 0; k < N_RULE_TYPES; k++)
+					pRules[i][j][k] = op_rule((SymbolValue_t)(kADD + i), j ? (SymbolValue_t)(kInteger + j - 1) : kUnknown, k ? (SymbolValue_t)(kInteger + k - 1) : kUnknown);
+	}
+};
+
+static constexpr OpRuleTable k_oOpRules;
+
+// Get the type string of an operand for error messages, arrays have no symbol string of their type.
+static const char *operand_type_string(AstNode *pAst)
+{
+	SymbolValue_t nType = ((ExpressionNode *)pAst->pBody)->nResultType;
+	return (nType != kUnknown) ? GetSymbolString(nType) : GetArrayTypeString(pAst);
+}
+
 // ----------------------------------------------------------------
 //  Determine Expression Node type after calculation.
 // ----------------------------------------------------------------
 int determine_op_type(AstNode *pAst)
 {
 	ExpressionNode *pNode = (ExpressionNode *)pAst->pBody;
-	ExpressionNode *pLeft = pNode->pLeftNode ? (ExpressionNode *)pNode->pLeftNode->pBody: NULL;
-	ExpressionNode *pRight = pNode->pRightNode ? (ExpressionNode *)pNode->pRightNode->pBody : NULL;
-
-	const SymbolValue_t kIntReal[] = {kInteger, kReal, kUnknown};
-	const SymbolValue_t kArithmetics[] = {kADD, kMINUS, kMULTIPLY, kDIVIDE, kUnknown};
-	const SymbolValue_t kRelations[] = {kLT, kLE, kEQ, kGE, kGT, kNE, kUnknown};
-	const SymbolValue_t kBooleans[] = {kAND, kOR, kUnknown};
-	const char *pszLeftOpType, *pszRightOpType;
+	SymbolValue_t nLeftType = pNode->pLeftNode ? ((ExpressionNode *)pNode->pLeftNode->pBody)->nResultType : kUnknown;
+	SymbolValue_t nRightType = pNode->pRightNode ? ((ExpressionNode *)pNode->pRightNode->pBody)->nResultType : kUnknown;
+	const OpRule *pRule;
 
+	if (pNode->nOp < kADD || pNode->nOp > kSTRCAT)
+		return 1;
 
-	if (pNode->nOp == kADD && pLeft->nResultType == kString && pRight->nResultType == kString){
-		pNode->nOp = kSTRCAT;
-		pNode->nResultType = kString;
-	}
-	else if (pNode->nOp == kNEG){
-		if (InSymbolValueSet(pRight->nResultType, kIntReal))
-			pNode->nResultType = pRight->nResultType;
-		else{
-			pszRightOpType = GetSymbolString(pRight->nResultType) ? GetSymbolString(pRight->nResultType) : GetArrayTypeString(pNode->pRightNode);
-			ErrorMessage(pAst, "invalid operand to unary operator '%s' ('%s')\n", GetSymbolString(pNode->nOp), pszRightOpType);
-		}
-	}
-	else if (pNode->nOp == kNOT){
-		if (pRight->nResultType == kBoolean)
-			pNode->nResultType = kBoolean;
-		else{
-			pszRightOpType = GetSymbolString(pRight->nResultType) ? GetSymbolString(pRight->nResultType) : GetArrayTypeString(pNode->pRightNode);
-			ErrorMessage(pAst, "invalid operand to unary operator '%s' ('%s')\n", GetSymbolString(pNode->nOp), pszRightOpType);
-		}
-	}
-	else if (pNode->nOp == kMOD){
-		if (pLeft->nResultType == kInteger && pRight->nResultType == kInteger)
-			pNode->nResultType = kInteger;
-		else{
-			pszLeftOpType = GetSymbolString(pLeft->nResultType) ? GetSymbolString(pLeft->nResultType) : GetArrayTypeString(pNode->pLeftNode);
-			pszRightOpType = GetSymbolString(pRight->nResultType) ? GetSymbolString(pRight->nResultType) : GetArrayTypeString(pNode->pRightNode);
-			ErrorMessage(pAst, "invalid operands to binary operator '%s' ('%s' and '%s')\n", GetSymbolString(pNode->nOp), pszLeftOpType, pszRightOpType);
-		}
-	}
-	else if (InSymbolValueSet(pNode->nOp, kArithmetics)){
-		if (InSymbolValueSet(pLeft->nResultType, kIntReal) && InSymbolValueSet(pRight->nResultType, kIntReal))
-			pNode->nResultType = (pLeft->nResultType == kReal || pRight->nResultType == kReal) ? kReal : kInteger;
-		else{
-			pszLeftOpType = GetSymbolString(pLeft->nResultType) ? GetSymbolString(pLeft->nResultType) : GetArrayTypeString(pNode->pLeftNode);
-			pszRightOpType = GetSymbolString(pRight->nResultType) ? GetSymbolString(pRight->nResultType) : GetArrayTypeString(pNode->pRightNode);
-			ErrorMessage(pAst, "invalid operands to binary operator '%s' ('%s' and '%s')\n", GetSymbolString(pNode->nOp), pszLeftOpType, pszRightOpType);
-		}
-	}
-	else if (InSymbolValueSet(pNode->nOp, kRelations)){
-		if (InSymbolValueSet(pLeft->nResultType, kIntReal) && InSymbolValueSet(pRight->nResultType, kIntReal))
-			pNode->nResultType = kBoolean;
-		else{
-			pszLeftOpType = GetSymbolString(pLeft->nResultType) ? GetSymbolString(pLeft->nResultType) : GetArrayTypeString(pNode->pLeftNode);
-			pszRightOpType = GetSymbolString(pRight->nResultType) ? GetSymbolString(pRight->nResultType) : GetArrayTypeString(pNode->pRightNode);
-			ErrorMessage(pAst, "invalid operands to binary operator '%s' ('%s' and '%s')\n", GetSymbolString(pNode->nOp), pszLeftOpType, pszRightOpType);
-		}
-	}
-	else if (InSymbolValueSet(pNode->nOp, kBooleans)){
-		if (pLeft->nResultType == kBoolean && pRight->nResultType == kBoolean)
-			pNode->nResultType = kBoolean;
-		else{
-			pszLeftOpType = GetSymbolString(pLeft->nResultType) ? GetSymbolString(pLeft->nResultType) : GetArrayTypeString(pNode->pLeftNode);
-			pszRightOpType = GetSymbolString(pRight->nResultType) ? GetSymbolString(pRight->nResultType) : GetArrayTypeString(pNode->pRightNode);
-			ErrorMessage(pAst, "invalid operands to binary operator '%s' ('%s' and '%s')\n", GetSymbolString(pNode->nOp), pszLeftOpType, pszRightOpType);
-		}
+	pRule = &k_oOpRules.pRules[pNode->nOp - kADD][rule_type_index(nLeftType)][rule_type_index(nRightType)];
+	if (pRule->nResult != kUnknown){
+		pNode->nOp = pRule->nOp;
+		pNode->nResultType = pRule->nResult;
+		return 0;
 	}
 
-	return (pNode->nResultType != kUnknown) ? 0 : 1;
+	if (pNode->nKind == kExprUnary)
+		ErrorMessage(pAst, kDiagUnaryOperand, GetSymbolString(pNode->nOp), operand_type_string(pNode->pRightNode));
+	else
+		ErrorMessage(pAst, kDiagBinaryOperands, GetSymbolString(pNode->nOp), operand_type_string(pNode->pLeftNode), operand_type_string(pNode->pRightNode));
+	return 1;
 }
 
 int VisitExpressionNode(AstNode *pAst)
@@ -117,33 +149,203 @@ int VisitExpressionNode(AstNode *pAst)
 	nErr += VisitAstNode(pNode->pRightNode);
 
 	if (nErr == 0){
-		if (strcmp(pNode->pszOp, "constant") == 0)
+		switch(pNode->nKind){
+		case kExprConstant:
 			pNode->nResultType = ((LiteralNode *)pNode->pLeftNode->pBody)->nType;
-		else if (strcmp(pNode->pszOp, "VariableReference") == 0)
+			break;
+		case kExprVariableRef:
 			pNode->nResultType = ((VariableRefNode *)pNode->pLeftNode->pBody)->nVarType;
-		else if (strcmp(pNode->pszOp, "FunctionInvocation") == 0)
+			break;
+		case kExprFunctionInvocation:
 			pNode->nResultType = ((FunctionInvocationNode *)pNode->pLeftNode->pBody)->nReturnType;
-		else
+			break;
+		default:
 			nErr = determine_op_type(pAst);
+			break;
+		}
 	}
 
 	return nErr;
 }
 
+// ----------------------------------------------------------------
+//  CodeGen Expression Node, returns the register of the value.
+// ----------------------------------------------------------------
+// Instruction of a binary operator, on reals if either operand is real.
+static BcOp_t binary_op(SymbolValue_t nOp, bool bReal)
+{
+	switch(nOp){
+	case kADD:		return bReal ? kBcAddReal : kBcAddInt;
+	case kMINUS:	return bReal ? kBcSubReal : kBcSubInt;
+	case kMULTIPLY:	return bReal ? kBcMulReal : kBcMulInt;
+	case kDIVIDE:	return bReal ? kBcDivReal : kBcDivInt;
+	case kMOD:		return kBcModInt;
+	case kAND:		return kBcAnd;
+	case kOR:		return kBcOr;
+	case kSTRCAT:	return kBcConcat;
+	default:		// kLT .. kNE in the order of the compare instructions.
+		return (BcOp_t)((bReal ? kBcLtReal : kBcLtInt) + (nOp - kLT));
+	}
+}
+
+int CodeGenExpressionNode(AstNode *pAst)
+{
+	ExpressionNode *pNode = (ExpressionNode *)pAst->pBody;
+	SymbolValue_t nLeftType, nRightType;
+	int nTop, nLeft, nRight, n;
+	bool bReal;
+
+	if (pNode->nKind != kExprUnary && pNode->nKind != kExprBinary)
+		return CodeGenAstNode(pNode->pLeftNode);
+
+	// The operands are evaluated into temporaries from nTop on, the result takes the first of them.
+	nTop = ByteCode_GetTop();
+	nRightType = ((ExpressionNode *)pNode->pRightNode->pBody)->nResultType;
+	if (pNode->nKind == kExprUnary){
+		nRight = CodeGenAstNode(pNode->pRightNode);
+		ByteCode_SetTop(nTop);
+		n = ByteCode_NewTemp();
+		ByteCode_Emit(pNode->nOp == kNOT ? kBcNot : (nRightType == kReal ? kBcNegReal : kBcNegInt), n, nRight, 0);
+		return n;
+	}
+
+	nLeftType = ((ExpressionNode *)pNode->pLeftNode->pBody)->nResultType;
+	bReal = (nLeftType == kReal || nRightType == kReal);
+	nLeft = CodeGenAstNode(pNode->pLeftNode);
+	if (bReal && nLeftType == kInteger)
+		nLeft = ByteCode_IntToReal(nLeft);
+	nRight = CodeGenAstNode(pNode->pRightNode);
+	if (bReal && nRightType == kInteger)
+		nRight = ByteCode_IntToReal(nRight);
+	ByteCode_SetTop(nTop);
+	n = ByteCode_NewTemp();
+	ByteCode_Emit(binary_op(pNode->nOp, bReal), n, nLeft, nRight);
+	return n;
+}
+
+// ----------------------------------------------------------------
+//  Eval Expression Node.
+// ----------------------------------------------------------------
+// Integer arithmetic wraps around at 32 bits like the bytecode, without undefined behaviour.
+#define WRAP(a, op, b)		((int)((uint32_t)(a) op (uint32_t)(b)))
+
+static EvalValue eval_int(AstNode *pAst, SymbolValue_t nOp, int nLeft, int nRight)
+{
+	EvalValue oValue;
+
+	switch(nOp){
+	case kADD:		oValue.n = WRAP(nLeft, +, nRight);	break;
+	case kMINUS:	oValue.n = WRAP(nLeft, -, nRight);	break;
+	case kMULTIPLY:	oValue.n = WRAP(nLeft, *, nRight);	break;
+	case kDIVIDE:
+	case kMOD:
+		if (nRight == 0)
+			Eval_Error(pAst, "division by zero");
+		if (nRight == -1)
+			oValue.n = (nOp == kDIVIDE) ? WRAP(0, -, nLeft) : 0;
+		else
+			oValue.n = (nOp == kDIVIDE) ? nLeft / nRight : nLeft % nRight;
+		break;
+	case kLT:		oValue.n = nLeft < nRight;		break;
+	case kLE:		oValue.n = nLeft <= nRight;		break;
+	case kEQ:		oValue.n = nLeft == nRight;		break;
+	case kGE:		oValue.n = nLeft >= nRight;		break;
+	case kGT:		oValue.n = nLeft > nRight;		break;
+	case kNE:		oValue.n = nLeft != nRight;		break;
+	case kAND:		oValue.n = nLeft & nRight;		break;
+	default:		oValue.n = nLeft | nRight;		break;	// kOR
+	}
+	return oValue;
+}
+
+static EvalValue eval_real(SymbolValue_t nOp, double dLeft, double dRight)
+{
+	EvalValue oValue;
+
+	switch(nOp){
+	case kADD:		oValue.d = dLeft + dRight;		break;
+	case kMINUS:	oValue.d = dLeft - dRight;		break;
+	case kMULTIPLY:	oValue.d = dLeft * dRight;		break;
+	case kDIVIDE:	oValue.d = dLeft / dRight;		break;
+	case kLT:		oValue.n = dLeft < dRight;		break;
+	case kLE:		oValue.n = dLeft <= dRight;		break;
+	case kEQ:		oValue.n = dLeft == dRight;		break;
+	case kGE:		oValue.n = dLeft >= dRight;		break;
+	case kGT:		oValue.n = dLeft > dRight;		break;
+	default:		oValue.n = dLeft != dRight;		break;	// kNE
+	}
+	return oValue;
+}
+
+// Both operands are evaluated, left first, as in the bytecode.
+EvalValue EvalExpressionNode(AstNode *pAst)
+{
+	ExpressionNode *pNode = (ExpressionNode *)pAst->pBody;
+	SymbolValue_t nLeftType, nRightType;
+	EvalValue oLeft, oRight;
+
+	if (pNode->nKind != kExprUnary && pNode->nKind != kExprBinary)
+		return EvalAstNode(pNode->pLeftNode);
+
+	nRightType = ((ExpressionNode *)pNode->pRightNode->pBody)->nResultType;
+	if (pNode->nKind == kExprUnary){
+		oRight = EvalAstNode(pNode->pRightNode);
+		if (pNode->nOp == kNOT)
+			oRight.n = !oRight.n;
+		else if (nRightType == kReal)
+			oRight.d = -oRight.d;
+		else
+			oRight.n = WRAP(0, -, oRight.n);
+		return oRight;
+	}
+
+	nLeftType = ((ExpressionNode *)pNode->pLeftNode->pBody)->nResultType;
+	oLeft = EvalAstNode(pNode->pLeftNode);
+	oRight = EvalAstNode(pNode->pRightNode);
+	if (pNode->nOp == kSTRCAT)
+		oLeft.psz = Eval_Concat(oLeft.psz, oRight.psz);
+	else if (nLeftType == kReal || nRightType == kReal)
+		oLeft = eval_real(pNode->nOp, nLeftType == kInteger ? oLeft.n : oLeft.d, nRightType == kInteger ? oRight.n : oRight.d);
+	else
+		oLeft = eval_int(pAst, pNode->nOp, oLeft.n, oRight.n);
+	return oLeft;
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
-AstNode *NewExpressionNode(int nLine, int nCol, const char *pszOp, AstNode *pLeftNode, AstNode *pRightNode)
+// Operator node, a unary operator has pLeftNode == NULL.
+AstNode *NewExpressionNode(int nLine, int nCol, SymbolValue_t nOp, AstNode *pLeftNode, AstNode *pRightNode)
 {
 	// Filling in body contents.
-	ExpressionNode *pBody = new ExpressionNode;
-	pBody->pszOp = pszOp;
+	ExpressionNode *pBody = Arena_New<ExpressionNode>();
+	pBody->pszOp = GetSymbolString(nOp);
 	pBody->pLeftNode = pLeftNode;
 	pBody->pRightNode = pRightNode;
-	pBody->nOp = GetSymbolValue(pBody->pszOp);
+	pBody->nKind = pLeftNode ? kExprBinary : kExprUnary;
+	pBody->nOp = nOp;
+	pBody->nResultType = kUnknown;
+	pBody->pszTypeStr = NULL;
+	// Build AST.
+	return NewAstNode(nLine, nCol, kAstExpression, pBody, PrintExpressionNode, VisitExpressionNode, CodeGenExpressionNode, EvalExpressionNode);
+}
+
+// Operand node wrapping a literal, variable reference, or function invocation in pLeftNode.
+AstNode *NewOperandNode(int nLine, int nCol, ExprKind_t nKind, AstNode *pOperandNode)
+{
+	const char *kOperandNames[] = {"", "", "constant", "VariableReference", "FunctionInvocation"};
+
+	// Filling in body contents.
+	ExpressionNode *pBody = Arena_New<ExpressionNode>();
+	pBody->pszOp = kOperandNames[nKind];
+	pBody->pLeftNode = pOperandNode;
+	pBody->pRightNode = NULL;
+	pBody->nKind = nKind;
+	pBody->nOp = kUnknown;
 	pBody->nResultType = kUnknown;
+	pBody->pszTypeStr = NULL;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintExpressionNode, VisitExpressionNode, NULL);
+	return NewAstNode(nLine, nCol, kAstExpression, pBody, PrintExpressionNode, VisitExpressionNode, CodeGenExpressionNode, EvalExpressionNode);
 }
 
 
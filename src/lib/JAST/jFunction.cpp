@@ -1,12 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 
 #include "JAST/jast_internal.h"
 
-// Declare a global variable to show what function name currently in. 
-AstNode *gCurrentFuncNode = NULL;
-extern AstNode *NewScalerTypeNode(int nLine, int nCol, const char *pszType);
+// Declare a global variable to show what function name currently in, one per thread checking function bodies.
+thread_local AstNode *gCurrentFuncNode = NULL;
+extern AstNode *NewScalerTypeNode(int nLine, int nCol, SymbolValue_t nType);
 
 // ----------------------------------------------------------------
 // Print Funtion and FunctionInvocation node.
@@ -14,8 +15,7 @@ extern AstNode *NewScalerTypeNode(int nLine, int nCol, const char *pszType);
 int PrintFunctionInvocationNode(AstNode *pAst, int nLevel)
 {
 	FunctionInvocationNode *pNode = (FunctionInvocationNode *)pAst->pBody;
-	PrintLeadingTabs(nLevel);
-	printf("function invocation <line: %d, col: %d> %s\n", pAst->location.line, pAst->location.col, pNode->pszFuncName);
+	PrintNodeLine(nLevel, "function invocation", pAst->location.line, pAst->location.col, pNode->pszFuncName);
 	PrintAstList(pNode->pFirstExpressionNode, nLevel + 1);
 	return 0;
 }
@@ -23,8 +23,7 @@ int PrintFunctionInvocationNode(AstNode *pAst, int nLevel)
 int PrintFunctionNode(AstNode *pAst, int nLevel)
 {	
 	FunctionNode *pNode = (FunctionNode *)pAst->pBody;
-	PrintLeadingTabs(nLevel);
-	printf("function declaration <line: %d, col: %d> %s %s %s\n", pAst->location.line, pAst->location.col, pNode->pszFuncName, pNode->pszReturnType, pNode->pszParamTypeStr);
+	PrintNodeLine(nLevel, "function declaration", pAst->location.line, pAst->location.col, pNode->pszFuncName, pNode->pszReturnType, pNode->pszParamTypeStr);
 	PrintAstList(pNode->pFirstArgDeclNode, nLevel + 1);
 	PrintAstList(pNode->pFirstStatementNode, nLevel + 1);
 	return 0;
@@ -44,13 +43,13 @@ int VisitFunctionInvocationNode(AstNode *pAst)
 
 	// 1. The identifier has to be in symbol tables.
 	if ((n = SymTab_Lookup(pNode->pszFuncName)) < 0){
-		ErrorMessage(pAst, "use of undeclared symbol '%s'\n", pNode->pszFuncName);
+		ErrorMessage(pAst, kDiagUndeclared, pNode->pszFuncName);
 		return 1;
 	}
 
 	// 2. The kind of symbol has to be function..
 	if (SymTab_GetKindValue(n) != kFunction){
-		ErrorMessage(pAst, "call of non-function symbol '%s'\n", pNode->pszFuncName);
+		ErrorMessage(pAst, kDiagCallNonFunction, pNode->pszFuncName);
 		return 1;
 	}
 
@@ -60,7 +59,7 @@ int VisitFunctionInvocationNode(AstNode *pAst)
 	// 3. The number of arguments must be the same as one of the parameters.
 	pFunc = (FunctionNode *)SymTab_GetAstNode(n)->pBody;
 	if (AstLinkLength(pNode->pFirstExpressionNode) != AstLinkLength(pFunc->pFirstArgTypeNode)){
-		ErrorMessage(pAst, "too few/much arguments provided for function '%s'\n", pNode->pszFuncName);
+		ErrorMessage(pAst, kDiagArgumentCount, pNode->pszFuncName);
 		return 1;
 	}
 
@@ -73,41 +72,55 @@ int VisitFunctionInvocationNode(AstNode *pAst)
 			nArgType = ((ExpressionNode *)p->pBody)->nResultType;
 			nParamType = ((TypeNode *)q->pBody)->nScalerType;
 			if(!((nArgType == kInteger && nParamType == kReal) || nArgType == nParamType)){
-				ErrorMessage(p, "incompatible type passing '%s' to parameter of type '%s'\n", GetSymbolString(nArgType), GetSymbolString(nParamType));
+				ErrorMessage(p, kDiagArgumentType, GetSymbolString(nArgType), GetSymbolString(nParamType));
 				return 1;
 			}
 			p = p->pNext;
 			q = q->pNext;
 		}
+		// Bind the call to the function.
+		pNode->pFuncNode = SymTab_GetAstNode(n);
 	}
 	
 	return nErr;
 }
 
-int VisitFunctionNode(AstNode *pAst)
+// Check and enter the function name, the part of a function visit that depends on the functions before it.
+int VisitFunctionSignature(AstNode *pAst)
 {
 	FunctionNode *pNode = (FunctionNode *)pAst->pBody;
-	int n, nErr = 0;
-
-	// Get function name currently in.
-	gCurrentFuncNode = pAst;
+	int n;
 
 	n = SymTab_Lookup(pNode->pszFuncName);
 	if (n >= 0 && SymTab_GetLevel(n) == SymTab_GetCurrStackLevel()){
-		ErrorMessage(pAst, "symbol '%s' is redeclared\n", pNode->pszFuncName); // DBG : not quite sure
-		nErr++;
-	}
-	else{
-		SymTab_Insert(pNode->pszFuncName, "function", pNode->pszReturnType, pNode->pszReturnType, pNode->pszParamTypeStr, pAst);
+		ErrorMessage(pAst, kDiagRedeclared, pNode->pszFuncName); // DBG : not quite sure
+		return 1;
 	}
+	SymTab_Insert(pNode->pszFuncName, kFunction, pNode->nReturnType, pNode->pszReturnType, pNode->pszParamTypeStr, pAst);
+	return 0;
+}
 
-	// For function definition, pFirstStatementNode != NULL, push symbol table and visit args and statements.
-	if (pNode->pFirstStatementNode){
-		SymTab_Push();
-		nErr += VisitAstList(pNode->pFirstArgDeclNode, false);
-		nErr += VisitAstList(pNode->pFirstStatementNode, false);
-		SymTab_Pop();
-	}
+// Visit the arguments and statements of a function definition in a scope of their own.
+// It only reads the scope around it, so bodies can be checked in parallel once their signatures are in.
+int VisitFunctionBody(AstNode *pAst)
+{
+	FunctionNode *pNode = (FunctionNode *)pAst->pBody;
+	int nErr = 0;
+
+	// For function definition, pFirstStatementNode != NULL, push symbol table and visit args and statements,
+	// unless the incremental cache has the results of an unchanged body.
+	if (!pNode->pFirstStatementNode || IncCache_Replay(pAst, &nErr))
+		return nErr;
+
+	// Get function name currently in.
+	gCurrentFuncNode = pAst;
+
+	IncCache_Begin(pAst);
+	SymTab_Push();
+	nErr += VisitAstList(pNode->pFirstArgDeclNode, false);
+	nErr += VisitAstList(pNode->pFirstStatementNode, false);
+	SymTab_Pop();
+	IncCache_End(pAst, nErr);
 
 	// Set the gCurrentFuncNode to NULL when leaving the function.
 	gCurrentFuncNode = NULL;
@@ -115,62 +128,148 @@ int VisitFunctionNode(AstNode *pAst)
 	return nErr;
 }
 
+int VisitFunctionNode(AstNode *pAst)
+{
+	int nErr = 0;
+
+	nErr += VisitFunctionSignature(pAst);
+	nErr += VisitFunctionBody(pAst);
+	return nErr;
+}
+
+// ----------------------------------------------------------------
+// CodeGen Function Node.
+// ----------------------------------------------------------------
+// The arguments go into consecutive temporaries, the first of them gets the result.
+int CodeGenFunctionInvocationNode(AstNode *pAst)
+{
+	FunctionInvocationNode *pNode = (FunctionInvocationNode *)pAst->pBody;
+	AstNode *p, *q;
+	int nBase = ByteCode_GetTop(), nArgs = 0, n;
+
+	q = ((FunctionNode *)pNode->pFuncNode->pBody)->pFirstArgTypeNode;
+	for(p = pNode->pFirstExpressionNode; p; p = p->pNext, q = q->pNext){
+		n = CodeGenAstNode(p);
+		if (((TypeNode *)q->pBody)->nScalerType == kReal && ((ExpressionNode *)p->pBody)->nResultType == kInteger)
+			n = ByteCode_IntToReal(n);
+		ByteCode_MoveTo(nBase + nArgs, n);
+		ByteCode_SetTop(nBase + nArgs++);
+		ByteCode_NewTemp();
+	}
+	if (nArgs == 0)
+		ByteCode_NewTemp();
+	ByteCode_Emit(kBcCall, nBase, ByteCode_FunctionIndex(pNode->pFuncNode), nArgs);
+	ByteCode_SetTop(nBase + 1);
+	return nBase;
+}
+
+int CodeGenFunctionNode(AstNode *pAst)
+{
+	FunctionNode *pNode = (FunctionNode *)pAst->pBody;
+
+	ByteCode_SetLine(pAst->location.line);
+	ByteCode_BeginFunction(ByteCode_FunctionIndex(pAst), pAst, AstLinkLength(pNode->pFirstArgTypeNode), pNode->nReturnType, pNode->pszFuncName);
+	CodeGenAstList(pNode->pFirstStatementNode);
+	// Falling off the end returns the zero of the return type.
+	if (pNode->nReturnType == kVoid)
+		ByteCode_Emit(kBcReturnVoid, 0, 0, 0);
+	else{
+		if (pNode->nReturnType == kReal)
+			ByteCode_EmitImm(kBcLoadReal, ByteCode_GetTop(), ByteCode_RealConst(0.0));
+		else if (pNode->nReturnType == kString)
+			ByteCode_EmitImm(kBcLoadStr, ByteCode_GetTop(), ByteCode_StrConst(StrPool_Intern("")));
+		else
+			ByteCode_EmitImm(kBcLoadInt, ByteCode_GetTop(), 0);
+		ByteCode_Emit(kBcReturn, ByteCode_NewTemp(), 0, 0);
+	}
+	ByteCode_EndFunction();
+	return 0;
+}
+
+// ----------------------------------------------------------------
+// Eval Function Node.
+// ----------------------------------------------------------------
+EvalValue EvalFunctionInvocationNode(AstNode *pAst)
+{
+	FunctionInvocationNode *pNode = (FunctionInvocationNode *)pAst->pBody;
+	EvalValue *pArgs = Eval_PushArgs(pAst, AstLinkLength(pNode->pFirstExpressionNode));
+	AstNode *p, *q;
+	int i = 0;
+
+	q = ((FunctionNode *)pNode->pFuncNode->pBody)->pFirstArgTypeNode;
+	for(p = pNode->pFirstExpressionNode; p; p = p->pNext, q = q->pNext, i++){
+		pArgs[i] = EvalAstNode(p);
+		if (((TypeNode *)q->pBody)->nScalerType == kReal && ((ExpressionNode *)p->pBody)->nResultType == kInteger)
+			pArgs[i].d = pArgs[i].n;
+	}
+	return Eval_Call(pAst, pNode->pFuncNode, pArgs);
+}
+
+// Run the body of a function, called by Eval_Call() in the frame of the call.
+EvalValue EvalFunctionNode(AstNode *pAst)
+{
+	EvalAstList(((FunctionNode *)pAst->pBody)->pFirstStatementNode);
+	return EvalValue();
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
 AstNode *NewFunctionInvocationNode(int nLine, int nCol, const char *pszFuncName, AstNode *pFirstExpressionNode)
 {
 	// Filling in body contents.
-	FunctionInvocationNode *pBody = new FunctionInvocationNode;
-	pBody->pszFuncName = strdup(pszFuncName);
+	FunctionInvocationNode *pBody = Arena_New<FunctionInvocationNode>();
+	pBody->pszFuncName = StrPool_Intern(pszFuncName);
 	pBody->pFirstExpressionNode = pFirstExpressionNode;
+	pBody->pFuncNode = NULL;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintFunctionInvocationNode, VisitFunctionInvocationNode, NULL);
+	return NewAstNode(nLine, nCol, kAstFunctionInvocation, pBody, PrintFunctionInvocationNode, VisitFunctionInvocationNode, CodeGenFunctionInvocationNode, EvalFunctionInvocationNode);
 }
 
 AstNode *NewFunctionNode(int nLine, int nCol, const char *pszFuncName, AstNode *pFirstArgDeclNode, AstNode *pReturnTypeNode, AstNode *pFirstStatementNode)
  {
  	int i, n;
-	char pszTemp[256];
-	AstNode *p, oNode;
+	std::string oParamTypes;
+	AstNode *p;
+	AstList oArgTypes = {NULL, NULL};
 	DeclarationNode *pDecl;
 
 	if (!pReturnTypeNode)
-		pReturnTypeNode = NewScalerTypeNode(nLine, 0, "void");
+		pReturnTypeNode = NewScalerTypeNode(nLine, 0, kVoid);
 
 	// Filling in body contents.
- 	FunctionNode *pBody = new FunctionNode;
- 	pBody->pszFuncName = strdup(pszFuncName);
+ 	FunctionNode *pBody = Arena_New<FunctionNode>();
+ 	pBody->pszFuncName = StrPool_Intern(pszFuncName);
 	pBody->pszReturnType = ((TypeNode *)pReturnTypeNode->pBody)->pszScalerType;
+	pBody->nReturnType = ((TypeNode *)pReturnTypeNode->pBody)->nScalerType;
 	pBody->pFirstArgDeclNode = pFirstArgDeclNode;
 	pBody->pReturnTypeNode = pReturnTypeNode;
 	pBody->pFirstStatementNode = pFirstStatementNode;
 
 	// Expand the declaration and generate formal parameters' type list.
-	oNode.pNext = NULL;
 	p = pFirstArgDeclNode;
 	while(p){
 		pDecl = (DeclarationNode *)p->pBody;
-		for(i = 0; i < AstLinkLength(pDecl->pFirstIdNode); i++)
-			AddSiblingNode(&oNode, DupAstNode(pDecl->pTypeNode));
+		n = AstLinkLength(pDecl->pFirstIdNode);
+		for(i = 0; i < n; i++)
+			oArgTypes = AppendAstList(oArgTypes, DupAstNode(pDecl->pTypeNode));
 		p = p->pNext;
 	}
-	pBody->pFirstArgTypeNode = oNode.pNext;
+	pBody->pFirstArgTypeNode = oArgTypes.pHead;
 
 	// Generate string that needs to be printed for formal parameters types.
-	strcpy(pszTemp, "(");
+	// Any number of parameters, so the string grows as needed.
+	oParamTypes = "(";
 	p = pBody->pFirstArgTypeNode;
 	while(p){
-		strcat(pszTemp, ((TypeNode *)p->pBody)->pszTypeStr);
-		strcat(pszTemp, ", ");			
+		if (p != pBody->pFirstArgTypeNode)
+			oParamTypes += ", ";
+		oParamTypes += ((TypeNode *)p->pBody)->pszTypeStr;
 		p = p->pNext;
 	}
-	n = strlen(pszTemp);
-	if (n > 1)
-		pszTemp[n - 2] = 0;
-	strcat(pszTemp, ")");
-	pBody->pszParamTypeStr = strdup(pszTemp);
+	oParamTypes += ")";
+	pBody->pszParamTypeStr = StrPool_Intern(oParamTypes.c_str());
 
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintFunctionNode, VisitFunctionNode, NULL);
+	return NewAstNode(nLine, nCol, kAstFunction, pBody, PrintFunctionNode, VisitFunctionNode, CodeGenFunctionNode, EvalFunctionNode);
  }
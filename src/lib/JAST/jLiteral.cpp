@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <float.h>
 
 #include "JAST/jast_internal.h"
 
@@ -10,11 +11,52 @@
 int PrintLiteralNode(AstNode *pAst, int nLevel)
 {
 	LiteralNode *pNode = (LiteralNode *)pAst->pBody;
-	PrintLeadingTabs(nLevel);
-	printf("constant <line: %d, col: %d> %s\n", pAst->location.line, pAst->location.col, pNode->pszStr);
+	PrintNodeLine(nLevel, "constant", pAst->location.line, pAst->location.col, pNode->pszStr);
 	return 0;
 }
 
+// ----------------------------------------------------------------
+// CodeGen Literal Node, the value goes into a new temporary.
+// ----------------------------------------------------------------
+int CodeGenLiteralNode(AstNode *pAst)
+{
+	LiteralNode *pNode = (LiteralNode *)pAst->pBody;
+	int n = ByteCode_NewTemp();
+
+	switch(pNode->nType){
+	case kReal:
+		ByteCode_EmitImm(kBcLoadReal, n, ByteCode_RealConst(pNode->dLiteralReal));
+		break;
+	case kString:
+		ByteCode_EmitImm(kBcLoadStr, n, ByteCode_StrConst(pNode->pszLiteralString));
+		break;
+	case kBoolean:
+		ByteCode_EmitImm(kBcLoadInt, n, pNode->nLiteralBoolean ? 1 : 0);
+		break;
+	default:
+		ByteCode_EmitImm(kBcLoadInt, n, pNode->nLiteralInt);
+		break;
+	}
+	return n;
+}
+
+// ----------------------------------------------------------------
+// Eval Literal Node.
+// ----------------------------------------------------------------
+EvalValue EvalLiteralNode(AstNode *pAst)
+{
+	LiteralNode *pNode = (LiteralNode *)pAst->pBody;
+	EvalValue oValue;
+
+	switch(pNode->nType){
+	case kReal:		oValue.d = pNode->dLiteralReal;			break;
+	case kString:	oValue.psz = pNode->pszLiteralString;	break;
+	case kBoolean:	oValue.n = pNode->nLiteralBoolean;		break;
+	default:		oValue.n = pNode->nLiteralInt;			break;
+	}
+	return oValue;
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
@@ -23,52 +65,52 @@ AstNode *NewLiteralIntNode(int nLine, int nCol, int nValue)
 	char pszTemp[256];
 
 	// Filling in body contents.
-	LiteralNode *pBody = new LiteralNode;
+	LiteralNode *pBody = Arena_New<LiteralNode>();
 	pBody->pszType = "integer";
 	pBody->nType = kInteger;
 	pBody->nLiteralInt = nValue;
-	sprintf(pszTemp, "%d", nValue);
-	pBody->pszStr = strdup(pszTemp);
+	FormatInt(pszTemp, nValue);
+	pBody->pszStr = StrPool_Intern(pszTemp);
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintLiteralNode, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstLiteral, pBody, PrintLiteralNode, NULL, CodeGenLiteralNode, EvalLiteralNode);
 }
 
 AstNode *NewLiteralRealNode(int nLine, int nCol, double dValue)
 {
-	char pszTemp[256];
+	char pszTemp[DBL_MAX_10_EXP + 16];	// all digits of the largest double, the point, 6 decimals and a sign.
 
 	// Filling in body contents.
-	LiteralNode *pBody = new LiteralNode;
+	LiteralNode *pBody = Arena_New<LiteralNode>();
 	pBody->pszType = "real";
 	pBody->nType = kReal;
 	pBody->dLiteralReal = dValue;
-	sprintf(pszTemp, "%.6lf", dValue);
-	pBody->pszStr = strdup(pszTemp);
+	snprintf(pszTemp, sizeof(pszTemp), "%.6lf", dValue);
+	pBody->pszStr = StrPool_Intern(pszTemp);
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintLiteralNode, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstLiteral, pBody, PrintLiteralNode, NULL, CodeGenLiteralNode, EvalLiteralNode);
 }
 
 AstNode *NewLiteralStringNode(int nLine, int nCol, const char *pszStr)
 {
 	// Filling in body contents.
-	LiteralNode *pBody = new LiteralNode;
+	LiteralNode *pBody = Arena_New<LiteralNode>();
 	pBody->pszType = "string";
 	pBody->nType = kString;
-	pBody->pszLiteralString = strdup(pszStr);
+	pBody->pszLiteralString = StrPool_Intern(pszStr);
 	pBody->pszStr = pBody->pszLiteralString;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintLiteralNode, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstLiteral, pBody, PrintLiteralNode, NULL, CodeGenLiteralNode, EvalLiteralNode);
 }
 
 AstNode *NewLiteralBooleanNode(int nLine, int nCol, bool nBoolean)
 {
 	// Filling in body contents.
-	LiteralNode *pBody = new LiteralNode;
+	LiteralNode *pBody = Arena_New<LiteralNode>();
 	pBody->pszType = "boolean";
 	pBody->nType = kBoolean;
 	pBody->nLiteralBoolean = nBoolean;
 	pBody->pszStr = nBoolean ? "true" : "false";
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintLiteralNode, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstLiteral, pBody, PrintLiteralNode, NULL, CodeGenLiteralNode, EvalLiteralNode);
 }
 
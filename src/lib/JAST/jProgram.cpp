@@ -4,6 +4,12 @@
 
 #include "JAST/jast_internal.h"
 
+// extern from scanner.l
+struct ParseContext;
+extern const char *LexGetSourceCode(int nLine, int *pnLeng);
+extern ParseContext *LexGetContext(void);
+extern void LexSetContext(ParseContext *pCtx);
+
 // ----------------------------------------------------------------
 // Print functions for each non-terminal
 // ----------------------------------------------------------------
@@ -11,14 +17,124 @@ int PrintProgramNode(AstNode *pAst, int nLevel)
 {
 	ProgramNode *pNode = (ProgramNode *)pAst->pBody;
 
-	PrintLeadingTabs(nLevel);
-	printf("program <line: %d, col: %d> %s void\n", pAst->location.line, pAst->location.col, pNode->pszName);
+	PrintNodeLine(nLevel, "program", pAst->location.line, pAst->location.col, pNode->pszName, "void");
 	PrintAstList(pNode->pFirstDeclarationNode, nLevel + 1);
 	PrintAstList(pNode->pFirstFunctionNode, nLevel + 1);
 	PrintAstNode(pNode->pCompoundStatementNode, nLevel + 1);
 	return 0;
 }
 
+// ----------------------------------------------------------------
+// Parallel check of function bodies.
+// ----------------------------------------------------------------
+
+struct FunctionCheck {
+	AstNode *pFunc;
+	int nGlobals;			// symbols in the global scope after the function name went in.
+	int nErr;
+	OutCapture oSignature;
+	OutCapture oBody;
+	char *pDiag;			// diagnostics of the body, appended by the main thread.
+	size_t nDiag;
+};
+
+// The functions to check and the compilation state of the main thread the workers share.
+struct FunctionChecks {
+	FunctionCheck *pChecks;
+	Arena *pArena;
+	StrPool *pPool;
+	ParseContext *pSource;
+	bool bDump;
+};
+
+// A worker thread gets a symbol table of its own, with the global scope on level 0,
+// and works in the arena, string pool and source lines of the main thread.
+static void check_thread(bool bStart, void *pArg)
+{
+	FunctionChecks *pShared = (FunctionChecks *)pArg;
+
+	if (bStart){
+		Arena_Use(pShared->pArena);
+		StrPool_Use(pShared->pPool);
+		LexSetContext(pShared->pSource);
+		SymTab_EnableDump(pShared->bDump);
+		SymTab_Init();
+		SymTab_Push();
+	}
+	else{
+		SymTab_Release();
+		Diag_Release();
+		OutBuf_Release();
+		Arena_Use(NULL);
+		StrPool_Use(NULL);
+		LexSetContext(NULL);
+	}
+}
+
+// Check one function body on a worker thread, seeing the globals declared before the function.
+static void check_body(int nItem, void *pArg)
+{
+	FunctionCheck *pCheck = &((FunctionChecks *)pArg)->pChecks[nItem];
+	size_t nMark = Diag_Mark();
+	const char *pDiag;
+
+	SymTab_SetGlobalView(pCheck->nGlobals);
+	OutBuf_BeginCapture();
+	pCheck->nErr += VisitFunctionBody(pCheck->pFunc);
+	OutBuf_TakeCapture(&pCheck->oBody);
+	pDiag = Diag_Since(nMark, &pCheck->nDiag);
+	pCheck->pDiag = (char *)malloc(pCheck->nDiag + 1);
+	memcpy(pCheck->pDiag, pDiag, pCheck->nDiag);
+	Diag_Truncate(nMark);
+}
+
+// Visit a list of functions like VisitAstList(), the bodies on worker threads.
+// Function names go into the global scope in order first, then each body is checked against the
+// scope as it was after its own name, and the output of the functions is written in source order.
+static int visit_functions(AstNode *pFirstFunc)
+{
+	int i, nFuncs = AstLinkLength(pFirstFunc), nLeng, nErr = 0;
+	FunctionCheck *pChecks;
+	FunctionChecks oShared;
+	AstNode *p;
+
+	if (nFuncs < 2 || WorkPool_GetJobs() < 2 || IncCache_IsOpen())
+		return VisitAstList(pFirstFunc, false);
+
+	pChecks = (FunctionCheck *)calloc(nFuncs, sizeof(FunctionCheck));
+	for(i = 0, p = pFirstFunc; p; i++, p = p->pNext){
+		pChecks[i].pFunc = p;
+		OutBuf_BeginCapture();
+		pChecks[i].nErr = VisitFunctionSignature(p);
+		OutBuf_TakeCapture(&pChecks[i].oSignature);
+		pChecks[i].nGlobals = SymTab_GetCount();
+	}
+
+	// Workers only read the global scope and the source lines, build the lazy line index beforehand.
+	LexGetSourceCode(0, &nLeng);
+	SymTab_ShareGlobals();
+	oShared.pChecks = pChecks;
+	oShared.pArena = Arena_GetCurrent();
+	oShared.pPool = StrPool_GetCurrent();
+	oShared.pSource = LexGetContext();
+	oShared.bDump = SymTab_IsDumpEnabled();
+	Arena_SetShared(true);
+	StrPool_SetShared(true);
+	WorkPool_Run(nFuncs, check_body, check_thread, &oShared);
+	StrPool_SetShared(false);
+	Arena_SetShared(false);
+
+	for(i = 0; i < nFuncs; i++){
+		OutBuf_EmitCapture(&pChecks[i].oSignature);
+		OutBuf_EmitCapture(&pChecks[i].oBody);
+		Diag_Append(pChecks[i].pDiag, pChecks[i].nDiag);
+		free(pChecks[i].pDiag);
+		nErr += pChecks[i].nErr;
+	}
+	free(pChecks);
+	return nErr;
+}
+
 // ----------------------------------------------------------------
 // Visit Declaration related Node.
 // ----------------------------------------------------------------
@@ -28,27 +144,56 @@ int VisitProgramNode(AstNode *pAst)
 	int nErr = 0;
 
 	SymTab_Push();
-	SymTab_Insert(pNode->pszName, "program", "", "", "", pAst);
+	SymTab_Insert(pNode->pszName, kProgram, kUnknown, "", "", pAst);
 	nErr += VisitAstList(pNode->pFirstDeclarationNode, false);
-	nErr += VisitAstList(pNode->pFirstFunctionNode, false);
+	nErr += visit_functions(pNode->pFirstFunctionNode);
 	nErr += VisitAstNode(pNode->pCompoundStatementNode);
 	SymTab_Pop();
 	return nErr;
 }
 
+// ----------------------------------------------------------------
+// CodeGen Program Node, the body is function 0 and the functions follow.
+// ----------------------------------------------------------------
+int CodeGenProgramNode(AstNode *pAst)
+{
+	ProgramNode *pNode = (ProgramNode *)pAst->pBody;
+
+	ByteCode_SetLine(pAst->location.line);
+	ByteCode_BeginFunction(0, pNode->pCompoundStatementNode, 0, kVoid, pNode->pszName);
+	CodeGenAstList(pNode->pFirstDeclarationNode);
+	CodeGenAstNode(pNode->pCompoundStatementNode);
+	ByteCode_Emit(kBcHalt, 0, 0, 0);
+	ByteCode_EndFunction();
+	CodeGenAstList(pNode->pFirstFunctionNode);
+	return 0;
+}
+
+// ----------------------------------------------------------------
+// Eval Program Node, the functions only run when they are called.
+// ----------------------------------------------------------------
+EvalValue EvalProgramNode(AstNode *pAst)
+{
+	ProgramNode *pNode = (ProgramNode *)pAst->pBody;
+
+	EvalAstList(pNode->pFirstDeclarationNode);
+	EvalAstNode(pNode->pCompoundStatementNode);
+	return EvalValue();
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
 AstNode *NewProgramNode(int nLine, int nCol, const char *pszProgName, AstNode *pFirstDeclarationNode, AstNode *pFirstFunctionNode, AstNode *pCompoundStatementNode)
 {
 	// Filling in body contents.
-	ProgramNode *pBody = new ProgramNode;
-	pBody->pszName = strdup(pszProgName);
+	ProgramNode *pBody = Arena_New<ProgramNode>();
+	pBody->pszName = StrPool_Intern(pszProgName);
 	pBody->pFirstDeclarationNode = pFirstDeclarationNode;
 	pBody->pFirstFunctionNode = pFirstFunctionNode;
 	pBody->pCompoundStatementNode = pCompoundStatementNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintProgramNode, VisitProgramNode, NULL);
+	return NewAstNode(nLine, nCol, kAstProgram, pBody, PrintProgramNode, VisitProgramNode, CodeGenProgramNode, EvalProgramNode);
 }
 
 
@@ -4,9 +4,9 @@
 
 #include "JAST/jast_internal.h"
 
-extern AstNode *gCurrentFuncNode;
-extern AstNode *NewDeclarationNode_Type(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pTypeNode, const char *pszKind);
-extern AstNode *NewScalerTypeNode(int nLine, int nCol, const char *pszType);
+extern thread_local AstNode *gCurrentFuncNode;
+extern AstNode *NewDeclarationNode_Type(int nLine, int nCol, AstNode *pFirstIdNode, AstNode *pTypeNode, SymbolValue_t nKind);
+extern AstNode *NewScalerTypeNode(int nLine, int nCol, SymbolValue_t nType);
 
 // ----------------------------------------------------------------
 // Print Condition, While, Return and For Node.
@@ -15,8 +15,7 @@ int PrintConditionNode(AstNode *pAst, int nLevel)
 {
 	ConditionNode *pNode = (ConditionNode *)pAst->pBody;
 
-	PrintLeadingTabs(nLevel);
-	printf("if statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "if statement", pAst->location.line, pAst->location.col);
 	PrintAstNode(pNode->pExpressionNode, nLevel + 1);
 	PrintAstNode(pNode->pThenCompoundStatementNode, nLevel + 1);
 	PrintAstNode(pNode->pElseCompoundStatementNode, nLevel + 1);
@@ -27,8 +26,7 @@ int PrintWhileNode(AstNode *pAst, int nLevel)
 {
 	WhileNode *pNode = (WhileNode *)pAst->pBody;
 
-	PrintLeadingTabs(nLevel);
-	printf("while statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "while statement", pAst->location.line, pAst->location.col);
 	PrintAstNode(pNode->pExpressionNode, nLevel + 1);
 	PrintAstNode(pNode->pCompoundStatementNode, nLevel + 1);
 	return 0;
@@ -38,8 +36,7 @@ int PrintReturnNode(AstNode *pAst, int nLevel)
 {
 	ReturnNode *pNode = (ReturnNode *)pAst->pBody;
 
-	PrintLeadingTabs(nLevel);
-	printf("return statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	PrintNodeLine(nLevel, "return statement", pAst->location.line, pAst->location.col);
 	PrintAstNode(pNode->pExpressionNode, nLevel + 1);
 	return 0;
 }
@@ -48,23 +45,22 @@ int PrintForNode(AstNode *pAst, int nLevel)
 {
 	ForNode *pNode = (ForNode *)pAst->pBody;
 	Location loc2, loc3, loc4, loc6;
+	char pszStart[16], pszEnd[16];
 
 	loc2 = pNode->pLoopVarNode->location;
 	loc3 = pNode->pAssignSymbolNode->location;
 	loc4 = pNode->pStartIntNode->location;
 	loc6 = pNode->pEndIntNode->location;
 
-	PrintLeadingTabs(nLevel);
-	printf("for statement <line: %d, col: %d>\n", pAst->location.line, pAst->location.col);
+	FormatInt(pszStart, pNode->nStart);
+	FormatInt(pszEnd, pNode->nEnd);
+
+	PrintNodeLine(nLevel, "for statement", pAst->location.line, pAst->location.col);
 	PrintAstNode(pNode->pDeclarationNode, nLevel + 1); 
-	PrintLeadingTabs(nLevel + 1);
-	printf("assignment statement <line: %d, col: %d>\n", loc3.line, loc3.col);
-	PrintLeadingTabs(nLevel + 2);
-	printf("variable reference <line: %d, col: %d> %s\n", loc2.line, loc2.col, pNode->pszLoopVar);
-	PrintLeadingTabs(nLevel + 2);
-	printf("constant <line: %d, col: %d> %d\n", loc4.line, loc4.col, pNode->nStart);
-	PrintLeadingTabs(nLevel + 1);
-	printf("constant <line: %d, col: %d> %d\n", loc6.line, loc6.col, pNode->nEnd);
+	PrintNodeLine(nLevel + 1, "assignment statement", loc3.line, loc3.col);
+	PrintNodeLine(nLevel + 2, "variable reference", loc2.line, loc2.col, pNode->pszLoopVar);
+	PrintNodeLine(nLevel + 2, "constant", loc4.line, loc4.col, pszStart);
+	PrintNodeLine(nLevel + 1, "constant", loc6.line, loc6.col, pszEnd);
 	PrintAstNode(pNode->pCompoundStatementNode, nLevel + 1);
 	return 0;
 }
@@ -80,16 +76,14 @@ int VisitConditionNode(AstNode *pAst)
 	// Skip further checks if there is semantic errors in expression.
 	if ((nErr = VisitAstNode(pNode->pExpressionNode)) == 0){
 		nResultType = ((ExpressionNode *)(pNode->pExpressionNode)->pBody)->nResultType;
-		// // Skip further checks if the result type of expression is not boolean.
 		if(nResultType != kBoolean){
-			ErrorMessage(pNode->pExpressionNode, "the expression of condition must be boolean type\n");
-			return 1;
+			ErrorMessage(pNode->pExpressionNode, kDiagConditionNotBoolean);
+			nErr++;
 		}
 	}
-	else{
-		nErr += VisitAstNode(pNode->pThenCompoundStatementNode);
-		nErr += VisitAstNode(pNode->pElseCompoundStatementNode);
-	}
+	// The bodies are checked whatever the condition is.
+	nErr += VisitAstNode(pNode->pThenCompoundStatementNode);
+	nErr += VisitAstNode(pNode->pElseCompoundStatementNode);
 	
 	return nErr;
 }
@@ -103,15 +97,13 @@ int VisitWhileNode(AstNode *pAst)
 	// Skip further checks if there is semantic errors in expression.
 	if ((nErr = VisitAstNode(pNode->pExpressionNode)) == 0){
 		nResultType = ((ExpressionNode *)(pNode->pExpressionNode)->pBody)->nResultType;
-		// Skip further checks if the result type of expression is not boolean type.
 		if(nResultType != kBoolean){
-			ErrorMessage(pNode->pExpressionNode, "the expression of condition must be boolean type\n");
-			return 1;
+			ErrorMessage(pNode->pExpressionNode, kDiagConditionNotBoolean);
+			nErr++;
 		}
 	}
-	else{
-		nErr += VisitAstNode(pNode->pCompoundStatementNode);
-	}
+	// The body is checked whatever the condition is.
+	nErr += VisitAstNode(pNode->pCompoundStatementNode);
 	return nErr;
 }
 
@@ -119,27 +111,29 @@ int VisitReturnNode(AstNode *pAst)
 {
 	int nErr = 0;
 	const char *pszFuncType, *pszResultType;
+	SymbolValue_t nFuncType, nResultType;
 	ReturnNode *pNode = (ReturnNode *)pAst->pBody;
 
 	// 1. Check if currently in the main program. (not in any function)
 	if(!gCurrentFuncNode){
-		ErrorMessage(pAst, "program/procedure should not return a value\n");
+		ErrorMessage(pAst, kDiagReturnFromProcedure);
 		nErr++;
 	}
 	else{
 		// 2. Skip further checks if there is semantic errors in expressions.
 		if((nErr = VisitAstNode(pNode->pExpressionNode)) == 0){
-			pszFuncType = ((FunctionNode *)gCurrentFuncNode->pBody)->pszReturnType;
-			pszResultType = GetSymbolString(((ExpressionNode *)(pNode->pExpressionNode)->pBody)->nResultType);
-			pszResultType  = pszResultType ? pszResultType : GetArrayTypeString(pNode->pExpressionNode);
+			nFuncType = ((FunctionNode *)gCurrentFuncNode->pBody)->nReturnType;
+			nResultType = ((ExpressionNode *)(pNode->pExpressionNode)->pBody)->nResultType;
+			pszFuncType = GetSymbolString(nFuncType);
+			pszResultType = (nResultType != kUnknown) ? GetSymbolString(nResultType) : GetArrayTypeString(pNode->pExpressionNode);
 			// 2.1 Check if the function return type is "void".
-			if(strcmp(pszFuncType, "void") == 0){
-				ErrorMessage(pAst, "program/procedure should not return a value\n");
+			if(nFuncType == kVoid){
+				ErrorMessage(pAst, kDiagReturnFromProcedure);
 				nErr++;
 			}
 			// 2.2 Check if the return type is the same as the function return type after type coercion.
-			else if(!(strcmp(pszFuncType, pszResultType) == 0 || (strcmp(pszFuncType, "real") == 0 && strcmp(pszResultType, "integer") == 0))){
-				ErrorMessage(pAst, "return '%s' from a function with return type '%s'\n", pszFuncType, pszResultType);
+			else if(!(nFuncType == nResultType || (nFuncType == kReal && nResultType == kInteger))){
+				ErrorMessage(pAst, kDiagReturnType, pszFuncType, pszResultType);
 				nErr++;
 			}
 		}
@@ -159,7 +153,7 @@ int VisitForNode(AstNode *pAst)
 	n1 = ((IntValueNode *)(pNode->pStartIntNode)->pBody)->nValue;
 	n2 = ((IntValueNode *)(pNode->pEndIntNode)->pBody)->nValue;
 	if (n1 > n2){
-		ErrorMessage(pAst, "the lower bound and upper bound of iteration count must be in the incremental order\n");
+		ErrorMessage(pAst, kDiagLoopBounds);
 		nErr++;
 	}
 	nErr += VisitAstNode(pNode->pDeclarationNode);
@@ -169,37 +163,162 @@ int VisitForNode(AstNode *pAst)
 	return nErr;
 }
 
+// ----------------------------------------------------------------
+// CodeGen Condition, While, Return, For nodes 
+// ----------------------------------------------------------------
+int CodeGenConditionNode(AstNode *pAst)
+{
+	ConditionNode *pNode = (ConditionNode *)pAst->pBody;
+	int nTop = ByteCode_GetTop(), nElse, nEnd;
+
+	ByteCode_SetLine(pAst->location.line);
+	nElse = ByteCode_EmitImm(kBcJumpFalse, CodeGenAstNode(pNode->pExpressionNode), 0);
+	ByteCode_SetTop(nTop);
+	CodeGenAstNode(pNode->pThenCompoundStatementNode);
+	if (pNode->pElseCompoundStatementNode){
+		nEnd = ByteCode_EmitImm(kBcJump, 0, 0);
+		ByteCode_PatchJump(nElse);
+		CodeGenAstNode(pNode->pElseCompoundStatementNode);
+		ByteCode_PatchJump(nEnd);
+	}
+	else
+		ByteCode_PatchJump(nElse);
+	return 0;
+}
+
+// Loops test their condition at the bottom, so an iteration takes one jump.
+int CodeGenWhileNode(AstNode *pAst)
+{
+	WhileNode *pNode = (WhileNode *)pAst->pBody;
+	int nTop = ByteCode_GetTop(), nTest, nBody;
+
+	ByteCode_SetLine(pAst->location.line);
+	nTest = ByteCode_EmitImm(kBcJump, 0, 0);
+	nBody = ByteCode_Here();
+	CodeGenAstNode(pNode->pCompoundStatementNode);
+	ByteCode_PatchJump(nTest);
+	ByteCode_SetLine(pAst->location.line);
+	ByteCode_JumpTo(kBcJumpTrue, CodeGenAstNode(pNode->pExpressionNode), nBody);
+	ByteCode_SetTop(nTop);
+	return 0;
+}
+
+int CodeGenReturnNode(AstNode *pAst)
+{
+	ReturnNode *pNode = (ReturnNode *)pAst->pBody;
+	int nTop = ByteCode_GetTop(), n;
+
+	ByteCode_SetLine(pAst->location.line);
+	n = CodeGenAstNode(pNode->pExpressionNode);
+	if (ByteCode_GetReturnType() == kReal && ((ExpressionNode *)pNode->pExpressionNode->pBody)->nResultType == kInteger)
+		n = ByteCode_IntToReal(n);
+	ByteCode_Emit(kBcReturn, n, 0, 0);
+	ByteCode_SetTop(nTop);
+	return 0;
+}
+
+// The loop variable runs from the start up to, not including, the end.
+int CodeGenForNode(AstNode *pAst)
+{
+	ForNode *pNode = (ForNode *)pAst->pBody;
+	int nTop = ByteCode_GetTop(), nVar, nEnd, nTest, nBody, n;
+
+	ByteCode_SetLine(pAst->location.line);
+	nVar = ((IdNode *)pNode->pLoopVarNode->pBody)->nSlot;
+	nEnd = ByteCode_NewTemp();
+	ByteCode_EmitImm(kBcLoadInt, nVar, pNode->nStart);
+	ByteCode_EmitImm(kBcLoadInt, nEnd, pNode->nEnd);
+	nTest = ByteCode_EmitImm(kBcJump, 0, 0);
+	nBody = ByteCode_Here();
+	CodeGenAstNode(pNode->pCompoundStatementNode);
+	ByteCode_SetLine(pAst->location.line);
+	ByteCode_Emit(kBcAddIntK, nVar, nVar, 1);
+	ByteCode_PatchJump(nTest);
+	n = ByteCode_NewTemp();
+	ByteCode_Emit(kBcLtInt, n, nVar, nEnd);
+	ByteCode_JumpTo(kBcJumpTrue, n, nBody);
+	ByteCode_SetTop(nTop);
+	return 0;
+}
+
+// ----------------------------------------------------------------
+// Eval Condition, While, Return, For nodes 
+// ----------------------------------------------------------------
+EvalValue EvalConditionNode(AstNode *pAst)
+{
+	ConditionNode *pNode = (ConditionNode *)pAst->pBody;
+
+	if (EvalAstNode(pNode->pExpressionNode).n)
+		EvalAstNode(pNode->pThenCompoundStatementNode);
+	else
+		EvalAstNode(pNode->pElseCompoundStatementNode);
+	return EvalValue();
+}
+
+EvalValue EvalWhileNode(AstNode *pAst)
+{
+	WhileNode *pNode = (WhileNode *)pAst->pBody;
+
+	while(!Eval_IsReturning() && EvalAstNode(pNode->pExpressionNode).n)
+		EvalAstNode(pNode->pCompoundStatementNode);
+	return EvalValue();
+}
+
+EvalValue EvalReturnNode(AstNode *pAst)
+{
+	ReturnNode *pNode = (ReturnNode *)pAst->pBody;
+	EvalValue oValue = EvalAstNode(pNode->pExpressionNode);
+
+	if (Eval_GetReturnType() == kReal && ((ExpressionNode *)pNode->pExpressionNode->pBody)->nResultType == kInteger)
+		oValue.d = oValue.n;
+	Eval_Return(oValue);
+	return EvalValue();
+}
+
+// The loop variable runs from the start up to, not including, the end, see CodeGenForNode().
+EvalValue EvalForNode(AstNode *pAst)
+{
+	ForNode *pNode = (ForNode *)pAst->pBody;
+	IdNode *pId = (IdNode *)pNode->pLoopVarNode->pBody;
+
+	for(int i = pNode->nStart; i < pNode->nEnd && !Eval_IsReturning(); i++){
+		Eval_Variable(pId->nLevel, pId->nSlot)->n = i;
+		EvalAstNode(pNode->pCompoundStatementNode);
+	}
+	return EvalValue();
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
 AstNode *NewConditionNode(int nLine, int nCol, AstNode *pExpressionNode, AstNode *pThenCompoundStatementNode, AstNode *pElseCompoundStatementNode)
 {
 	// Filling in body contents.
-	ConditionNode *pBody = new ConditionNode;
+	ConditionNode *pBody = Arena_New<ConditionNode>();
 	pBody->pExpressionNode = pExpressionNode;
 	pBody->pThenCompoundStatementNode = pThenCompoundStatementNode;
 	pBody->pElseCompoundStatementNode = pElseCompoundStatementNode;	// It can be NULL.
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintConditionNode, VisitConditionNode, NULL);
+	return NewAstNode(nLine, nCol, kAstCondition, pBody, PrintConditionNode, VisitConditionNode, CodeGenConditionNode, EvalConditionNode);
 }
 
 AstNode *NewWhileNode(int nLine, int nCol, AstNode *pExpressionNode, AstNode *pCompoundStatementNode)
 {
 	// Filling in body contents.
-	WhileNode *pBody = new WhileNode;
+	WhileNode *pBody = Arena_New<WhileNode>();
 	pBody->pExpressionNode = pExpressionNode;
 	pBody->pCompoundStatementNode = pCompoundStatementNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintWhileNode, VisitWhileNode, NULL);
+	return NewAstNode(nLine, nCol, kAstWhile, pBody, PrintWhileNode, VisitWhileNode, CodeGenWhileNode, EvalWhileNode);
 }
 
 AstNode *NewReturnNode(int nLine, int nCol, AstNode *pExpressionNode)
 {
 	// Filling in body contents.
-	ReturnNode *pBody = new ReturnNode;
+	ReturnNode *pBody = Arena_New<ReturnNode>();
 	pBody->pExpressionNode = pExpressionNode;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintReturnNode, VisitReturnNode, NULL);
+	return NewAstNode(nLine, nCol, kAstReturn, pBody, PrintReturnNode, VisitReturnNode, CodeGenReturnNode, EvalReturnNode);
 }
 
 AstNode *NewForNode(int nLine, int nCol, AstNode *pLoopVarNode, AstNode *pAssignSymbolNode, AstNode *pStartIntNode, AstNode *pEndIntNode, AstNode *pCompoundStatementNode)
@@ -207,7 +326,7 @@ AstNode *NewForNode(int nLine, int nCol, AstNode *pLoopVarNode, AstNode *pAssign
 	Location loc;
 
 	// Filling in body contents.
-	ForNode *pBody = new ForNode;
+	ForNode *pBody = Arena_New<ForNode>();
 	pBody->pszLoopVar = ((IdNode *)pLoopVarNode->pBody)->pszName;
 	pBody->nStart = ((IntValueNode *)pStartIntNode->pBody)->nValue;
 	pBody->nEnd = ((IntValueNode *)pEndIntNode->pBody)->nValue;
@@ -217,7 +336,7 @@ AstNode *NewForNode(int nLine, int nCol, AstNode *pLoopVarNode, AstNode *pAssign
 	pBody->pEndIntNode = pEndIntNode;
 	pBody->pCompoundStatementNode = pCompoundStatementNode;
 	loc = pLoopVarNode->location;
-	pBody->pDeclarationNode = NewDeclarationNode_Type(loc.line, loc.col, pLoopVarNode, NewScalerTypeNode(loc.line, loc.col, "integer"), "loop_var");
+	pBody->pDeclarationNode = NewDeclarationNode_Type(loc.line, loc.col, pLoopVarNode, NewScalerTypeNode(loc.line, loc.col, kInteger), kLoopVar);
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, PrintForNode, VisitForNode, NULL);
+	return NewAstNode(nLine, nCol, kAstFor, pBody, PrintForNode, VisitForNode, CodeGenForNode, EvalForNode);
 }
@@ -1,62 +1,70 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 
 #include "JAST/jast_internal.h"
 
+// Intern the type string of an array of pszScalerType with the dimensions from pFirstIntNode on,
+// e.g. "real [3][4]"; any number of dimensions, so the string grows as needed.
+const char *InternArrayTypeString(const char *pszScalerType, AstNode *pFirstIntNode)
+{
+	std::string oStr = pszScalerType;
+	char pszDim[16];
+	AstNode *p;
+
+	oStr += " ";
+	for(p = pFirstIntNode; p; p = p->pNext){
+		snprintf(pszDim, sizeof(pszDim), "[%d]", ((IntValueNode *)p->pBody)->nValue);
+		oStr += pszDim;
+	}
+	return StrPool_Intern(oStr.c_str());
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
 AstNode *NewIdNode(int nLine, int nCol, const char *pszName)
 {
 	// Filling in body contents.
-	IdNode *pBody = new IdNode;
-	pBody->pszName = strdup(pszName);
+	IdNode *pBody = Arena_New<IdNode>();
+	pBody->pszName = StrPool_Intern(pszName);
+	pBody->nLevel = -1;
+	pBody->nSlot = -1;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, NULL, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstId, pBody, NULL, NULL, NULL, NULL);
 }
 
 AstNode *NewIntValueNode(int nLine, int nCol, int n)
 {
 	// Filling in body contents.
-	IntValueNode *pBody = new IntValueNode;
+	IntValueNode *pBody = Arena_New<IntValueNode>();
 	pBody->nValue = n;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, NULL, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstIntValue, pBody, NULL, NULL, NULL, NULL);
 }
 
-AstNode *NewScalerTypeNode(int nLine, int nCol, const char *pszType)
+AstNode *NewScalerTypeNode(int nLine, int nCol, SymbolValue_t nType)
 {
 	// Filling in body contents.
-	TypeNode *pBody = new TypeNode;
-	pBody->pszScalerType = strdup(pszType);
-	pBody->nScalerType = GetSymbolValue(pszType);
+	TypeNode *pBody = Arena_New<TypeNode>();
+	pBody->pszScalerType = GetSymbolString(nType);
+	pBody->nScalerType = nType;
 	pBody->pFirstIntNode = NULL;
 	pBody->pszTypeStr = pBody->pszScalerType;
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, NULL, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstType, pBody, NULL, NULL, NULL, NULL);
 }
 
-AstNode *NewArrTypeNode(int nLine, int nCol, AstNode *pFirstIntNode, const char *pszType)
+AstNode *NewArrTypeNode(int nLine, int nCol, AstNode *pFirstIntNode, SymbolValue_t nType)
 {
-	AstNode *p;
-	char pszTemp[256], pszStr[256];
-
 	// Filling in body contents.
-	TypeNode *pBody = new TypeNode;
-	pBody->pszScalerType = strdup(pszType);
-	pBody->nScalerType = GetSymbolValue(pszType);
+	TypeNode *pBody = Arena_New<TypeNode>();
+	pBody->pszScalerType = GetSymbolString(nType);
+	pBody->nScalerType = nType;
 	pBody->pFirstIntNode = pFirstIntNode;
-	p = pFirstIntNode;
-	strcpy(pszStr, pszType);
-	strcat(pszStr, " ");
-	while(p){
-		sprintf(pszTemp, "[%d]", ((IntValueNode *)p->pBody)->nValue);
-		strcat(pszStr, pszTemp);
-		p = p->pNext;
-	}
-	pBody->pszTypeStr = strdup(pszStr);
+	pBody->pszTypeStr = InternArrayTypeString(pBody->pszScalerType, pFirstIntNode);
 	// Build AST.
-	return NewAstNode(nLine, nCol, pBody, NULL, NULL, NULL);
+	return NewAstNode(nLine, nCol, kAstType, pBody, NULL, NULL, NULL, NULL);
 }
 
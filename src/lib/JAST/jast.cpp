@@ -6,14 +6,6 @@
 #include "JAST/jast.h"
 #include "JAST/jast_internal.h"
 
-// extern from scanner.l
-extern char *LexGetSourceCode(int nLine);
-
-const SymbolValue_t k_pnSymbolValues[] = { 
-	kProgram, kFunction, kParameter, kVariable, kLoopVar, kConstant, kInteger, kReal, kBoolean, kString, kVoid, 
-	kADD, kMINUS, kMULTIPLY, kDIVIDE, kNEG, kMOD, kAND, kOR, kNOT, kLT, kLE, kEQ, kGE, kGT, kNE, 
-	kUnknown 
-};
 const char *k_ppszSymbols[] = { 
 	"program", "function", "parameter", "variable", "loop_var", "constant", "integer", "real", "boolean", "string", "void", 
 	"+", "-", "*", "/", "neg", "mod", "and", "or", "not",  "<", "<=", "=", ">=", ">", "<>", 
@@ -37,18 +29,71 @@ int SearchStringItem(const char *pszItem, const char *ppszItems[])
 	return i;
 }
 
-// Search a list of symbol strings, with NULL at end of the list, and return the corresponsing value for the input symbol.
+// Get the symbol value of the input symbol string, or kUnknown if it is not a symbol.
+// Symbol strings are told apart by their length and one character (gperf style), so only one strcmp()
+// confirming the candidate is needed. Keep it in sync with k_ppszSymbols[].
 SymbolValue_t GetSymbolValue(const char *pszSymbol)
 {
-	int n = SearchStringItem(pszSymbol, k_ppszSymbols);
-	return k_pnSymbolValues[n];
+	SymbolValue_t n = kUnknown;
+
+	switch(strlen(pszSymbol)){
+	case 1:
+		switch(pszSymbol[0]){
+		case '+': n = kADD; break;
+		case '-': n = kMINUS; break;
+		case '*': n = kMULTIPLY; break;
+		case '/': n = kDIVIDE; break;
+		case '<': n = kLT; break;
+		case '=': n = kEQ; break;
+		case '>': n = kGT; break;
+		}
+		break;
+	case 2:
+		switch(pszSymbol[0]){
+		case 'o': n = kOR; break;
+		case '<': n = (pszSymbol[1] == '=') ? kLE : kNE; break;
+		case '>': n = kGE; break;
+		}
+		break;
+	case 3:
+		switch(pszSymbol[0]){
+		case 'n': n = (pszSymbol[1] == 'e') ? kNEG : kNOT; break;
+		case 'm': n = kMOD; break;
+		case 'a': n = kAND; break;
+		}
+		break;
+	case 4:
+		n = (pszSymbol[0] == 'r') ? kReal : kVoid;
+		break;
+	case 6:
+		n = kString;
+		break;
+	case 7:
+		switch(pszSymbol[0]){
+		case 'p': n = kProgram; break;
+		case 'i': n = kInteger; break;
+		case 'b': n = kBoolean; break;
+		}
+		break;
+	case 8:
+		switch(pszSymbol[0]){
+		case 'f': n = kFunction; break;
+		case 'v': n = kVariable; break;
+		case 'l': n = kLoopVar; break;
+		case 'c': n = kConstant; break;
+		}
+		break;
+	case 9:
+		n = kParameter;
+		break;
+	}
+	return (n != kUnknown && strcmp(k_ppszSymbols[n], pszSymbol) == 0) ? n : kUnknown;
 }
 
-// Get symbol string corresponding to the input symbol value. 
-// Assume k_pnSymbolValues[] is {0, 1, 2, 3, ......, -1}.
+// Get symbol string corresponding to the input symbol value, NULL for kUnknown and kSTRCAT.
 const char *GetSymbolString(SymbolValue_t n)
 {
-	return k_ppszSymbols[n];
+	return (n >= kProgram && n < kSTRCAT) ? k_ppszSymbols[n] : NULL;
 }
 
 // Check if the input symbol value existing in a list of symbol values, with kUnknown at end of the list.
@@ -63,46 +108,120 @@ bool InSymbolValueSet(SymbolValue_t nSymbol, const SymbolValue_t pnSymbols[])
 	return false;
 }
 
-void ErrorMessage(AstNode *pAst, const char *format, ...)
+// Record a semantic error at the node, with the string arguments its code takes; see Diag.cpp.
+void ErrorMessage(AstNode *pAst, DiagCode_t nCode, ...)
 {
 	va_list args;
 
-	fprintf(stderr, "<Error> Found in line %d, column %d: ", pAst->location.line, pAst->location.col);
-	
-	va_start(args, format);
-	vfprintf(stderr, format, args);
+	va_start(args, nCode);
+	Diag_VReport(pAst->location.line, pAst->location.col, nCode, args);
 	va_end(args);
-
-	fprintf(stderr, "%s\n", LexGetSourceCode(pAst->location.line - 1));
-	for (int i = 0; i < pAst->location.col - 1; i++)
-		fprintf(stderr, " ");
-	fprintf(stderr, "^\n");
 }
 
-// Get array type string for printing error messages.
+// Get the type string of an array-typed operand for error messages, e.g. "real [4]" for a[1] of
+// "real [3][4]": the scalar type and the dimensions left after the indices. It comes from the
+// TypeNode the variable reference resolved to and is kept on the expression for the next error.
 const char *GetArrayTypeString(AstNode *pAst)
 {	
-	int n;
-	const char *pszVarName, *pszArrayTypeStr;
 	ExpressionNode *pNode = (ExpressionNode *)pAst->pBody;
-
-	// Get the variable name in the expression node.
-	pszVarName = ((VariableRefNode *)pNode->pLeftNode->pBody)->pszVarName;
-	
-	// Look up in the symbol table and get the array type string.
-	n = SymTab_Lookup(pszVarName);
-	pszArrayTypeStr = SymTab_GetTypeStr(n);
-	
-	return pszArrayTypeStr;
+	VariableRefNode *pVarRef;
+	TypeNode *pType;
+	AstNode *p;
+	int nDimRef;
+
+	if (pNode->pszTypeStr)
+		return pNode->pszTypeStr;
+	if (pNode->nKind != kExprVariableRef)
+		return NULL;
+	pVarRef = (VariableRefNode *)pNode->pLeftNode->pBody;
+	if (!pVarRef->pTypeNode)
+		return NULL;
+	pType = (TypeNode *)pVarRef->pTypeNode->pBody;
+
+	nDimRef = AstLinkLength(pVarRef->pFirstArrRefNode);
+	if (nDimRef == 0){
+		pNode->pszTypeStr = pType->pszTypeStr;
+		return pNode->pszTypeStr;
+	}
+	for(p = pType->pFirstIntNode; p && nDimRef > 0; nDimRef--)
+		p = p->pNext;
+	pNode->pszTypeStr = InternArrayTypeString(pType->pszScalerType, p);
+	return pNode->pszTypeStr;
 }
 
 // ----------------------------------------------------------------
 // Print, semantic analysis, and code generation functions
 // ----------------------------------------------------------------
+
+// The AST dump is formatted straight into the output buffer: indentation is copied from a run of
+// spaces, numbers are converted by hand, and the whole dump is written out with the rest of stdout.
+#define INDENT_WIDTH		2
+#define MAX_INDENT_COPY		128		// levels copied at once from k_szIndent.
+
+static const char k_szIndent[INDENT_WIDTH * MAX_INDENT_COPY + 1] =
+	"                                                                                                                                "
+	"                                                                                                                                ";
+
+// Write the decimal digits of n to pszBuf, '\0' terminated, and return the number of characters.
+int FormatInt(char *pszBuf, int n)
+{
+	char pszTemp[16];
+	unsigned int u = (n < 0) ? 0u - (unsigned int)n : (unsigned int)n;
+	int i = 0, nLeng = 0;
+
+	do {
+		pszTemp[i++] = '0' + u % 10;
+		u /= 10;
+	} while(u);
+	if (n < 0)
+		pszBuf[nLeng++] = '-';
+	while(i > 0)
+		pszBuf[nLeng++] = pszTemp[--i];
+	pszBuf[nLeng] = '\0';
+	return nLeng;
+}
+
 void PrintLeadingTabs(int nTab)
 {
-	for(int i = 0; i < nTab; i++)
-		printf("  ");
+	for(; nTab > MAX_INDENT_COPY; nTab -= MAX_INDENT_COPY)
+		OutBuf_Write(k_szIndent, INDENT_WIDTH * MAX_INDENT_COPY);
+	OutBuf_Write(k_szIndent, INDENT_WIDTH * nTab);
+}
+
+// Print one line of the AST dump, "<pszWhat> <line: nLine, col: nCol>" followed by the non-NULL arguments
+// separated by spaces, indented by nLevel.
+void PrintNodeLine(int nLevel, const char *pszWhat, int nLine, int nCol, const char *pszArg1, const char *pszArg2, const char *pszArg3)
+{
+	const char *ppszArgs[3] = {pszArg1, pszArg2, pszArg3};
+	size_t nWhat = strlen(pszWhat), nArgs[3], nTotal;
+	char *p, *pStart;
+	int i;
+
+	PrintLeadingTabs(nLevel);
+	nTotal = nWhat + sizeof(" <line: , col: >\n") + 2 * 11;
+	for(i = 0; i < 3; i++){
+		nArgs[i] = ppszArgs[i] ? strlen(ppszArgs[i]) : 0;
+		nTotal += nArgs[i] + 1;
+	}
+	p = pStart = OutBuf_Reserve(nTotal);
+	memcpy(p, pszWhat, nWhat);
+	p += nWhat;
+	memcpy(p, " <line: ", 8);
+	p += 8;
+	p += FormatInt(p, nLine);
+	memcpy(p, ", col: ", 7);
+	p += 7;
+	p += FormatInt(p, nCol);
+	*p++ = '>';
+	for(i = 0; i < 3; i++){
+		if (ppszArgs[i]){
+			*p++ = ' ';
+			memcpy(p, ppszArgs[i], nArgs[i]);
+			p += nArgs[i];
+		}
+	}
+	*p++ = '\n';
+	OutBuf_Commit(p - pStart);
 }
 
 int PrintAstNode(AstNode *pAst, int nLevel)
@@ -169,17 +288,146 @@ int CodeGenAstList(AstNode *pFirstAst)
 	return 0;
 }
 
+// Evaluate a node in the tree-walking interpreter, see Eval.cpp.
+EvalValue EvalAstNode(AstNode *pAst)
+{
+	EvalValue oValue;
+
+	if (pAst && pAst->eval)
+		return pAst->eval(pAst);
+	oValue.p = NULL;
+	return oValue;
+}
+
+// Evaluate a list of statements, up to a return statement.
+void EvalAstList(AstNode *pFirstAst)
+{
+	AstNode *p;
+
+	for(p = pFirstAst; p && !Eval_IsReturning(); p = p->pNext)
+		EvalAstNode(p);
+}
+
+// Call func on every node of the subtree of pAst in pre-order, not on the siblings of pAst.
+// Derived nodes (for-loop ids and bounds, function argument types) are reached through their declarations only.
+void ForEachAstNode(AstNode *pAst, void (*func)(AstNode*, void*), void *pArg)
+{
+	AstNode *pChildren[3] = {NULL, NULL, NULL};
+	void *pBody;
+	int i;
+
+	if (!pAst)
+		return;
+	func(pAst, pArg);
+	pBody = pAst->pBody;
+	switch(pAst->nKind){
+	case kAstType:
+		pChildren[0] = ((TypeNode *)pBody)->pFirstIntNode;
+		break;
+	case kAstProgram:
+		pChildren[0] = ((ProgramNode *)pBody)->pFirstDeclarationNode;
+		pChildren[1] = ((ProgramNode *)pBody)->pFirstFunctionNode;
+		pChildren[2] = ((ProgramNode *)pBody)->pCompoundStatementNode;
+		break;
+	case kAstDeclaration:
+		pChildren[0] = ((DeclarationNode *)pBody)->pFirstIdNode;
+		pChildren[1] = ((DeclarationNode *)pBody)->pLiteralNode ? ((DeclarationNode *)pBody)->pLiteralNode : ((DeclarationNode *)pBody)->pTypeNode;
+		break;
+	case kAstExpression:
+		pChildren[0] = ((ExpressionNode *)pBody)->pLeftNode;
+		pChildren[1] = ((ExpressionNode *)pBody)->pRightNode;
+		break;
+	case kAstCompoundStatement:
+		pChildren[0] = ((CompoundStatementNode *)pBody)->pFirstDeclarationNode;
+		pChildren[1] = ((CompoundStatementNode *)pBody)->pFirstStatementNode;
+		break;
+	case kAstPrint:
+		pChildren[0] = ((PrintNode *)pBody)->pExpressionNode;
+		break;
+	case kAstVariableRef:
+		pChildren[0] = ((VariableRefNode *)pBody)->pFirstArrRefNode;
+		break;
+	case kAstAssign:
+		pChildren[0] = ((AssignNode *)pBody)->pVariableRefNode;
+		pChildren[1] = ((AssignNode *)pBody)->pExpressionNode;
+		break;
+	case kAstRead:
+		pChildren[0] = ((ReadNode *)pBody)->pVariableRefNode;
+		break;
+	case kAstFunctionInvocation:
+		pChildren[0] = ((FunctionInvocationNode *)pBody)->pFirstExpressionNode;
+		break;
+	case kAstFunction:
+		pChildren[0] = ((FunctionNode *)pBody)->pFirstArgDeclNode;
+		pChildren[1] = ((FunctionNode *)pBody)->pReturnTypeNode;
+		pChildren[2] = ((FunctionNode *)pBody)->pFirstStatementNode;
+		break;
+	case kAstCondition:
+		pChildren[0] = ((ConditionNode *)pBody)->pExpressionNode;
+		pChildren[1] = ((ConditionNode *)pBody)->pThenCompoundStatementNode;
+		pChildren[2] = ((ConditionNode *)pBody)->pElseCompoundStatementNode;
+		break;
+	case kAstWhile:
+		pChildren[0] = ((WhileNode *)pBody)->pExpressionNode;
+		pChildren[1] = ((WhileNode *)pBody)->pCompoundStatementNode;
+		break;
+	case kAstReturn:
+		pChildren[0] = ((ReturnNode *)pBody)->pExpressionNode;
+		break;
+	case kAstFor:
+		pChildren[0] = ((ForNode *)pBody)->pDeclarationNode;
+		pChildren[1] = ((ForNode *)pBody)->pCompoundStatementNode;
+		break;
+	default:
+		break;
+	}
+	for(i = 0; i < 3; i++){
+		// Lists: every child field may head a list of siblings.
+		for(AstNode *p = pChildren[i]; p; p = p->pNext)
+			ForEachAstNode(p, func, pArg);
+	}
+}
+
+struct SlotCount {
+	bool bGlobals;
+	int nSlots;
+};
+
+static void count_slot(AstNode *pAst, void *pArg)
+{
+	SlotCount *pCount = (SlotCount *)pArg;
+	IdNode *pId;
+
+	if (pAst->nKind != kAstId)
+		return;
+	pId = (IdNode *)pAst->pBody;
+	if ((pId->nLevel == 0) == pCount->bGlobals && pId->nSlot >= pCount->nSlots)
+		pCount->nSlots = pId->nSlot + 1;
+}
+
+// Number of slots the declarations of a subtree use, see SymTab_GetSlot(): the globals (level 0),
+// or the locals of a function frame when pScope is a function or the compound statement of the program.
+int CountSlots(AstNode *pScope, bool bGlobals)
+{
+	SlotCount oCount = {bGlobals, 0};
+
+	ForEachAstNode(pScope, count_slot, &oCount);
+	return oCount.nSlots;
+}
+
 // ----------------------------------------------------------------
 // Tree construction functions 
 // ----------------------------------------------------------------
-AstNode *NewAstNode(int nLine, int nCol, void *pBody, int (*funcPrint)(AstNode*, int), int (*funcVisit)(AstNode*), int (*funcCodeGen)(AstNode*))
+AstNode *NewAstNode(int nLine, int nCol, AstKind_t nKind, void *pBody, int (*funcPrint)(AstNode*, int), int (*funcVisit)(AstNode*), int (*funcCodeGen)(AstNode*), EvalValue (*funcEval)(AstNode*))
 {
-	AstNode *node = new AstNode;
+	AstNode *node = Arena_New<AstNode>();
 
+	node->nKind = nKind;
 	node->pBody = pBody;
 	node->print = funcPrint;
 	node->visit = funcVisit;
 	node->codegen = funcCodeGen;
+	node->eval = funcEval;
 	node->pNext = NULL;
 	node->location.line = nLine;
 	node->location.col = nCol;
@@ -188,7 +436,7 @@ AstNode *NewAstNode(int nLine, int nCol, void *pBody, int (*funcPrint)(AstNode*,
 
 AstNode *DupAstNode(AstNode *pAst)
 {
-	AstNode *node = new AstNode;
+	AstNode *node = Arena_New<AstNode>();
 	memcpy(node, pAst, sizeof(AstNode));
 	return node;
 }
@@ -204,6 +452,33 @@ AstNode *AddSiblingNode(AstNode *pNode, AstNode *pSibling)
 	return pNode;
 }
 
+// Start a list with the input node (and the siblings already linked after it).
+AstList NewAstList(AstNode *pFirstNode)
+{
+	AstList oList;
+
+	oList.pHead = pFirstNode;
+	oList.pTail = pFirstNode;
+	while(oList.pTail && oList.pTail->pNext)
+		oList.pTail = oList.pTail->pNext;
+	return oList;
+}
+
+// Append the input node at the list tail in O(1), without walking from the head like AddSiblingNode().
+AstList AppendAstList(AstList oList, AstNode *pNode)
+{
+	if (!pNode)
+		return oList;
+	if (!oList.pHead)
+		return NewAstList(pNode);
+
+	oList.pTail->pNext = pNode;
+	oList.pTail = pNode;
+	while(oList.pTail->pNext)
+		oList.pTail = oList.pTail->pNext;
+	return oList;
+}
+
 int AstLinkLength(AstNode *pFirstNode)
 {
 	int n;
@@ -7,63 +7,112 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <csetjmp>
+#include <ctime>
 
-#define YYLTYPE yyltype
-
-typedef struct YYLTYPE {
-    uint32_t first_line;
-    uint32_t first_column;
-    uint32_t last_line;
-    uint32_t last_column;
-} yyltype;
-
-extern int32_t line_num;  /* declared in scanner.l */
-extern char buffer[];     /* declared in scanner.l */
-extern FILE *yyin;        /* declared by lex */
-extern char *yytext;      /* declared by lex */
-
-static AstNode *root;
-
-extern "C" int yylex(void);
-static void yyerror(const char *msg);
-extern int yylex_destroy(void);
+/* The parser stacks can be relocated and grow past YYINITDEPTH for deeply nested programs,
+   up to YYMAXDEPTH entries. */
+#define YYMAXDEPTH 10000000
 %}
 
 
 %code requires {
-    struct AstNode;
+    #include <cstdio>
+    #include <cstdint>
+    #include "JAST/jast.h"
+
+    /* Locations in 32 bits; YYLTYPE is plain data, so the parser stacks can be relocated. */
+    typedef struct YYLTYPE {
+        uint32_t first_line;
+        uint32_t first_column;
+        uint32_t last_line;
+        uint32_t last_column;
+    } YYLTYPE;
+    #define YYLTYPE_IS_DECLARED 1
+    #define YYLTYPE_IS_TRIVIAL 1
+
+    /* Everything the scanner and parser know about one file, so several files can be compiled at once
+       on different threads. The parser gets it as pCtx and the reentrant scanner keeps it as yyextra. */
+    struct ParseContext {
+        AstNode *pRoot;             /* the program, once it is parsed, also after recovered syntax errors */
+        int nSyntaxErrors;          /* syntax errors and bad characters reported so far */
+        void *pScanner;             /* yyscan_t of the scanner */
+        FILE *fpInput;
+
+        uint32_t line_num;
+        uint32_t col_num;
+        char *buffer;               /* current source line, grown by concatenateString() */
+        size_t buffer_len;
+        size_t buffer_size;
+        char *string_literal;       /* a string literal without its quotes, before it is interned */
+        size_t string_literal_size;
+        uint32_t opt_src;
+        uint32_t opt_tok;
+        uint32_t opt_quiet;         /* set by LexSetQuiet(), overrides //&S+ and //&T+ */
+
+        /* Source lines copied into the arena, or the mapping of the file with --mmap and its line index. */
+        int nSourceLines;
+        size_t nSourceLineBytes;
+        char **ppszSourceLine;
+        const char *pSourceMap;
+        size_t nSourceMapSize;
+        size_t nSourceMapPos;
+        uint32_t *pnLineOffset;     /* start of each line, plus one past the end of the last line */
+        int nLineOffsets;
+    };
 }
 
+%code {
+    extern int yylex(YYSTYPE *yylval, YYLTYPE *yylloc, void *pScanner);
+    extern char *yyget_text(void *pScanner);
+    static void yyerror(YYLTYPE *yylloc, void *pScanner, ParseContext *pCtx, const char *msg);
+    void AbortCompilation(void);
+    extern void LexInit(ParseContext *pCtx);
+    extern void LexDestroy(ParseContext *pCtx);
+    extern bool LexOpenInput(ParseContext *pCtx, const char *pszFile, bool bMmap);
+    extern void LexKeepPartialLine(ParseContext *pCtx);
+    extern void LexSetQuiet(bool quiet);
+}
+
+%define api.pure full
+%lex-param {void *pScanner}
+%parse-param {void *pScanner} {ParseContext *pCtx}
+
     /* For yylval */
 %union {
-    char *identifier;
+    const char *identifier;
     int integer;
     double real;
     bool boolean;
     AstNode *node;
+    AstList list;   /* list under construction, appended at its tail */
+    SymbolValue_t symbol;
 };
 
-%type <identifier> ID INTEGER REAL STRING BOOLEAN STRING_LITERAL
+%type <identifier> ID STRING_LITERAL
 %type <identifier> ASSIGN
 %type <integer> INT_LITERAL
 %type <real> REAL_LITERAL
 %type <boolean> TRUE FALSE NegOrNot
 
-%type <identifier> ProgramName ScalarType FunctionName 
+%type <identifier> ProgramName FunctionName 
+%type <symbol> INTEGER REAL STRING BOOLEAN ScalarType
 
-%type <node> IdList Type ArrType ArrDecl ReturnType 
+%type <node> Type ArrType ReturnType 
 %type <node> IntegerAndReal StringAndBoolean LiteralConstant
 %type <node> VariableReference FunctionInvocation
-%type <node> Expression Expressions ExpressionList
+%type <node> Expression ExpressionList
 %type <node> Simple Condition While For Return FunctionCall
-%type <node> ArrRefs ArrRefList
-%type <node> Statement Statements StatementList CompoundStatement
-%type <node> Declaration Declarations DeclarationList
-%type <node> Function Functions FunctionList 
+%type <node> ArrRefList
+%type <node> Statement StatementList CompoundStatement
+%type <node> Declaration DeclarationList
+%type <node> Function FunctionList 
 %type <node> FunctionDeclaration FunctionDefinition
-%type <node> FormalArg FormalArgs FormalArgList
+%type <node> FormalArg FormalArgList
 %type <node> ElseOrNot
 
+%type <list> IdList ArrDecl ArrRefs Expressions Statements Declarations Functions FormalArgs
+
 
     /* Follow the order in scanner.l */
 
@@ -109,8 +158,7 @@ Program:
     DeclarationList FunctionList CompoundStatement
     /*  End of ProgramBody */
     END {
-        root = NewProgramNode(@1.first_line, @1.first_column, $1, $3, $4, $5);
-        free($1);
+        pCtx->pRoot = NewProgramNode(@1.first_line, @1.first_column, $1, $3, $4, $5);
     }
 ;
 
@@ -121,31 +169,35 @@ ProgramName:
 DeclarationList:
     Epsilon { $$ = NULL; }
     |
-    Declarations
+    Declarations { $$ = $1.pHead; }
 ;
 
 Declarations:
-    Declaration 
+    Declaration { $$ = NewAstList($1); }
     |
-    Declarations Declaration { $$ = AddSiblingNode($1, $2); }
+    Declarations Declaration { $$ = AppendAstList($1, $2); }
 ;
 
 FunctionList:
     Epsilon { $$ = NULL; }
     |
-    Functions 
+    Functions { $$ = $1.pHead; }
 ;
 
 Functions:
-    Function
+    Function { $$ = NewAstList($1); }
     |
-    Functions Function { $$ = AddSiblingNode($1, $2); }
+    Functions Function { $$ = AppendAstList($1, $2); }
 ;
 
 Function:
     FunctionDeclaration
     |
     FunctionDefinition
+    |
+    /* Recovery: a broken signature is skipped up to the body, which is still parsed for its own errors
+       but left out of the tree with the function. */
+    FunctionName error CompoundStatement END { $$ = NULL; }
 ;
 
 FunctionDeclaration:
@@ -167,23 +219,23 @@ FunctionName:
 FormalArgList:
     Epsilon { $$ = NULL; }
     |
-    FormalArgs
+    FormalArgs { $$ = $1.pHead; }
 ;
 
 FormalArgs:
-    FormalArg
+    FormalArg { $$ = NewAstList($1); }
     |
-    FormalArgs SEMICOLON FormalArg { $$ = AddSiblingNode($1, $3); }
+    FormalArgs SEMICOLON FormalArg { $$ = AppendAstList($1, $3); }
 ;
 
 FormalArg:
-    IdList COLON Type { $$ = NewDeclarationNode_Type(@1.first_line, @1.first_column, $1, $3, "parameter"); }
+    IdList COLON Type { $$ = NewDeclarationNode_Type(@1.first_line, @1.first_column, $1.pHead, $3, kParameter); }
 ;
 
 IdList:
-    ID { $$ = NewIdNode(@1.first_line, @1.first_column, $1); }
+    ID { $$ = NewAstList(NewIdNode(@1.first_line, @1.first_column, $1)); }
     |
-    IdList COMMA ID { $$ = AddSiblingNode($1, NewIdNode(@3.first_line, @3.first_column, $3)); }
+    IdList COMMA ID { $$ = AppendAstList($1, NewIdNode(@3.first_line, @3.first_column, $3)); }
 ;
 
 ReturnType:
@@ -197,9 +249,12 @@ ReturnType:
                                    */
 
 Declaration:
-    VAR IdList COLON Type SEMICOLON { $$ = NewDeclarationNode_Type(@1.first_line, @1.first_column, $2, $4, "variable"); }
+    VAR IdList COLON Type SEMICOLON { $$ = NewDeclarationNode_Type(@1.first_line, @1.first_column, $2.pHead, $4, kVariable); }
+    |
+    VAR IdList COLON LiteralConstant SEMICOLON  { $$ = NewDeclarationNode_LiteralConstant(@1.first_line, @1.first_column, $2.pHead, $4); }
     |
-    VAR IdList COLON LiteralConstant SEMICOLON  { $$ = NewDeclarationNode_LiteralConstant(@1.first_line, @1.first_column, $2, $4); }
+    /* Recovery: skip a broken declaration up to its semicolon. */
+    VAR error SEMICOLON { $$ = NULL; }
 ;
 
 Type:
@@ -219,13 +274,13 @@ ScalarType:
 ;
 
 ArrType:
-    ArrDecl ScalarType { $$ = NewArrTypeNode(@1.first_line, @1.first_column, $1, $2); }
+    ArrDecl ScalarType { $$ = NewArrTypeNode(@1.first_line, @1.first_column, $1.pHead, $2); }
 ;
 
 ArrDecl:
-    ARRAY INT_LITERAL OF { $$ = NewIntValueNode(@1.first_line, @1.first_column, $2); }
+    ARRAY INT_LITERAL OF { $$ = NewAstList(NewIntValueNode(@1.first_line, @1.first_column, $2)); }
     |
-    ArrDecl ARRAY INT_LITERAL OF { $$ = AddSiblingNode($1, NewIntValueNode(@1.first_line, @1.first_column, $3)); }
+    ArrDecl ARRAY INT_LITERAL OF { $$ = AppendAstList($1, NewIntValueNode(@1.first_line, @1.first_column, $3)); }
 ;
 
 LiteralConstant:
@@ -274,6 +329,12 @@ Statement:
     Return
     |
     FunctionCall
+    |
+    /* Recovery: skip a broken statement up to its semicolon, or up to the start of the next statement
+       or the end of the block when the semicolon is missing. */
+    error SEMICOLON { $$ = NULL; }
+    |
+    error { $$ = NULL; }
 ;
 
 CompoundStatement:
@@ -299,13 +360,13 @@ VariableReference:
 ArrRefList:
     Epsilon { $$ = NULL; }
     |
-    ArrRefs
+    ArrRefs { $$ = $1.pHead; }
 ;
 
 ArrRefs:
-    L_BRACKET Expression R_BRACKET { $$ = $2; }
+    L_BRACKET Expression R_BRACKET { $$ = NewAstList($2); }
     |
-    ArrRefs L_BRACKET Expression R_BRACKET { $$ = AddSiblingNode($1, $3); }
+    ArrRefs L_BRACKET Expression R_BRACKET { $$ = AppendAstList($1, $3); }
 ;
 
 Condition:
@@ -358,67 +419,67 @@ FunctionInvocation:
 ExpressionList:
     Epsilon { $$ = NULL; }
     |
-    Expressions
+    Expressions { $$ = $1.pHead; }
 ;
 
 Expressions:
-    Expression
+    Expression { $$ = NewAstList($1); }
     |
-    Expressions COMMA Expression { $$ = AddSiblingNode($1, $3); }
+    Expressions COMMA Expression { $$ = AppendAstList($1, $3); }
 ;
 
 StatementList:
     Epsilon { $$ = NULL; }
     |
-    Statements
+    Statements { $$ = $1.pHead; }
 ;
 
 Statements:
-    Statement
+    Statement { $$ = NewAstList($1); }
     |
-    Statements Statement { $$ = AddSiblingNode($1, $2); }
+    Statements Statement { $$ = AppendAstList($1, $2); }
 ;
 
 Expression:
     L_PARENTHESIS Expression R_PARENTHESIS { $$ = $2; }
     |
-    MINUS Expression %prec UNARY_MINUS { $$ = NewExpressionNode(@1.first_line, @1.first_column, "neg", NULL, $2); }
+    MINUS Expression %prec UNARY_MINUS { $$ = NewExpressionNode(@1.first_line, @1.first_column, kNEG, NULL, $2); }
     |
-    Expression MULTIPLY Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "*", $1, $3); }
+    Expression MULTIPLY Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kMULTIPLY, $1, $3); }
     |
-    Expression DIVIDE Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "/", $1, $3); }
+    Expression DIVIDE Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kDIVIDE, $1, $3); }
     |
-    Expression MOD Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "mod", $1, $3); }
+    Expression MOD Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kMOD, $1, $3); }
     |
-    Expression PLUS Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "+", $1, $3); }
+    Expression PLUS Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kADD, $1, $3); }
     |
-    Expression MINUS Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "-", $1, $3); }
+    Expression MINUS Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kMINUS, $1, $3); }
     |
-    Expression LESS Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "<", $1, $3); }
+    Expression LESS Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kLT, $1, $3); }
     |
-    Expression LESS_OR_EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "<=", $1, $3); }
+    Expression LESS_OR_EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kLE, $1, $3); }
     |
-    Expression GREATER Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, ">", $1, $3); }
+    Expression GREATER Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kGT, $1, $3); }
     |
-    Expression GREATER_OR_EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, ">=", $1, $3); }
+    Expression GREATER_OR_EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kGE, $1, $3); }
     |
-    Expression EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "=", $1, $3); }
+    Expression EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kEQ, $1, $3); }
     |
-    Expression NOT_EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "<>", $1, $3); }
+    Expression NOT_EQUAL Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kNE, $1, $3); }
     |
-    NOT Expression { $$ = NewExpressionNode(@1.first_line, @1.first_column, "not", NULL, $2); }
+    NOT Expression { $$ = NewExpressionNode(@1.first_line, @1.first_column, kNOT, NULL, $2); }
     |
-    Expression AND Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "and", $1, $3); }
+    Expression AND Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kAND, $1, $3); }
     |
-    Expression OR Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, "or", $1, $3); }
+    Expression OR Expression { $$ = NewExpressionNode(@2.first_line, @2.first_column, kOR, $1, $3); }
     |
-    IntegerAndReal { $$ = NewExpressionNode(@1.first_line, @1.first_column, "constant", $1, NULL); }
+    IntegerAndReal { $$ = NewOperandNode(@1.first_line, @1.first_column, kExprConstant, $1); }
     |
-    StringAndBoolean { $$ = NewExpressionNode(@1.first_line, @1.first_column, "constant", $1, NULL); }
+    StringAndBoolean { $$ = NewOperandNode(@1.first_line, @1.first_column, kExprConstant, $1); }
     |
-    VariableReference { $$ = NewExpressionNode(@1.first_line, @1.first_column, "VariableReference", $1, NULL); }
+    VariableReference { $$ = NewOperandNode(@1.first_line, @1.first_column, kExprVariableRef, $1); }
     |
-    FunctionInvocation { $$ = NewExpressionNode(@1.first_line, @1.first_column, "FunctionInvocation", $1, NULL); }
+    FunctionInvocation { $$ = NewOperandNode(@1.first_line, @1.first_column, kExprFunctionInvocation, $1); }
 ;
 
     /*
@@ -429,47 +490,321 @@ Epsilon:
 
 %%
 
-void yyerror(const char *msg) {
-    fprintf(stderr,
-            "\n"
-            "|-----------------------------------------------------------------"
-            "---------\n"
-            "| Error found in Line #%d: %s\n"
-            "|\n"
-            "| Unmatched token: %s\n"
-            "|-----------------------------------------------------------------"
-            "---------\n",
-            line_num, buffer, yytext);
+// Report a syntax error; the parser then recovers at the next statement, declaration or function
+// if it can, so one run reports the errors of the whole file.
+static void yyerror(YYLTYPE *yylloc, void *pScanner, ParseContext *pCtx, const char *msg) {
+    pCtx->nSyntaxErrors++;
+    // Written with the semantic errors in line order, the box quotes the line up to the token.
+    Diag_Report(pCtx->line_num, yylloc->first_column, kDiagSyntax, yyget_text(pScanner), pCtx->buffer);
+}
+
+// Options that apply to every compiled file.
+struct CompileOptions {
+    bool bDumpAst;
+    bool bMmap;
+    bool bLoadAst;
+    const char *pszSaveAst;
+    const char *pszEmitBytecode;
+    bool bDumpBytecode;
+    const char *pszEmitAsm;
+    const char *pszNative;
+    bool bRun;
+};
+
+// Result of compiling one file of a batch.
+struct UnitResult {
+    double dParseMs;        // scanning and parsing, or loading the AST.
+    double dCheckMs;        // semantic analysis.
+    int nSyntaxErr;         // syntax errors the parser recovered from.
+    int nErr;               // semantic errors.
+    bool bAborted;          // stopped at an unreadable file or a syntax error the parser could not recover from.
+    bool bRunFailed;        // --run stopped at a runtime error.
+};
+
+// A file of a batch, with its output kept apart while the batch is compiled on several threads.
+struct BatchUnit {
+    char *pszFile;
+    UnitResult oResult;
+    OutCapture oOutput;
+};
+
+struct BatchJob {
+    BatchUnit *pUnits;
+    const CompileOptions *pOptions;
+};
+
+// A fatal error in a batch unit jumps back to run_unit() instead of exiting the process.
+// Every thread compiles its own files, so these are per thread.
+static thread_local jmp_buf g_oUnitAbort;
+static thread_local bool g_bUnitAbortArmed = false;
+static thread_local struct timespec g_oUnitStart;   // start of the unit, for the time of an aborted one.
+
+// Stop compiling the current file after a fatal error, e.g. a syntax error.
+void AbortCompilation(void) {
+    if (g_bUnitAbortArmed)
+        longjmp(g_oUnitAbort, 1);
+    Diag_Flush();
     exit(-1);
 }
 
-int main(int argc, const char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: ./parser <filename> [--dump-ast]\n");
-        exit(-1);
+static double elapsed_ms(const struct timespec *pStart) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - pStart->tv_sec) * 1e3 + (now.tv_nsec - pStart->tv_nsec) / 1e6;
+}
+
+// Release the per-file state, so the next file on this thread starts from scratch.
+static void release_unit(ParseContext *pCtx) {
+    Diag_Flush(); // quotes the source lines, before they go away.
+    LexDestroy(pCtx);
+    SymTab_Release();
+    StrPool_Release();
+    Arena_Release(); // all AST nodes, bodies and strings go away here.
+    OutBuf_Flush();
+}
+
+// Scan, parse and check one file with a context from LexInit(); its output goes to stdout as if it was compiled on its own.
+static void compile_unit(ParseContext *pCtx, const char *pszFile, const CompileOptions *pOptions, UnitResult *pResult) {
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &g_oUnitStart);
+    Diag_SetFile(pszFile);
+    if (pOptions->bLoadAst) {
+        pCtx->pRoot = AstBin_Load(pszFile);
+        if (pCtx->pRoot == NULL)
+            AbortCompilation();
+    } else {
+        if (!LexOpenInput(pCtx, pszFile, pOptions->bMmap)) {
+            OutBuf_ErrPrintf("fopen() failed:: %s\n", strerror(errno));
+            if (g_bUnitAbortArmed)
+                AbortCompilation(); // a batch must not read stdin instead.
+        }
+        // After recovered syntax errors the tree lacks the broken parts but is still checked,
+        // without a program there is nothing to check.
+        yyparse(pCtx->pScanner, pCtx);
+        if (pCtx->pRoot == NULL) {
+            LexKeepPartialLine(pCtx);
+            AbortCompilation();
+        }
+    }
+    pResult->dParseMs = elapsed_ms(&g_oUnitStart);
+    pResult->nSyntaxErr = pCtx->nSyntaxErrors;
+
+    if (pOptions->pszSaveAst) {
+        if (pCtx->nSyntaxErrors) {
+            OutBuf_ErrPrintf("%s: not saved after syntax errors\n", pOptions->pszSaveAst);
+        } else if (AstBin_Save(pCtx->pRoot, pOptions->pszSaveAst) != 0)
+            AbortCompilation();
     }
 
-    yyin = fopen(argv[1], "r");
-    if (yyin == NULL) {
-        perror("fopen() failed:");
+    if (pOptions->bDumpAst) {
+        PrintAstNode(pCtx->pRoot, 0); //DBG : print for hw4 developing
     }
 
-    yyparse();
+    if (pCtx->nSyntaxErrors == 0) {
+        OutBuf_Printf("\n"
+               "|--------------------------------|\n"
+               "|  There is no syntactic error!  |\n"
+               "|--------------------------------|\n");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    SymTab_Init();
+    pResult->nErr = VisitAstNode(pCtx->pRoot);
+    pResult->dCheckMs = elapsed_ms(&start);
+
+    // Only a program without errors has the bindings code generation needs.
+    if (pOptions->pszEmitBytecode || pOptions->bDumpBytecode || pOptions->pszEmitAsm || pOptions->pszNative) {
+        if (pCtx->nSyntaxErrors || pResult->nErr) {
+            OutBuf_ErrPrintf("bytecode: not generated after errors\n");
+        } else if (ByteCode_Generate(pCtx->pRoot) == 0) {
+            if (pOptions->bDumpBytecode)
+                ByteCode_Dump();
+            if (pOptions->pszEmitBytecode && ByteCode_Save(pOptions->pszEmitBytecode) != 0)
+                AbortCompilation();
+            if (pOptions->pszEmitAsm && Native_EmitAsm(pOptions->pszEmitAsm) != 0)
+                AbortCompilation();
+            if (pOptions->pszNative && Native_Build(pOptions->pszNative) != 0)
+                AbortCompilation();
+        }
+        ByteCode_Release();
+    }
 
-    if (argc >= 3 && strcmp(argv[2], "--dump-ast") == 0) {
-        PrintAstNode(root, 0); //DBG : print for hw4 developing
+    pResult->bRunFailed = false;
+    if (pOptions->bRun) {
+        if (pCtx->nSyntaxErrors || pResult->nErr)
+            OutBuf_ErrPrintf("run: not run after errors\n");
+        else
+            pResult->bRunFailed = Eval_Run(pCtx->pRoot) != 0;
     }
+}
 
-    printf("\n"
-           "|--------------------------------|\n"
-           "|  There is no syntactic error!  |\n"
-           "|--------------------------------|\n");
+// Compile one file of a batch on this thread, a fatal error only stops this file.
+static void run_unit(const char *pszFile, const CompileOptions *pOptions, UnitResult *pResult) {
+    ParseContext oCtx;
+
+    memset(pResult, 0, sizeof(*pResult));
+    LexInit(&oCtx);
+    g_bUnitAbortArmed = true;
+    if (setjmp(g_oUnitAbort) == 0)
+        compile_unit(&oCtx, pszFile, pOptions, pResult);
+    else {
+        pResult->bAborted = true;
+        pResult->dParseMs = elapsed_ms(&g_oUnitStart);
+    }
+    g_bUnitAbortArmed = false;
+    release_unit(&oCtx);
+}
 
-    SymTab_Init();
-    VisitAstNode(root);
+// Compile one file of a batch on a worker thread, keeping its output to be written in list order.
+static void batch_unit(int nItem, void *pArg) {
+    BatchJob *pJob = (BatchJob *)pArg;
+    BatchUnit *pUnit = &pJob->pUnits[nItem];
+
+    OutBuf_BeginCapture();
+    run_unit(pUnit->pszFile, pJob->pOptions, &pUnit->oResult);
+    OutBuf_TakeCapture(&pUnit->oOutput);
+}
+
+static void batch_thread(bool bStart, void *pArg) {
+    if (!bStart) {
+        Diag_Release();
+        OutBuf_Release();
+    }
+}
+
+// Compile every file named in the list file, one per line, in this process, then report the
+// time each one took on stderr. With --jobs the files are compiled on that many threads at once,
+// and their output is written in list order as if they were compiled one after the other.
+// Return the number of files that had syntax errors or stopped at a fatal error.
+static int compile_batch(const char *pszList, const CompileOptions *pOptions) {
+    FILE *fp = fopen(pszList, "r");
+    char *pszLine = NULL;
+    size_t nSize = 0, nUnitsSize = 0;
+    ssize_t nLeng;
+    int i, nAborted = 0, nSyntax = 0, nFiles = 0;
+    double dTotalMs = 0;
+    BatchUnit *pUnits = NULL;
+    BatchJob oJob;
+    bool bParallel;
+
+    if (fp == NULL) {
+        perror("fopen() failed:");
+        return 1;
+    }
+    while ((nLeng = getline(&pszLine, &nSize, fp)) >= 0) {
+        while (nLeng > 0 && (pszLine[nLeng - 1] == '\n' || pszLine[nLeng - 1] == '\r'))
+            pszLine[--nLeng] = '\0';
+        if (nLeng == 0 || pszLine[0] == '#')
+            continue;
+        if ((nFiles + 1) * sizeof(BatchUnit) > nUnitsSize) {
+            nUnitsSize = nUnitsSize ? nUnitsSize * 2 : 64 * sizeof(BatchUnit);
+            pUnits = (BatchUnit *)realloc(pUnits, nUnitsSize);
+        }
+        memset(&pUnits[nFiles], 0, sizeof(BatchUnit));
+        pUnits[nFiles++].pszFile = strdup(pszLine);
+    }
+    free(pszLine);
+    fclose(fp);
+
+    // The incremental cache is one for the whole process, with it the files go one after the other.
+    bParallel = nFiles > 1 && WorkPool_GetJobs() > 1 && !IncCache_IsOpen();
+    if (bParallel) {
+        oJob.pUnits = pUnits;
+        oJob.pOptions = pOptions;
+        WorkPool_Run(nFiles, batch_unit, batch_thread, &oJob);
+    }
+    for (i = 0; i < nFiles; i++) {
+        UnitResult *pResult = &pUnits[i].oResult;
+
+        if (bParallel)
+            OutBuf_EmitCapture(&pUnits[i].oOutput);
+        else
+            run_unit(pUnits[i].pszFile, pOptions, pResult);
+
+        nAborted += pResult->bAborted;
+        nSyntax += !pResult->bAborted && pResult->nSyntaxErr;
+        dTotalMs += pResult->dParseMs + pResult->dCheckMs;
+        if (pResult->bAborted)
+            OutBuf_ErrPrintf("[batch] %10.3f ms parse %10s check  aborted   %s\n", pResult->dParseMs, "-", pUnits[i].pszFile);
+        else if (pResult->nSyntaxErr)
+            OutBuf_ErrPrintf("[batch] %10.3f ms parse %10.3f ms check  %d syntax errors, %d errors  %s\n",
+                             pResult->dParseMs, pResult->dCheckMs, pResult->nSyntaxErr, pResult->nErr, pUnits[i].pszFile);
+        else
+            OutBuf_ErrPrintf("[batch] %10.3f ms parse %10.3f ms check  %d errors  %s\n", pResult->dParseMs, pResult->dCheckMs, pResult->nErr, pUnits[i].pszFile);
+        free(pUnits[i].pszFile);
+    }
+    OutBuf_ErrPrintf("[batch] %d files, %d with syntax errors, %d aborted, %.3f ms\n", nFiles, nSyntax, nAborted, dTotalMs);
+    free(pUnits);
+    return nSyntax + nAborted;
+}
+
+int main(int argc, const char *argv[]) {
+    CompileOptions oOptions = {false, false, false, NULL, NULL, false, NULL, NULL, false};
+    UnitResult oResult;
+    bool bBatch = false;
+    const char *pszIncCache = NULL;
+    int nRet = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: ./parser <filename> [--dump-ast] [--mmap] [--quiet] [--save-ast <file>] [--load-ast] [--incremental <cache>] [--jobs <n>] [--batch] [--diag-json] [--emit-bytecode <file>] [--dump-bytecode] [--emit-asm <file>] [--native <file>] [--run]\n");
+        exit(-1);
+    }
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--dump-ast") == 0)
+            oOptions.bDumpAst = true;
+        else if (strcmp(argv[i], "--mmap") == 0)
+            oOptions.bMmap = true;
+        else if (strcmp(argv[i], "--quiet") == 0)
+            LexSetQuiet(true); // no source echo or token trace, even with //&S+ or //&T+.
+        else if (strcmp(argv[i], "--save-ast") == 0 && i + 1 < argc)
+            oOptions.pszSaveAst = argv[++i];
+        else if (strcmp(argv[i], "--load-ast") == 0)
+            oOptions.bLoadAst = true; // <filename> is an AST file from --save-ast, no scanning or parsing.
+        else if (strcmp(argv[i], "--incremental") == 0 && i + 1 < argc)
+            pszIncCache = argv[++i]; // reuse the checks of function bodies unchanged since the last run.
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+            WorkPool_SetJobs(atoi(argv[++i])); // check function bodies, or the files of a batch, on n threads, 0 for all cores.
+        else if (strcmp(argv[i], "--batch") == 0)
+            bBatch = true; // <filename> lists the files to compile, one per line.
+        else if (strcmp(argv[i], "--diag-json") == 0)
+            Diag_SetJson(true); // errors as JSON lines on stderr, for editors and other tools.
+        else if (strcmp(argv[i], "--emit-bytecode") == 0 && i + 1 < argc)
+            oOptions.pszEmitBytecode = argv[++i]; // write the bytecode of a program without errors, for pvm.
+        else if (strcmp(argv[i], "--dump-bytecode") == 0)
+            oOptions.bDumpBytecode = true;
+        else if (strcmp(argv[i], "--emit-asm") == 0 && i + 1 < argc)
+            oOptions.pszEmitAsm = argv[++i]; // x86-64 assembly of a program without errors, for GNU as.
+        else if (strcmp(argv[i], "--native") == 0 && i + 1 < argc)
+            oOptions.pszNative = argv[++i]; // an executable of a program without errors, built with cc.
+        else if (strcmp(argv[i], "--run") == 0)
+            oOptions.bRun = true; // interpret a program without errors straight from its AST.
+    }
+    if (bBatch && oOptions.pszSaveAst) {
+        fprintf(stderr, "--save-ast takes a single file, not a --batch\n");
+        exit(-1);
+    }
+    if (bBatch && (oOptions.pszEmitBytecode || oOptions.bDumpBytecode || oOptions.pszEmitAsm || oOptions.pszNative || oOptions.bRun)) {
+        fprintf(stderr, "--emit-bytecode, --dump-bytecode, --emit-asm, --native and --run take a single file, not a --batch\n");
+        exit(-1);
+    }
 
-    delete root;
-    fclose(yyin);
-    yylex_destroy();
-    return 0;
+    if (pszIncCache)
+        IncCache_Open(pszIncCache);
+    if (bBatch) {
+        nRet = compile_batch(argv[1], &oOptions) ? -1 : 0;
+    } else {
+        ParseContext oCtx;
+
+        LexInit(&oCtx);
+        compile_unit(&oCtx, argv[1], &oOptions, &oResult);
+        release_unit(&oCtx);
+        nRet = oResult.nSyntaxErr ? -1 : oResult.bRunFailed ? 1 : 0;
+    }
+    IncCache_Save();
+    IncCache_Release();
+    Diag_Release();
+    OutBuf_Release();
+    return nRet;
 }
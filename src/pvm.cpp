@@ -0,0 +1,1258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "JAST/bytecode.h"
+
+// pvm: run the bytecode the parser writes with --emit-bytecode, see include/JAST/bytecode.h.
+//
+// The file is loaded and verified once: every register operand is inside its function's frame, every
+// constant, global and jump target exists, and every function ends in a jump or return, so the
+// dispatch loop checks nothing but array indices (CheckIndex), division by zero and stack overflow.
+// Instructions are dispatched with computed goto, registers are untyped 8-byte values that the typed
+// instructions read as int, double or pointer, and all frames live in one register stack and one
+// array stack, a call only moves the frame base.
+//
+// With --jit, functions called often enough are compiled to x86-64 machine code in memory and run
+// from then on without the dispatch loop, on the same stacks, see JIT below.
+
+// Values of SymbolValue_t in jast.h the loader needs, pvm does not link the AST library.
+#define PVM_VOID			10
+
+#define PVM_STACK_REGS		(1 << 22)		// registers of all frames.
+#define PVM_STACK_CELLS		(1 << 22)		// cells of the local arrays of all frames.
+#define PVM_MAX_DEPTH		(1 << 20)		// nested calls.
+#define PVM_C_STACK_SPARE	(1 << 20)		// bytes of C stack left to the C library.
+#define PVM_C_STACK_MAX		(256 << 20)		// bytes of C stack calls through machine code may take without a stack limit.
+#define PVM_JIT_THRESHOLD	100				// calls of a function before --jit compiles it.
+
+struct Program {
+	BcHeader oHeader;
+	BcFunction *pFuncs;
+	double *pReals;
+	char *pStrings;
+	BcInst *pCode;
+	int32_t *pLines;
+};
+
+struct Frame {
+	const BcInst *pReturn;		// instruction after the call.
+	const BcFunction *pFunc;	// the caller.
+	BcValue *pRegs;				// registers of the caller.
+	BcValue *pArrays;			// array area of the caller.
+};
+
+typedef void (*JitCode)(BcValue *pRegs, BcValue *pArrays);
+
+static const Program *g_pProgram = NULL;
+
+// State of the run, shared by the interpreter loops and the machine code.
+static BcValue *g_pStackEnd = NULL, *g_pArrayEnd = NULL;
+static BcValue *g_pGlobals = NULL, *g_pGlobalCells = NULL;
+static Frame *g_pFrame = NULL, *g_pFrameEnd = NULL;		// first free frame.
+static char *g_pCStack = NULL;			// C stack at run(), calls through machine code recurse below it.
+static size_t g_nCStack = 0;			// bytes of C stack below it they may take.
+static uint32_t g_nJitThreshold = 0;	// 0 without --jit.
+static uint32_t *g_pJitCalls = NULL;	// calls of every function so far.
+static JitCode *g_ppJitCode = NULL;		// machine code of every function, NULL until it is compiled.
+static size_t *g_pJitBytes = NULL;		// bytes mapped for it.
+
+// ----------------------------------------------------------------
+// Errors
+// ----------------------------------------------------------------
+
+// Stop the program at a runtime error of the instruction at pc.
+static void runtime_error(const BcInst *pc, const char *format, ...) __attribute__((format(printf, 2, 3), noreturn));
+static void runtime_error(const BcInst *pc, const char *format, ...)
+{
+	va_list args;
+
+	fflush(stdout);
+	fprintf(stderr, "pvm: line %d: ", g_pProgram->pLines[pc - g_pProgram->pCode]);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static bool load_error(const char *pszFile, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static bool load_error(const char *pszFile, const char *format, ...)
+{
+	va_list args;
+
+	fprintf(stderr, "pvm: %s: ", pszFile);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+	return false;
+}
+
+// ----------------------------------------------------------------
+// Loading and verification
+// ----------------------------------------------------------------
+
+static bool read_part(FILE *fp, void **pp, size_t nSize, size_t nCount)
+{
+	*pp = malloc(nSize * nCount + 1);
+	return *pp && fread(*pp, nSize, nCount, fp) == nCount;
+}
+
+// Check the instructions of function j, see the operands in bytecode.h.
+static bool verify_function(const char *pszFile, const Program *pProg, int j)
+{
+	const BcHeader *pHeader = &pProg->oHeader;
+	const BcFunction *pFunc = &pProg->pFuncs[j];
+	int nEnd = (j + 1 < pHeader->nFuncs) ? pProg->pFuncs[j + 1].nEntry : pHeader->nInsts;
+	int nRegs = pFunc->nRegs, nTarget, i;
+	const BcInst *p;
+	bool bOk;
+
+	if (pFunc->nEntry < 0 || pFunc->nEntry >= nEnd || nEnd > pHeader->nInsts || nRegs < pFunc->nParams || nRegs > BC_MAX_REGS
+	 || pFunc->nArrayCells < 0 || pFunc->nName < 0 || pFunc->nName >= pHeader->nStringBytes)
+		return load_error(pszFile, "function %d is broken", j);
+	for(i = pFunc->nEntry; i < nEnd; i++){
+		p = &pProg->pCode[i];
+		switch(p->nOp){
+		case kBcNop: case kBcHalt: case kBcReturnVoid:
+			bOk = true;
+			break;
+		case kBcJump:
+			nTarget = i + 1 + p->imm;
+			bOk = nTarget >= pFunc->nEntry && nTarget < nEnd;
+			break;
+		case kBcJumpTrue: case kBcJumpFalse:
+			nTarget = i + 1 + p->imm;
+			bOk = p->a < nRegs && nTarget >= pFunc->nEntry && nTarget < nEnd;
+			break;
+		case kBcLoadInt: case kBcCheckIndex: case kBcClearArray:
+		case kBcReturn: case kBcPrintInt: case kBcPrintReal: case kBcPrintBool: case kBcPrintStr:
+		case kBcReadInt: case kBcReadReal: case kBcReadBool: case kBcReadStr:
+			bOk = p->a < nRegs;
+			break;
+		case kBcLoadReal:
+			bOk = p->a < nRegs && p->imm >= 0 && p->imm < pHeader->nReals;
+			break;
+		case kBcLoadStr:
+			bOk = p->a < nRegs && p->imm >= 0 && p->imm < pHeader->nStringBytes;
+			break;
+		case kBcGetGlobal: case kBcSetGlobal:
+			bOk = p->a < nRegs && p->imm >= 0 && p->imm < pHeader->nGlobals;
+			break;
+		case kBcLocalArray:
+			bOk = p->a < nRegs && p->imm >= 0 && p->imm <= pFunc->nArrayCells;
+			break;
+		case kBcGlobalArray:
+			bOk = p->a < nRegs && p->imm >= 0 && p->imm <= pHeader->nGlobalCells;
+			break;
+		case kBcMove: case kBcNegInt: case kBcNegReal: case kBcIntToReal: case kBcNot: case kBcAddIntK:
+			bOk = p->a < nRegs && p->b < nRegs;
+			break;
+		case kBcCall:
+			bOk = p->b > 0 && p->b < pHeader->nFuncs && pProg->pFuncs[p->b].nParams == p->c
+				&& p->a + (p->c ? p->c : 1) <= nRegs;
+			break;
+		default:
+			bOk = p->nOp < kBcOps && p->a < nRegs && p->b < nRegs && p->c < nRegs;
+			break;
+		}
+		if (!bOk)
+			return load_error(pszFile, "bad instruction %d in function %d", i, j);
+	}
+	// The last instruction does not fall through into the next function.
+	p = &pProg->pCode[nEnd - 1];
+	if (p->nOp != kBcHalt && p->nOp != kBcReturn && p->nOp != kBcReturnVoid && p->nOp != kBcJump)
+		return load_error(pszFile, "function %d runs off its end", j);
+	return true;
+}
+
+static void release_program(Program *pProg)
+{
+	free(pProg->pFuncs);
+	free(pProg->pReals);
+	free(pProg->pStrings);
+	free(pProg->pCode);
+	free(pProg->pLines);
+}
+
+static bool load_program(const char *pszFile, Program *pProg)
+{
+	BcHeader *pHeader = &pProg->oHeader;
+	FILE *fp;
+	bool bOk;
+	int j;
+
+	if (!(fp = fopen(pszFile, "rb")))
+		return load_error(pszFile, "cannot open");
+	bOk = fread(pHeader, sizeof(*pHeader), 1, fp) == 1 && memcmp(pHeader->pszMagic, BC_MAGIC, 4) == 0;
+	if (bOk && pHeader->nVersion != BC_VERSION){
+		fclose(fp);
+		return load_error(pszFile, "bytecode version %d, pvm runs version %d", pHeader->nVersion, BC_VERSION);
+	}
+	bOk = bOk && pHeader->nFuncs > 0 && pHeader->nGlobals >= 0 && pHeader->nGlobalCells >= 0 && pHeader->nReals >= 0
+		&& pHeader->nStringBytes > 0 && pHeader->nInsts > 0
+		&& read_part(fp, (void **)&pProg->pFuncs, sizeof(BcFunction), pHeader->nFuncs)
+		&& read_part(fp, (void **)&pProg->pReals, sizeof(double), pHeader->nReals)
+		&& read_part(fp, (void **)&pProg->pStrings, 1, pHeader->nStringBytes)
+		&& read_part(fp, (void **)&pProg->pCode, sizeof(BcInst), pHeader->nInsts)
+		&& read_part(fp, (void **)&pProg->pLines, sizeof(int32_t), pHeader->nInsts);
+	fclose(fp);
+	if (!bOk || pProg->pStrings[pHeader->nStringBytes - 1] != '\0')
+		return load_error(pszFile, "not a bytecode file");
+	if (pProg->pFuncs[0].nEntry != 0 || pProg->pFuncs[0].nParams != 0 || pProg->pFuncs[0].nReturnType != PVM_VOID)
+		return load_error(pszFile, "no program body");
+	for(j = 0; j < pHeader->nFuncs; j++){
+		if (!verify_function(pszFile, pProg, j))
+			return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------
+// Input and output
+// ----------------------------------------------------------------
+
+// Shared by the interpreter and by the machine code of hot functions, which calls them.
+
+// Read a word separated by white space, NULL at the end of input. It lives until the program ends.
+static char *read_word()
+{
+	char *psz = NULL;
+
+	if (scanf("%ms", &psz) != 1)
+		return NULL;
+	return psz;
+}
+
+static int32_t read_int(const BcInst *pc)
+{
+	int32_t n;
+
+	fflush(stdout);
+	if (scanf("%d", &n) != 1)
+		runtime_error(pc, "cannot read an integer");
+	return n;
+}
+
+static double read_real(const BcInst *pc)
+{
+	double d;
+
+	fflush(stdout);
+	if (scanf("%lf", &d) != 1)
+		runtime_error(pc, "cannot read a real");
+	return d;
+}
+
+static int32_t read_bool(const BcInst *pc)
+{
+	char *psz;
+	int32_t n;
+
+	fflush(stdout);
+	if (!(psz = read_word()) || (strcmp(psz, "true") != 0 && strcmp(psz, "false") != 0))
+		runtime_error(pc, "cannot read a boolean");
+	n = (strcmp(psz, "true") == 0);
+	free(psz);
+	return n;
+}
+
+static const char *read_str(const BcInst *pc)
+{
+	char *psz;
+
+	fflush(stdout);
+	if (!(psz = read_word()))
+		runtime_error(pc, "cannot read a string");
+	return psz;
+}
+
+static void print_int(int32_t n)
+{
+	printf("%d\n", n);
+}
+
+static void print_real(double d)
+{
+	printf("%f\n", d);
+}
+
+static void print_bool(int32_t n)
+{
+	fputs(n ? "true\n" : "false\n", stdout);
+}
+
+static void print_str(const char *psz)
+{
+	fputs(psz ? psz : "", stdout);
+	fputc('\n', stdout);
+}
+
+// Strings made at run time live until the program ends.
+static const char *concat(const char *pszL, const char *pszR)
+{
+	size_t nL;
+	char *psz;
+
+	pszL = pszL ? pszL : "";
+	pszR = pszR ? pszR : "";
+	nL = strlen(pszL);
+	psz = (char *)malloc(nL + strlen(pszR) + 1);
+	memcpy(psz, pszL, nL);
+	strcpy(psz + nL, pszR);
+	return psz;
+}
+
+// ----------------------------------------------------------------
+// Calls between the tiers
+// ----------------------------------------------------------------
+
+static void interpret(const BcFunction *pFunc, BcValue *r, BcValue *pArrays);
+static bool jit_compile(int nFunc);
+
+// Count a call of function nFunc, true when it has machine code. It is compiled at its g_nJitThreshold'th call.
+static inline bool jit_hot(int nFunc)
+{
+	return g_ppJitCode[nFunc] || (++g_pJitCalls[nFunc] == g_nJitThreshold && jit_compile(nFunc));
+}
+
+// Run the call at pc with the callee's frame at pArgs and its local arrays at pArrays, in machine code
+// if the callee has some, or else in a new interpreter loop. Both recurse on the C stack.
+static void call_function(const BcInst *pc, BcValue *pArgs, BcValue *pArrays)
+{
+	const BcFunction *pCallee = &g_pProgram->pFuncs[pc->b];
+
+	if (pArgs + pCallee->nRegs > g_pStackEnd || pArrays + pCallee->nArrayCells > g_pArrayEnd
+	 || (size_t)(g_pCStack - (char *)__builtin_frame_address(0)) > g_nCStack)
+		runtime_error(pc, "stack overflow");
+	if (g_ppJitCode[pc->b])
+		g_ppJitCode[pc->b](pArgs, pArrays);
+	else
+		interpret(pCallee, pArgs, pArrays);
+}
+
+// Calls out of machine code, counted like the calls of the interpreter.
+static void jit_call(BcValue *pArgs, BcValue *pArrays, const BcInst *pc)
+{
+	jit_hot(pc->b);
+	call_function(pc, pArgs, pArrays);
+}
+
+static void jit_index_error(const BcInst *pc, int32_t n)
+{
+	runtime_error(pc, "array index %d out of range [0, %d)", n, pc->imm);
+}
+
+static void jit_division_error(const BcInst *pc)
+{
+	runtime_error(pc, "division by zero");
+}
+
+static void jit_stack_error(const BcInst *pc)
+{
+	runtime_error(pc, "stack overflow");
+}
+
+// ----------------------------------------------------------------
+// Interpreter
+// ----------------------------------------------------------------
+
+// Arithmetic wraps around like the 32-bit registers of a machine, without undefined behaviour.
+#define WRAP(a, op, b)		((int32_t)((uint32_t)(a) op (uint32_t)(b)))
+
+// Run function pFunc with its frame at r and its local arrays at pArrays until it returns, or the program
+// body until it halts. Calls of functions without machine code stay in the loop, on the frame stack.
+static void interpret(const BcFunction *pFunc, BcValue *r, BcValue *pArrays)
+{
+	static void *s_ppLabels[kBcOps];
+	const Program *pProg = g_pProgram;
+	const BcInst *pc = pProg->pCode + pFunc->nEntry;
+	const BcFunction *pCallee;
+	BcValue *pStackEnd = g_pStackEnd, *pArrayEnd = g_pArrayEnd, *pGlobals = g_pGlobals, *pGlobalCells = g_pGlobalCells;
+	Frame *pFrame = g_pFrame, *pFrameEnd = g_pFrameEnd;
+	int32_t nDiv;
+
+	if (!s_ppLabels[0]){
+		for(int i = 0; i < kBcOps; i++)
+			s_ppLabels[i] = &&op_bad;
+		s_ppLabels[kBcNop] = &&op_nop;				s_ppLabels[kBcHalt] = &&op_halt;
+		s_ppLabels[kBcMove] = &&op_move;				s_ppLabels[kBcLoadInt] = &&op_loadint;
+		s_ppLabels[kBcLoadReal] = &&op_loadreal;		s_ppLabels[kBcLoadStr] = &&op_loadstr;
+		s_ppLabels[kBcGetGlobal] = &&op_getglobal;	s_ppLabels[kBcSetGlobal] = &&op_setglobal;
+		s_ppLabels[kBcLocalArray] = &&op_localarray;	s_ppLabels[kBcGlobalArray] = &&op_globalarray;
+		s_ppLabels[kBcClearArray] = &&op_cleararray;	s_ppLabels[kBcCheckIndex] = &&op_checkindex;
+		s_ppLabels[kBcLoadElem] = &&op_loadelem;		s_ppLabels[kBcStoreElem] = &&op_storeelem;
+		s_ppLabels[kBcAddInt] = &&op_addint;			s_ppLabels[kBcSubInt] = &&op_subint;
+		s_ppLabels[kBcMulInt] = &&op_mulint;			s_ppLabels[kBcDivInt] = &&op_divint;
+		s_ppLabels[kBcModInt] = &&op_modint;			s_ppLabels[kBcNegInt] = &&op_negint;
+		s_ppLabels[kBcAddIntK] = &&op_addintk;
+		s_ppLabels[kBcAddReal] = &&op_addreal;		s_ppLabels[kBcSubReal] = &&op_subreal;
+		s_ppLabels[kBcMulReal] = &&op_mulreal;		s_ppLabels[kBcDivReal] = &&op_divreal;
+		s_ppLabels[kBcNegReal] = &&op_negreal;		s_ppLabels[kBcIntToReal] = &&op_inttoreal;
+		s_ppLabels[kBcLtInt] = &&op_ltint;			s_ppLabels[kBcLeInt] = &&op_leint;
+		s_ppLabels[kBcEqInt] = &&op_eqint;			s_ppLabels[kBcGeInt] = &&op_geint;
+		s_ppLabels[kBcGtInt] = &&op_gtint;			s_ppLabels[kBcNeInt] = &&op_neint;
+		s_ppLabels[kBcLtReal] = &&op_ltreal;			s_ppLabels[kBcLeReal] = &&op_lereal;
+		s_ppLabels[kBcEqReal] = &&op_eqreal;			s_ppLabels[kBcGeReal] = &&op_gereal;
+		s_ppLabels[kBcGtReal] = &&op_gtreal;			s_ppLabels[kBcNeReal] = &&op_nereal;
+		s_ppLabels[kBcAnd] = &&op_and;				s_ppLabels[kBcOr] = &&op_or;
+		s_ppLabels[kBcNot] = &&op_not;				s_ppLabels[kBcConcat] = &&op_concat;
+		s_ppLabels[kBcJump] = &&op_jump;				s_ppLabels[kBcJumpTrue] = &&op_jumptrue;
+		s_ppLabels[kBcJumpFalse] = &&op_jumpfalse;	s_ppLabels[kBcCall] = &&op_call;
+		s_ppLabels[kBcReturn] = &&op_return;			s_ppLabels[kBcReturnVoid] = &&op_returnvoid;
+		s_ppLabels[kBcPrintInt] = &&op_printint;		s_ppLabels[kBcPrintReal] = &&op_printreal;
+		s_ppLabels[kBcPrintBool] = &&op_printbool;	s_ppLabels[kBcPrintStr] = &&op_printstr;
+		s_ppLabels[kBcReadInt] = &&op_readint;		s_ppLabels[kBcReadReal] = &&op_readreal;
+		s_ppLabels[kBcReadBool] = &&op_readbool;		s_ppLabels[kBcReadStr] = &&op_readstr;
+	}
+
+	// The frame of the entry has no return instruction, returning from it leaves the loop.
+	if (pFrame == pFrameEnd)
+		runtime_error(pc, "stack overflow");
+	pFrame->pReturn = NULL;
+	pFrame++;
+
+#define A		r[pc->a]
+#define B		r[pc->b]
+#define C		r[pc->c]
+#define NEXT()	goto *s_ppLabels[(++pc)->nOp]
+#define JUMP()	goto *s_ppLabels[(pc += 1 + pc->imm)->nOp]
+
+	goto *s_ppLabels[pc->nOp];
+
+op_bad:
+	runtime_error(pc, "bad instruction %d", pc->nOp);
+op_nop:
+	NEXT();
+op_halt:
+	g_pFrame = pFrame - 1;
+	return;
+op_move:
+	A = B;
+	NEXT();
+op_loadint:
+	A.raw = pc->imm;
+	NEXT();
+op_loadreal:
+	A.d = pProg->pReals[pc->imm];
+	NEXT();
+op_loadstr:
+	A.psz = pProg->pStrings + pc->imm;
+	NEXT();
+op_getglobal:
+	A = pGlobals[pc->imm];
+	NEXT();
+op_setglobal:
+	pGlobals[pc->imm] = A;
+	NEXT();
+op_localarray:
+	A.p = pArrays + pc->imm;
+	NEXT();
+op_globalarray:
+	A.p = pGlobalCells + pc->imm;
+	NEXT();
+op_cleararray:
+	memset(A.p, 0, pc->imm * sizeof(BcValue));
+	NEXT();
+op_checkindex:
+	if ((uint32_t)A.n >= (uint32_t)pc->imm)
+		runtime_error(pc, "array index %d out of range [0, %d)", A.n, pc->imm);
+	NEXT();
+op_loadelem:
+	A = B.p[C.n];
+	NEXT();
+op_storeelem:
+	A.p[B.n] = C;
+	NEXT();
+
+op_addint:
+	A.n = WRAP(B.n, +, C.n);
+	NEXT();
+op_subint:
+	A.n = WRAP(B.n, -, C.n);
+	NEXT();
+op_mulint:
+	A.n = WRAP(B.n, *, C.n);
+	NEXT();
+op_divint:
+	if ((nDiv = C.n) == 0)
+		runtime_error(pc, "division by zero");
+	A.n = (nDiv == -1) ? WRAP(0, -, B.n) : B.n / nDiv;
+	NEXT();
+op_modint:
+	if ((nDiv = C.n) == 0)
+		runtime_error(pc, "division by zero");
+	A.n = (nDiv == -1) ? 0 : B.n % nDiv;
+	NEXT();
+op_negint:
+	A.n = WRAP(0, -, B.n);
+	NEXT();
+op_addintk:
+	A.n = WRAP(B.n, +, (int16_t)pc->c);
+	NEXT();
+
+op_addreal:
+	A.d = B.d + C.d;
+	NEXT();
+op_subreal:
+	A.d = B.d - C.d;
+	NEXT();
+op_mulreal:
+	A.d = B.d * C.d;
+	NEXT();
+op_divreal:
+	A.d = B.d / C.d;
+	NEXT();
+op_negreal:
+	A.d = -B.d;
+	NEXT();
+op_inttoreal:
+	A.d = B.n;
+	NEXT();
+
+op_ltint:	A.n = B.n < C.n;	NEXT();
+op_leint:	A.n = B.n <= C.n;	NEXT();
+op_eqint:	A.n = B.n == C.n;	NEXT();
+op_geint:	A.n = B.n >= C.n;	NEXT();
+op_gtint:	A.n = B.n > C.n;	NEXT();
+op_neint:	A.n = B.n != C.n;	NEXT();
+op_ltreal:	A.n = B.d < C.d;	NEXT();
+op_lereal:	A.n = B.d <= C.d;	NEXT();
+op_eqreal:	A.n = B.d == C.d;	NEXT();
+op_gereal:	A.n = B.d >= C.d;	NEXT();
+op_gtreal:	A.n = B.d > C.d;	NEXT();
+op_nereal:	A.n = B.d != C.d;	NEXT();
+op_and:		A.n = B.n & C.n;	NEXT();
+op_or:		A.n = B.n | C.n;	NEXT();
+op_not:		A.n = !B.n;			NEXT();
+
+op_concat:
+	A.psz = concat(B.psz, C.psz);
+	NEXT();
+
+op_jump:
+	JUMP();
+op_jumptrue:
+	if (A.n)
+		JUMP();
+	NEXT();
+op_jumpfalse:
+	if (!A.n)
+		JUMP();
+	NEXT();
+
+op_call:
+	// The arguments from register a on become the first registers of the callee's frame.
+	pCallee = &pProg->pFuncs[pc->b];
+	if (g_nJitThreshold && jit_hot(pc->b)){
+		g_pFrame = pFrame;
+		call_function(pc, r + pc->a, pArrays + pFunc->nArrayCells);
+		NEXT();
+	}
+	if (pFrame == pFrameEnd || r + pc->a + pCallee->nRegs > pStackEnd || pArrays + pFunc->nArrayCells + pCallee->nArrayCells > pArrayEnd)
+		runtime_error(pc, "stack overflow");
+	pFrame->pReturn = pc + 1;
+	pFrame->pFunc = pFunc;
+	pFrame->pRegs = r;
+	pFrame->pArrays = pArrays;
+	pFrame++;
+	pArrays += pFunc->nArrayCells;
+	r += pc->a;
+	pFunc = pCallee;
+	pc = pProg->pCode + pCallee->nEntry;
+	goto *s_ppLabels[pc->nOp];
+op_return:
+	r[0] = A;
+op_returnvoid:
+	pFrame--;
+	if (!(pc = pFrame->pReturn)){
+		g_pFrame = pFrame;
+		return;
+	}
+	pFunc = pFrame->pFunc;
+	r = pFrame->pRegs;
+	pArrays = pFrame->pArrays;
+	goto *s_ppLabels[pc->nOp];
+
+op_printint:
+	print_int(A.n);
+	NEXT();
+op_printreal:
+	print_real(A.d);
+	NEXT();
+op_printbool:
+	print_bool(A.n);
+	NEXT();
+op_printstr:
+	print_str(A.psz);
+	NEXT();
+
+op_readint:
+	A.n = read_int(pc);
+	NEXT();
+op_readreal:
+	A.d = read_real(pc);
+	NEXT();
+op_readbool:
+	A.n = read_bool(pc);
+	NEXT();
+op_readstr:
+	A.psz = read_str(pc);
+	NEXT();
+
+#undef A
+#undef B
+#undef C
+#undef NEXT
+#undef JUMP
+}
+
+// ----------------------------------------------------------------
+// JIT
+// ----------------------------------------------------------------
+
+// With --jit a function is interpreted up to its g_nJitThreshold'th call, then its bytecode is encoded
+// to x86-64 machine code in pages of its own, writable while the code is written and only executable
+// after. The code keeps every register in the interpreter's frame, rbx points at it and r13 at the local
+// arrays, so a function runs the same in either tier. Calls out of machine code go through jit_call(),
+// except those of functions compiled already, which are bound when the caller is compiled.
+// The program body counts as one call, only --jit-threshold 1 compiles it.
+
+#define JIT_INST_BYTES		160		// most code one instruction is encoded to, with its error path.
+#define JIT_FRAME_BYTES		32		// prologue and epilogue.
+#define JIT_ADDR(x)			((uint64_t)(uintptr_t)(x))
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Condition codes, the opposite of a condition is the code with the lowest bit flipped.
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+// The compares from kBcLtInt on, for ints after cmp b, c and for reals after ucomisd of the operands
+// in the order of jit_real_compare().
+static const int k_pJitIntCc[] = {CC_L, CC_LE, CC_E, CC_GE, CC_G, CC_NE};
+static const int k_pJitRealCc[] = {CC_A, CC_AE, -1, CC_AE, CC_A, -1};
+
+struct JitPatch {
+	size_t nAt;					// rel32 of a jump
+	int nTarget;				// to this instruction of the function, the instruction count for the epilogue.
+};
+
+struct Jit {
+	uint8_t *p;					// code being written
+	size_t n;					// and its size so far.
+	size_t *pOffsets;			// code of every instruction, then of the epilogue.
+	JitPatch *pPatches;
+	int nPatches;
+};
+
+static void jit_byte(Jit *pJit, int n)
+{
+	pJit->p[pJit->n++] = (uint8_t)n;
+}
+
+static void jit_u32(Jit *pJit, uint32_t n)
+{
+	memcpy(pJit->p + pJit->n, &n, sizeof(n));
+	pJit->n += sizeof(n);
+}
+
+static void jit_u64(Jit *pJit, uint64_t n)
+{
+	memcpy(pJit->p + pJit->n, &n, sizeof(n));
+	pJit->n += sizeof(n);
+}
+
+static void jit_opcode(Jit *pJit, int nPrefix, bool bWide, int nOpcode, int nReg, int nRm)
+{
+	int nRex = 0x40 | (bWide ? 8 : 0) | ((nReg & 8) >> 1) | ((nRm & 8) >> 3);
+
+	if (nPrefix)
+		jit_byte(pJit, nPrefix);
+	if (nRex != 0x40)
+		jit_byte(pJit, nRex);
+	if (nOpcode > 0xFF)
+		jit_byte(pJit, nOpcode >> 8);
+	jit_byte(pJit, nOpcode & 0xFF);
+}
+
+// Instruction on a register, or opcode extension, and the memory at nBase + nDisp. nPrefix is the
+// mandatory prefix of SSE instructions, opcodes above 0xFF are two bytes.
+static void jit_mem(Jit *pJit, int nPrefix, bool bWide, int nOpcode, int nReg, int nBase, int32_t nDisp)
+{
+	jit_opcode(pJit, nPrefix, bWide, nOpcode, nReg, nBase);
+	jit_byte(pJit, 0x80 | (nReg & 7) << 3 | (nBase & 7));
+	if ((nBase & 7) == RSP)
+		jit_byte(pJit, 0x24);
+	jit_u32(pJit, (uint32_t)nDisp);
+}
+
+// Instruction on two registers.
+static void jit_reg(Jit *pJit, int nPrefix, bool bWide, int nOpcode, int nReg, int nRm)
+{
+	jit_opcode(pJit, nPrefix, bWide, nOpcode, nReg, nRm);
+	jit_byte(pJit, 0xC0 | (nReg & 7) << 3 | (nRm & 7));
+}
+
+// Instruction on a register and register r of the frame.
+static void jit_frame(Jit *pJit, int nPrefix, bool bWide, int nOpcode, int nReg, int r)
+{
+	jit_mem(pJit, nPrefix, bWide, nOpcode, nReg, RBX, 8 * r);
+}
+
+static void jit_load(Jit *pJit, bool bWide, int nReg, int r)
+{
+	jit_frame(pJit, 0, bWide, 0x8B, nReg, r);
+}
+
+static void jit_store(Jit *pJit, bool bWide, int nReg, int r)
+{
+	jit_frame(pJit, 0, bWide, 0x89, nReg, r);
+}
+
+static void jit_movabs(Jit *pJit, int nReg, uint64_t n)
+{
+	jit_byte(pJit, 0x48 | (nReg & 8) >> 3);
+	jit_byte(pJit, 0xB8 | (nReg & 7));
+	jit_u64(pJit, n);
+}
+
+// Address of nCells past the one nBase points at.
+static void jit_cell(Jit *pJit, int nReg, int nBase, int nCells)
+{
+	if (nCells < (1 << 28))
+		jit_mem(pJit, 0, true, 0x8D, nReg, nBase, 8 * nCells);		// lea
+	else{
+		jit_movabs(pJit, nReg, 8 * (uint64_t)nCells);
+		jit_reg(pJit, 0, true, 0x01, nBase, nReg);					// add
+	}
+}
+
+// Call a C function, the stack is aligned to 16 bytes all through the code.
+static void jit_call_c(Jit *pJit, uint64_t nFunc)
+{
+	jit_movabs(pJit, RAX, nFunc);
+	jit_byte(pJit, 0xFF);
+	jit_byte(pJit, 0xD0);
+}
+
+// Jump, nCc < 0 for an unconditional one, to instruction nTarget of the function.
+static void jit_jump(Jit *pJit, int nCc, int nTarget)
+{
+	if (nCc < 0)
+		jit_byte(pJit, 0xE9);
+	else{
+		jit_byte(pJit, 0x0F);
+		jit_byte(pJit, 0x80 | nCc);
+	}
+	pJit->pPatches[pJit->nPatches].nAt = pJit->n;
+	pJit->pPatches[pJit->nPatches++].nTarget = nTarget;
+	jit_u32(pJit, 0);
+}
+
+// Short forward jump over an error path or the other arm of a choice, return where jit_land() finishes it.
+static size_t jit_skip(Jit *pJit, int nCc)
+{
+	jit_byte(pJit, (nCc < 0) ? 0xEB : 0x70 | nCc);
+	jit_byte(pJit, 0);
+	return pJit->n;
+}
+
+static void jit_land(Jit *pJit, size_t nAt)
+{
+	pJit->p[nAt - 1] = (uint8_t)(pJit->n - nAt);
+}
+
+// Call function p->b, which has machine code or is nFunc being compiled, without jit_call(). rdi and rsi
+// hold its frame and its local arrays, the stacks are checked like call_function() does.
+static void jit_direct_call(Jit *pJit, const BcInst *p, int nFunc)
+{
+	const BcFunction *pCallee = &g_pProgram->pFuncs[p->b];
+	size_t nRegsAt, nArraysAt = 0, nOk;
+
+	jit_cell(pJit, RAX, RDI, pCallee->nRegs);
+	jit_movabs(pJit, RCX, JIT_ADDR(g_pStackEnd));
+	jit_reg(pJit, 0, true, 0x39, RCX, RAX);						// cmp rax, rcx
+	nRegsAt = jit_skip(pJit, CC_A);
+	if (pCallee->nArrayCells){
+		jit_cell(pJit, RAX, RSI, pCallee->nArrayCells);
+		jit_movabs(pJit, RCX, JIT_ADDR(g_pArrayEnd));
+		jit_reg(pJit, 0, true, 0x39, RCX, RAX);
+		nArraysAt = jit_skip(pJit, CC_A);
+	}
+	jit_movabs(pJit, RCX, JIT_ADDR(g_pCStack - g_nCStack));
+	jit_reg(pJit, 0, true, 0x39, RCX, RSP);						// cmp rsp, rcx
+	nOk = jit_skip(pJit, CC_AE);
+	jit_land(pJit, nRegsAt);
+	if (nArraysAt)
+		jit_land(pJit, nArraysAt);
+	jit_movabs(pJit, RDI, JIT_ADDR(p));
+	jit_call_c(pJit, JIT_ADDR(jit_stack_error));
+	jit_land(pJit, nOk);
+	if (p->b == nFunc){
+		jit_byte(pJit, 0xE8);										// call rel32 to the prologue
+		jit_u32(pJit, (uint32_t)-(int32_t)(pJit->n + 4));
+	}
+	else
+		jit_call_c(pJit, JIT_ADDR(g_ppJitCode[p->b]));
+}
+
+// setcc on the low byte of nReg.
+static void jit_setcc(Jit *pJit, int nCc, int nReg)
+{
+	jit_reg(pJit, 0, false, 0x0F90 | nCc, 0, nReg);
+}
+
+static void jit_int_op(Jit *pJit, const BcInst *p, int nOpcode)
+{
+	jit_load(pJit, false, RAX, p->b);
+	jit_frame(pJit, 0, false, nOpcode, RAX, p->c);
+	jit_store(pJit, false, RAX, p->a);
+}
+
+static void jit_real_op(Jit *pJit, const BcInst *p, int nOpcode)
+{
+	jit_frame(pJit, 0xF2, false, 0x0F10, 0, p->b);				// movsd
+	jit_frame(pJit, 0xF2, false, nOpcode, 0, p->c);
+	jit_frame(pJit, 0xF2, false, 0x0F11, 0, p->a);
+}
+
+// Division by -1 is negation, and the remainder 0, so INT_MIN / -1 does not trap.
+static void jit_divide(Jit *pJit, const BcInst *p)
+{
+	size_t nAt, nNegate, nDone;
+
+	jit_load(pJit, false, RCX, p->c);
+	jit_reg(pJit, 0, false, 0x85, RCX, RCX);					// test
+	nAt = jit_skip(pJit, CC_NE);
+	jit_movabs(pJit, RDI, JIT_ADDR(p));
+	jit_call_c(pJit, JIT_ADDR(jit_division_error));
+	jit_land(pJit, nAt);
+	jit_load(pJit, false, RAX, p->b);
+	jit_reg(pJit, 0, false, 0x83, 7, RCX);						// cmp ecx, -1
+	jit_byte(pJit, 0xFF);
+	nNegate = jit_skip(pJit, CC_E);
+	jit_byte(pJit, 0x99);										// cdq
+	jit_reg(pJit, 0, false, 0xF7, 7, RCX);						// idiv ecx
+	jit_store(pJit, false, (p->nOp == kBcDivInt) ? RAX : RDX, p->a);
+	nDone = jit_skip(pJit, -1);
+	jit_land(pJit, nNegate);
+	if (p->nOp == kBcDivInt){
+		jit_reg(pJit, 0, false, 0xF7, 3, RAX);					// neg eax
+		jit_store(pJit, false, RAX, p->a);
+	}
+	else{
+		jit_frame(pJit, 0, false, 0xC7, 0, p->a);				// mov dword, 0
+		jit_u32(pJit, 0);
+	}
+	jit_land(pJit, nDone);
+}
+
+// Compare two reals for a condition of k_pJitRealCc, or set eq and ne, which need the parity flag too
+// and are not fused with a jump. ucomisd compares like unsigned ints, unordered is below or equal.
+static void jit_real_compare(Jit *pJit, const BcInst *p)
+{
+	bool bSwap = (p->nOp == kBcLtReal || p->nOp == kBcLeReal);
+
+	jit_frame(pJit, 0xF2, false, 0x0F10, 0, bSwap ? p->c : p->b);		// movsd
+	jit_frame(pJit, 0x66, false, 0x0F2E, 0, bSwap ? p->b : p->c);		// ucomisd
+	if (p->nOp == kBcEqReal || p->nOp == kBcNeReal){
+		jit_setcc(pJit, (p->nOp == kBcEqReal) ? CC_E : CC_NE, RAX);
+		jit_setcc(pJit, (p->nOp == kBcEqReal) ? 0xB : 0xA, RCX);			// setnp, setp
+		jit_reg(pJit, 0, false, (p->nOp == kBcEqReal) ? 0x20 : 0x08, RCX, RAX);	// and al, cl or or al, cl
+	}
+}
+
+// Encode the instruction p, which is instruction i of a function of nInsts. Return how many
+// instructions it took: a compare followed by a conditional jump on its result is one branch.
+static int jit_inst(Jit *pJit, int nFunc, const BcInst *p, int i, int nInsts, const bool *pTargets)
+{
+	const BcFunction *pFunc = &g_pProgram->pFuncs[nFunc];
+	const BcInst *pNext = p + 1;
+	size_t nAt;
+	int nCc;
+
+	switch(p->nOp){
+	case kBcNop:
+		break;
+	case kBcHalt:
+	case kBcReturnVoid:
+		jit_jump(pJit, -1, nInsts);
+		break;
+	case kBcReturn:
+		jit_load(pJit, true, RAX, p->a);
+		jit_store(pJit, true, RAX, 0);
+		jit_jump(pJit, -1, nInsts);
+		break;
+	case kBcMove:
+		jit_load(pJit, true, RAX, p->b);
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcLoadInt:
+		jit_frame(pJit, 0, true, 0xC7, 0, p->a);					// mov qword, imm32
+		jit_u32(pJit, (uint32_t)p->imm);
+		break;
+	case kBcLoadReal:
+		jit_movabs(pJit, RAX, JIT_ADDR(&g_pProgram->pReals[p->imm]));
+		jit_mem(pJit, 0, true, 0x8B, RAX, RAX, 0);
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcLoadStr:
+		jit_movabs(pJit, RAX, JIT_ADDR(g_pProgram->pStrings + p->imm));
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcGetGlobal:
+		jit_movabs(pJit, RAX, JIT_ADDR(&g_pGlobals[p->imm]));
+		jit_mem(pJit, 0, true, 0x8B, RAX, RAX, 0);
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcSetGlobal:
+		jit_movabs(pJit, RCX, JIT_ADDR(&g_pGlobals[p->imm]));
+		jit_load(pJit, true, RAX, p->a);
+		jit_mem(pJit, 0, true, 0x89, RAX, RCX, 0);
+		break;
+	case kBcLocalArray:
+		jit_cell(pJit, RAX, R13, p->imm);
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcGlobalArray:
+		jit_movabs(pJit, RAX, JIT_ADDR(g_pGlobalCells + p->imm));
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcClearArray:
+		jit_load(pJit, true, RDI, p->a);
+		jit_byte(pJit, 0xB9);										// mov ecx, imm32
+		jit_u32(pJit, (uint32_t)p->imm);
+		jit_reg(pJit, 0, false, 0x31, RAX, RAX);					// xor
+		jit_byte(pJit, 0xF3);										// rep stosq
+		jit_byte(pJit, 0x48);
+		jit_byte(pJit, 0xAB);
+		break;
+	case kBcCheckIndex:
+		jit_frame(pJit, 0, false, 0x81, 7, p->a);					// cmp dword, imm32
+		jit_u32(pJit, (uint32_t)p->imm);
+		nAt = jit_skip(pJit, CC_B);
+		jit_movabs(pJit, RDI, JIT_ADDR(p));
+		jit_load(pJit, false, RSI, p->a);
+		jit_call_c(pJit, JIT_ADDR(jit_index_error));
+		jit_land(pJit, nAt);
+		break;
+	case kBcLoadElem:
+		jit_load(pJit, true, RAX, p->b);
+		jit_frame(pJit, 0, true, 0x63, RCX, p->c);					// movsxd
+		jit_byte(pJit, 0x48);										// mov rax, [rax + rcx * 8]
+		jit_byte(pJit, 0x8B);
+		jit_byte(pJit, 0x04);
+		jit_byte(pJit, 0xC8);
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcStoreElem:
+		jit_load(pJit, true, RAX, p->a);
+		jit_frame(pJit, 0, true, 0x63, RCX, p->b);
+		jit_load(pJit, true, RDX, p->c);
+		jit_byte(pJit, 0x48);										// mov [rax + rcx * 8], rdx
+		jit_byte(pJit, 0x89);
+		jit_byte(pJit, 0x14);
+		jit_byte(pJit, 0xC8);
+		break;
+	case kBcAddInt:		jit_int_op(pJit, p, 0x03);		break;
+	case kBcSubInt:		jit_int_op(pJit, p, 0x2B);		break;
+	case kBcMulInt:		jit_int_op(pJit, p, 0x0FAF);	break;
+	case kBcAnd:		jit_int_op(pJit, p, 0x23);		break;
+	case kBcOr:			jit_int_op(pJit, p, 0x0B);		break;
+	case kBcDivInt:
+	case kBcModInt:
+		jit_divide(pJit, p);
+		break;
+	case kBcNegInt:
+		jit_load(pJit, false, RAX, p->b);
+		jit_reg(pJit, 0, false, 0xF7, 3, RAX);
+		jit_store(pJit, false, RAX, p->a);
+		break;
+	case kBcAddIntK:
+		jit_load(pJit, false, RAX, p->b);
+		jit_byte(pJit, 0x05);										// add eax, imm32
+		jit_u32(pJit, (uint32_t)(int32_t)(int16_t)p->c);
+		jit_store(pJit, false, RAX, p->a);
+		break;
+	case kBcAddReal:	jit_real_op(pJit, p, 0x0F58);	break;
+	case kBcSubReal:	jit_real_op(pJit, p, 0x0F5C);	break;
+	case kBcMulReal:	jit_real_op(pJit, p, 0x0F59);	break;
+	case kBcDivReal:	jit_real_op(pJit, p, 0x0F5E);	break;
+	case kBcNegReal:
+		jit_load(pJit, true, RAX, p->b);
+		jit_reg(pJit, 0, true, 0x0FBA, 7, RAX);					// btc rax, 63
+		jit_byte(pJit, 63);
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcIntToReal:
+		jit_reg(pJit, 0x66, false, 0x0FEF, 0, 0);					// pxor
+		jit_frame(pJit, 0xF2, false, 0x0F2A, 0, p->b);				// cvtsi2sd
+		jit_frame(pJit, 0xF2, false, 0x0F11, 0, p->a);
+		break;
+	case kBcLtInt: case kBcLeInt: case kBcEqInt: case kBcGeInt: case kBcGtInt: case kBcNeInt:
+	case kBcLtReal: case kBcLeReal: case kBcEqReal: case kBcGeReal: case kBcGtReal: case kBcNeReal:
+		if (p->nOp <= kBcNeInt){
+			nCc = k_pJitIntCc[p->nOp - kBcLtInt];
+			jit_load(pJit, false, RAX, p->b);
+			jit_frame(pJit, 0, false, 0x3B, RAX, p->c);				// cmp
+			jit_setcc(pJit, nCc, RAX);
+		}
+		else{
+			nCc = k_pJitRealCc[p->nOp - kBcLtReal];
+			jit_real_compare(pJit, p);
+			if (nCc >= 0)
+				jit_setcc(pJit, nCc, RAX);
+		}
+		jit_reg(pJit, 0, false, 0x0FB6, RAX, RAX);					// movzx eax, al
+		jit_store(pJit, false, RAX, p->a);
+		// The result is still stored, the flags are left for a conditional jump on it.
+		if (nCc >= 0 && i + 1 < nInsts && !pTargets[i + 1] && pNext->a == p->a
+		 && (pNext->nOp == kBcJumpTrue || pNext->nOp == kBcJumpFalse)){
+			jit_jump(pJit, (pNext->nOp == kBcJumpTrue) ? nCc : nCc ^ 1, i + 2 + pNext->imm);
+			return 2;
+		}
+		break;
+	case kBcNot:
+		jit_reg(pJit, 0, false, 0x31, RAX, RAX);
+		jit_frame(pJit, 0, false, 0x83, 7, p->b);					// cmp dword, 0
+		jit_byte(pJit, 0);
+		jit_setcc(pJit, CC_E, RAX);
+		jit_store(pJit, false, RAX, p->a);
+		break;
+	case kBcConcat:
+		jit_load(pJit, true, RDI, p->b);
+		jit_load(pJit, true, RSI, p->c);
+		jit_call_c(pJit, JIT_ADDR(concat));
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	case kBcJump:
+		jit_jump(pJit, -1, i + 1 + p->imm);
+		break;
+	case kBcJumpTrue:
+	case kBcJumpFalse:
+		jit_frame(pJit, 0, false, 0x83, 7, p->a);
+		jit_byte(pJit, 0);
+		jit_jump(pJit, (p->nOp == kBcJumpTrue) ? CC_NE : CC_E, i + 1 + p->imm);
+		break;
+	case kBcCall:
+		jit_mem(pJit, 0, true, 0x8D, RDI, RBX, 8 * p->a);			// lea
+		jit_cell(pJit, RSI, R13, pFunc->nArrayCells);
+		if (p->b == nFunc || g_ppJitCode[p->b])
+			jit_direct_call(pJit, p, nFunc);
+		else{
+			jit_movabs(pJit, RDX, JIT_ADDR(p));
+			jit_call_c(pJit, JIT_ADDR(jit_call));
+		}
+		break;
+	case kBcPrintInt:
+	case kBcPrintBool:
+		jit_load(pJit, false, RDI, p->a);
+		jit_call_c(pJit, (p->nOp == kBcPrintInt) ? JIT_ADDR(print_int) : JIT_ADDR(print_bool));
+		break;
+	case kBcPrintReal:
+		jit_frame(pJit, 0xF2, false, 0x0F10, 0, p->a);
+		jit_call_c(pJit, JIT_ADDR(print_real));
+		break;
+	case kBcPrintStr:
+		jit_load(pJit, true, RDI, p->a);
+		jit_call_c(pJit, JIT_ADDR(print_str));
+		break;
+	case kBcReadInt:
+	case kBcReadBool:
+		jit_movabs(pJit, RDI, JIT_ADDR(p));
+		jit_call_c(pJit, (p->nOp == kBcReadInt) ? JIT_ADDR(read_int) : JIT_ADDR(read_bool));
+		jit_store(pJit, false, RAX, p->a);
+		break;
+	case kBcReadReal:
+		jit_movabs(pJit, RDI, JIT_ADDR(p));
+		jit_call_c(pJit, JIT_ADDR(read_real));
+		jit_frame(pJit, 0xF2, false, 0x0F11, 0, p->a);
+		break;
+	case kBcReadStr:
+		jit_movabs(pJit, RDI, JIT_ADDR(p));
+		jit_call_c(pJit, JIT_ADDR(read_str));
+		jit_store(pJit, true, RAX, p->a);
+		break;
+	}
+	return 1;
+}
+
+// Compile function nFunc. Return false if there is no memory for it, it is interpreted then.
+static bool jit_compile(int nFunc)
+{
+	const Program *pProg = g_pProgram;
+	const BcFunction *pFunc = &pProg->pFuncs[nFunc];
+	int nEnd = (nFunc + 1 < pProg->oHeader.nFuncs) ? pProg->pFuncs[nFunc + 1].nEntry : pProg->oHeader.nInsts;
+	int nInsts = nEnd - pFunc->nEntry, i, k;
+	const BcInst *pCode = pProg->pCode + pFunc->nEntry, *p;
+	size_t nPage = (size_t)sysconf(_SC_PAGESIZE), nMapped;
+	bool *pTargets;
+	void *pMem = MAP_FAILED;
+	Jit oJit;
+
+	oJit.p = (uint8_t *)malloc((size_t)nInsts * JIT_INST_BYTES + JIT_FRAME_BYTES);
+	oJit.n = 0;
+	oJit.pOffsets = (size_t *)malloc((nInsts + 1) * sizeof(size_t));
+	oJit.pPatches = (JitPatch *)malloc(nInsts * sizeof(JitPatch));
+	oJit.nPatches = 0;
+	pTargets = (bool *)calloc(nInsts + 1, sizeof(bool));
+	if (!oJit.p || !oJit.pOffsets || !oJit.pPatches || !pTargets)
+		goto done;
+	// Instructions jumped to do not fuse with the compare before them.
+	for(i = 0; i < nInsts; i++){
+		p = &pCode[i];
+		if (p->nOp == kBcJump || p->nOp == kBcJumpTrue || p->nOp == kBcJumpFalse)
+			pTargets[i + 1 + p->imm] = true;
+	}
+
+	// push rbx, push r13, sub rsp, 8, mov rbx, rdi, mov r13, rsi
+	jit_byte(&oJit, 0x53);
+	jit_byte(&oJit, 0x41);
+	jit_byte(&oJit, 0x55);
+	jit_reg(&oJit, 0, true, 0x83, 5, RSP);
+	jit_byte(&oJit, 8);
+	jit_reg(&oJit, 0, true, 0x89, RDI, RBX);
+	jit_reg(&oJit, 0, true, 0x89, RSI, R13);
+	for(i = 0; i < nInsts; i += k){
+		oJit.pOffsets[i] = oJit.n;
+		k = jit_inst(&oJit, nFunc, &pCode[i], i, nInsts, pTargets);
+		if (k == 2)
+			oJit.pOffsets[i + 1] = oJit.n;
+	}
+	// add rsp, 8, pop r13, pop rbx, ret
+	oJit.pOffsets[nInsts] = oJit.n;
+	jit_reg(&oJit, 0, true, 0x83, 0, RSP);
+	jit_byte(&oJit, 8);
+	jit_byte(&oJit, 0x41);
+	jit_byte(&oJit, 0x5D);
+	jit_byte(&oJit, 0x5B);
+	jit_byte(&oJit, 0xC3);
+	for(i = 0; i < oJit.nPatches; i++){
+		int32_t nRel = (int32_t)(oJit.pOffsets[oJit.pPatches[i].nTarget] - (oJit.pPatches[i].nAt + 4));
+		memcpy(oJit.p + oJit.pPatches[i].nAt, &nRel, sizeof(nRel));
+	}
+
+	nMapped = (oJit.n + nPage - 1) & ~(nPage - 1);
+	pMem = mmap(NULL, nMapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pMem != MAP_FAILED){
+		memcpy(pMem, oJit.p, oJit.n);
+		if (mprotect(pMem, nMapped, PROT_READ | PROT_EXEC) == 0){
+			g_ppJitCode[nFunc] = (JitCode)pMem;
+			g_pJitBytes[nFunc] = nMapped;
+		}
+		else{
+			munmap(pMem, nMapped);
+			pMem = MAP_FAILED;
+		}
+	}
+done:
+	free(oJit.p);
+	free(oJit.pOffsets);
+	free(oJit.pPatches);
+	free(pTargets);
+	return pMem != MAP_FAILED;
+}
+
+static void jit_release()
+{
+	for(int j = 0; g_ppJitCode && j < g_pProgram->oHeader.nFuncs; j++){
+		if (g_ppJitCode[j])
+			munmap((void *)g_ppJitCode[j], g_pJitBytes[j]);
+	}
+	free(g_ppJitCode);
+	free(g_pJitBytes);
+	free(g_pJitCalls);
+	g_ppJitCode = NULL;
+	g_pJitBytes = NULL;
+	g_pJitCalls = NULL;
+}
+
+// ----------------------------------------------------------------
+// Running a program
+// ----------------------------------------------------------------
+
+static int run(const Program *pProg)
+{
+	const BcFunction *pBody = pProg->pFuncs;
+	BcValue *pStack, *pArrayStack;
+	Frame *pFrames;
+	struct rlimit oLimit;
+	int nFuncs = pProg->oHeader.nFuncs;
+
+	// calloc() leaves the pages untouched until a deep call reaches them.
+	pStack = (BcValue *)calloc(PVM_STACK_REGS, sizeof(BcValue));
+	pArrayStack = (BcValue *)calloc(PVM_STACK_CELLS, sizeof(BcValue));
+	pFrames = (Frame *)calloc(PVM_MAX_DEPTH, sizeof(Frame));
+	g_pGlobals = (BcValue *)calloc(pProg->oHeader.nGlobals + 1, sizeof(BcValue));
+	g_pGlobalCells = (BcValue *)calloc(pProg->oHeader.nGlobalCells + 1, sizeof(BcValue));
+	g_ppJitCode = (JitCode *)calloc(nFuncs, sizeof(JitCode));
+	g_pJitBytes = (size_t *)calloc(nFuncs, sizeof(size_t));
+	g_pJitCalls = (uint32_t *)calloc(nFuncs, sizeof(uint32_t));
+	if (!pStack || !pArrayStack || !pFrames || !g_pGlobals || !g_pGlobalCells || !g_ppJitCode || !g_pJitBytes || !g_pJitCalls){
+		fprintf(stderr, "pvm: out of memory\n");
+		return 1;
+	}
+	g_pStackEnd = pStack + PVM_STACK_REGS;
+	g_pArrayEnd = pArrayStack + PVM_STACK_CELLS;
+	g_pFrame = pFrames;
+	g_pFrameEnd = pFrames + PVM_MAX_DEPTH;
+	g_pCStack = (char *)__builtin_frame_address(0);
+	g_nCStack = PVM_C_STACK_MAX;
+	if (getrlimit(RLIMIT_STACK, &oLimit) == 0 && oLimit.rlim_cur != RLIM_INFINITY && oLimit.rlim_cur < PVM_C_STACK_MAX)
+		g_nCStack = (oLimit.rlim_cur > 2 * PVM_C_STACK_SPARE) ? oLimit.rlim_cur - PVM_C_STACK_SPARE : oLimit.rlim_cur / 2;
+	if (pBody->nRegs > PVM_STACK_REGS || pBody->nArrayCells > PVM_STACK_CELLS)
+		runtime_error(pProg->pCode, "stack overflow");
+
+	if (g_nJitThreshold && jit_hot(0))
+		g_ppJitCode[0](pStack, pArrayStack);
+	else
+		interpret(pBody, pStack, pArrayStack);
+	fflush(stdout);
+	jit_release();
+	free(pStack);
+	free(pArrayStack);
+	free(pFrames);
+	free(g_pGlobals);
+	free(g_pGlobalCells);
+	return 0;
+}
+
+static void usage()
+{
+	fprintf(stderr, "Usage: ./pvm [--jit] [--jit-threshold <calls>] <bytecode file from parser --emit-bytecode>\n");
+	exit(-1);
+}
+
+int main(int argc, const char *argv[])
+{
+	static char s_pOutBuf[1 << 16];
+	Program oProgram;
+	int nRet, i;
+
+	for(i = 1; i < argc - 1; i++){
+		if (strcmp(argv[i], "--jit") == 0)
+			g_nJitThreshold = g_nJitThreshold ? g_nJitThreshold : PVM_JIT_THRESHOLD;
+		else if (strcmp(argv[i], "--jit-threshold") == 0 && i + 2 < argc && atoi(argv[i + 1]) > 0)
+			g_nJitThreshold = atoi(argv[++i]);
+		else
+			usage();
+	}
+	if (argc < 2 || argv[argc - 1][0] == '-')
+		usage();
+	memset(&oProgram, 0, sizeof(oProgram));
+	if (!load_program(argv[argc - 1], &oProgram)){
+		release_program(&oProgram);
+		exit(-1);
+	}
+	g_pProgram = &oProgram;
+	setvbuf(stdout, s_pOutBuf, _IOFBF, sizeof(s_pOutBuf));
+	nRet = run(&oProgram);
+	release_program(&oProgram);
+	return nRet;
+}
@@ -0,0 +1,31 @@
+//&S-
+//&T-
+
+recovery;
+
+// syntax errors the parser recovers from, followed by the semantic checks on what is left
+
+var a: integer;
+var b c: integer;
+var d: real;
+
+broken(x: integer: integer
+begin
+  x := x + ;
+end
+end
+
+sum(x, y: integer): integer
+begin
+  return x + y;
+end
+end
+
+begin
+  a := 1 +;
+  d := sum(a, 2);
+  print undeclared;
+  a := sum(a);
+  c := 3;
+end
+end
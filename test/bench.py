@@ -0,0 +1,220 @@
+#!/usr/bin/python3
+
+import subprocess
+import os
+import sys
+import time
+from argparse import ArgumentParser
+
+class Bench:
+
+    output_dir = "result"
+
+    def __init__(self, parser, symbols, depth, options, incremental):
+        self.parser = parser
+        self.incremental = incremental
+        self.options = options
+        self.symbols = symbols
+        self.depth = depth
+
+        if not os.path.exists(self.output_dir):
+            os.makedirs(self.output_dir)
+
+    # Half of the symbols are globals declared on one long line each in groups, the other half are
+    # locals of functions, and one function nests compound statements deeper than the old stack cap.
+    def gen_program(self, path):
+        n_globals = self.symbols // 2
+        n_funcs = max(1, self.symbols // 2000)
+        n_locals = (self.symbols - n_globals) // n_funcs
+
+        with open(path, "w") as out:
+            out.write("//&S-\n//&T-\n//&D-\n\nbench;\n\n")
+            for i in range(0, n_globals, 100):
+                names = ", ".join("g%d" % j for j in range(i, min(i + 100, n_globals)))
+                out.write("var %s: integer;\n" % names)
+            for f in range(n_funcs):
+                out.write("\nf%d(a%d: integer): integer\nbegin\n" % (f, f))
+                for i in range(n_locals):
+                    out.write("    var l%d: real;\n" % i)
+                out.write("    l0 := a%d + g0;\n    return a%d;\nend\nend\n" % (f, f))
+            out.write("\nnest()\nbegin\n")
+            for d in range(self.depth):
+                out.write("begin var n%d: integer;\n" % d)
+            for d in range(self.depth):
+                out.write("end\n")
+            out.write("end\nend\n\nbegin\nend\nend\n")
+
+    def run_parser(self, program):
+        start = time.time()
+        proc = subprocess.run([self.parser, program] + self.options, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+        elapsed = time.time() - start
+
+        if proc.returncode != 0:
+            print("ERROR: %s exited with %d" % (self.parser, proc.returncode))
+            print(str(proc.stderr, "utf-8", "replace")[-2000:])
+            return None
+        return elapsed
+
+    def run(self):
+        program = "%s/bench_%d.p" % (self.output_dir, self.symbols)
+        self.gen_program(program)
+        size = os.path.getsize(program)
+
+        # With --incremental the first run fills the cache and the timed run reuses it.
+        if self.incremental:
+            cache = "%s/bench_%d.inc" % (self.output_dir, self.symbols)
+            if os.path.exists(cache):
+                os.remove(cache)
+            self.options = self.options + ["--incremental", cache]
+            cold = self.run_parser(program)
+            if cold is None:
+                return False
+            print("---\tcold cache\t%.3f s" % cold)
+
+        elapsed = self.run_parser(program)
+        if elapsed is None:
+            return False
+
+        print("---\tsymbols\t\t%d" % self.symbols)
+        print("---\tnesting\t\t%d" % self.depth)
+        print("---\tinput\t\t%.1f MB" % (size / 1e6))
+        print("---\ttime\t\t%.3f s" % elapsed)
+        print("---\tthroughput\t%.0f symbols/s, %.1f MB/s" % (self.symbols / elapsed, size / 1e6 / elapsed))
+        return True
+
+# Many small programs, compiled one process each and then all in one --batch process.
+def run_batch(parser, n_files, options):
+    out_dir = Bench.output_dir
+    if not os.path.exists(out_dir):
+        os.makedirs(out_dir)
+    files = []
+    for i in range(n_files):
+        path = "%s/unit_%d.p" % (out_dir, i)
+        with open(path, "w") as out:
+            out.write("//&S-\n//&T-\n//&D-\nunit%d;\nvar g: integer;\n" % i)
+            out.write("f(a: integer): integer\nbegin\n    return a + g;\nend\nend\n")
+            out.write("begin\n    var i: integer;\n    i := f(%d);\n    print i;\nend\nend\n" % i)
+        files.append(path)
+    list_path = "%s/units.txt" % out_dir
+    with open(list_path, "w") as out:
+        out.write("\n".join(files) + "\n")
+
+    start = time.time()
+    for path in files:
+        subprocess.run([parser, path] + options, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    separate = time.time() - start
+
+    start = time.time()
+    proc = subprocess.run([parser, list_path, "--batch"] + options, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    batch = time.time() - start
+    if proc.returncode != 0:
+        print("ERROR: %s exited with %d" % (parser, proc.returncode))
+        return False
+
+    print("---\tfiles\t\t%d" % n_files)
+    print("---\tseparate\t%.3f s" % separate)
+    print("---\tbatch\t\t%.3f s" % batch)
+    return True
+
+# A compute-bound program: a sieve over a global array, recursive calls, and real arithmetic on a 2-D array.
+def gen_vm_program(path, size):
+    with open(path, "w") as out:
+        out.write("//&S-\n//&T-\n//&D-\nvmbench;\n")
+        out.write("var flags: array %d of boolean;\nvar m: array 64 of array 64 of real;\n\n" % size)
+        out.write("fib(n: integer): integer\nbegin\n    if n < 2 then\n    begin\n        return n;\n    end\n    end if\n")
+        out.write("    return fib(n - 1) + fib(n - 2);\nend\nend\n\n")
+        out.write("begin\n    var i, j, count: integer;\n    var sum: real;\n")
+        out.write("    for i := 2 to %d do\n    begin\n        if not flags[i] then\n        begin\n" % size)
+        out.write("            count := count + 1;\n            j := i + i;\n")
+        out.write("            while j < %d do\n            begin\n                flags[j] := true;\n                j := j + i;\n" % size)
+        out.write("            end\n            end do\n        end\n        end if\n    end\n    end do\n    print count;\n")
+        out.write("    print fib(%d);\n" % min(30, 16 + size.bit_length()))
+        out.write("    for i := 0 to 64 do\n    begin\n        for j := 0 to 64 do\n        begin\n")
+        out.write("            m[i][j] := i * j / 3.0;\n            sum := sum + m[i][j] - m[j][i] / 2;\n")
+        out.write("        end\n        end do\n    end\n    end do\n    print sum;\nend\nend\n")
+
+def time_run(cmd):
+    start = time.time()
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    elapsed = time.time() - start
+    if proc.returncode != 0:
+        print("ERROR: %s exited with %d" % (" ".join(cmd), proc.returncode))
+        print(str(proc.stderr, "utf-8", "replace")[-2000:])
+        return None, None
+    return elapsed, proc.stdout
+
+# Run one program on the bytecode VM and on the tree-walking interpreter of the parser (--run), their output must agree.
+def run_vm(parser, pvm, size):
+    out_dir = Bench.output_dir
+    if not os.path.exists(out_dir):
+        os.makedirs(out_dir)
+    program = "%s/vm_%d.p" % (out_dir, size)
+    bytecode = "%s/vm_%d.bc" % (out_dir, size)
+    gen_vm_program(program, size)
+
+    compile_time, _ = time_run([parser, program, "--quiet", "--emit-bytecode", bytecode])
+    if compile_time is None:
+        return False
+    vm_time, vm_out = time_run([pvm, bytecode])
+    if vm_time is None:
+        return False
+    print("---	sieve size	%d" % size)
+    print("---	compile		%.3f s" % compile_time)
+    print("---	pvm		%.3f s" % vm_time)
+
+    # pvm compiling hot functions to machine code in memory (--jit), and everything up front, the program body too.
+    for jit in (["--jit"], ["--jit-threshold", "1"]):
+        jit_time, jit_out = time_run([pvm] + jit + [bytecode])
+        if jit_time is None or jit_out != vm_out:
+            print("---	pvm %s	not available, pvm has no --jit or its output differs" % " ".join(jit))
+        else:
+            print("---	pvm %s	%.3f s (%.1fx pvm)" % (" ".join(jit), jit_time, vm_time / jit_time))
+
+    # The same bytecode as x86-64 code, assembled and linked by the system compiler (--native).
+    native = "%s/vm_%d" % (out_dir, size)
+    native_build, _ = time_run([parser, program, "--quiet", "--native", native])
+    native_time, native_out = time_run([native]) if native_build is not None else (None, None)
+    if native_time is None or native_out != vm_out:
+        print("---	native		not available, the parser has no --native or its output differs")
+    else:
+        print("---	native build	%.3f s" % native_build)
+        print("---	native		%.3f s (%.1fx pvm)" % (native_time, vm_time / native_time))
+
+    tree_time, tree_out = time_run([parser, program, "--quiet", "--run"])
+    if tree_time is None:
+        return False
+    # The parser writes its own report first, the program output follows it.
+    if not tree_out.endswith(vm_out):
+        print("ERROR: the output of %s --run differs from pvm" % parser)
+        return False
+    print("---	tree-walking	%.3f s" % tree_time)
+    print("---	speedup		%.1fx" % (tree_time / vm_time))
+    return True
+
+def main():
+    parser = ArgumentParser()
+    parser.add_argument("--parser", help="parser to benchmark", default="../src/parser")
+    parser.add_argument("--symbols", help="number of declared symbols", type=int, default=1000000)
+    parser.add_argument("--depth", help="compound statement nesting depth", type=int, default=300)
+    parser.add_argument("--mmap", help="pass --mmap to the parser", action="store_true")
+    parser.add_argument("--quiet", help="pass --quiet to the parser", action="store_true")
+    parser.add_argument("--dump-ast", help="pass --dump-ast to the parser", action="store_true")
+    parser.add_argument("--jobs", help="pass --jobs to the parser", type=int, default=0)
+    parser.add_argument("--batch", help="compare N small files, one process each, with one --batch run", type=int, default=0)
+    parser.add_argument("--incremental", help="time a second run with the cache of a first one", action="store_true")
+    parser.add_argument("--vm", help="run a compute-bound program of sieve size N on pvm with and without --jit, as native code and on the tree-walking interpreter", type=int, default=0)
+    parser.add_argument("--pvm", help="bytecode VM for --vm", default="../src/pvm")
+    args = parser.parse_args()
+
+    options = [opt for opt, on in [("--mmap", args.mmap), ("--quiet", args.quiet), ("--dump-ast", args.dump_ast)] if on]
+    if args.jobs:
+        options += ["--jobs", str(args.jobs)]
+    if args.batch:
+        sys.exit(0 if run_batch(args.parser, args.batch, options) else 1)
+    if args.vm:
+        sys.exit(0 if run_vm(args.parser, args.pvm, args.vm) else 1)
+    b = Bench(parser = args.parser, symbols = args.symbols, depth = args.depth, options = options, incremental = args.incremental)
+    sys.exit(0 if b.run() else 1)
+
+if __name__ == "__main__":
+    main()
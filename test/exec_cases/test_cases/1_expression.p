@@ -0,0 +1,33 @@
+//&S-
+//&T-
+//&D-
+
+expression;
+
+// arithmetic, comparison and logic on each scalar type, and string concatenation
+
+var limit: 10;
+var ratio: 2.5;
+var name: "pvm";
+
+begin
+  var i: integer;
+  var r: real;
+  var b: boolean;
+  var s: string;
+
+  i := 17;
+  print i / 5;
+  print i mod 5;
+  print -i + limit * 3 - 4;
+  r := i / 2.0 + ratio;
+  print r;
+  print -r;
+  print i < limit;
+  print r >= 11;
+  b := not (i = 17) or i <> limit and r > ratio;
+  print b;
+  s := name + " " + "test";
+  print s;
+end
+end
@@ -0,0 +1,50 @@
+//&S-
+//&T-
+//&D-
+
+control;
+
+// if, while and for statements, also nested
+
+begin
+  var i, j, n: integer;
+
+  n := 0;
+  for i := 1 to 6 do
+  begin
+    if i mod 2 = 0 then
+    begin
+      n := n + i;
+    end
+    else
+    begin
+      n := n - 1;
+    end
+    end if
+  end
+  end do
+  print n;
+
+  i := 1;
+  while i < 100 do
+  begin
+    i := i * 3;
+  end
+  end do
+  print i;
+
+  for i := 0 to 3 do
+  begin
+    for j := 1 to 3 do
+    begin
+      if j > i then
+      begin
+        print i * 10 + j;
+      end
+      end if
+    end
+    end do
+  end
+  end do
+end
+end
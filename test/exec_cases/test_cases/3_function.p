@@ -0,0 +1,69 @@
+//&S-
+//&T-
+//&D-
+
+function;
+
+// recursion, argument conversion, global and local arrays, and falling off the end of a function
+
+var calls: integer;
+var squares: array 8 of integer;
+
+fib(n: integer): integer
+begin
+  calls := calls + 1;
+  if n < 2 then
+  begin
+    return n;
+  end
+  end if
+  return fib(n - 1) + fib(n - 2);
+end
+end
+
+half(x: real): real
+begin
+  return x / 2;
+end
+end
+
+nothing(): real
+begin
+end
+end
+
+fill(n: integer)
+begin
+  var i: integer;
+  i := 0;
+  while i < n do
+  begin
+    squares[i] := i * i;
+    i := i + 1;
+  end
+  end do
+end
+end
+
+begin
+  var grid: array 3 of array 4 of integer;
+  var i, j: integer;
+
+  print fib(15);
+  print calls;
+  print half(7);
+  print nothing();
+  fill(8);
+  print squares[7];
+  for i := 0 to 3 do
+  begin
+    for j := 0 to 4 do
+    begin
+      grid[i][j] := i + j;
+    end
+    end do
+  end
+  end do
+  print grid[2][3] + grid[1][1];
+end
+end
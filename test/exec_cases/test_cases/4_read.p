@@ -0,0 +1,31 @@
+//&S-
+//&T-
+//&D-
+
+input;
+
+// read statements take their values from 4_read.in
+
+begin
+  var n, i: integer;
+  var sum, x: real;
+  var ok: boolean;
+  var word: string;
+
+  read n;
+  sum := 0;
+  i := 0;
+  while i < n do
+  begin
+    read x;
+    sum := sum + x;
+    i := i + 1;
+  end
+  end do
+  print sum;
+  read ok;
+  print not ok;
+  read word;
+  print word + "!";
+end
+end
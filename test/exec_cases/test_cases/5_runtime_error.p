@@ -0,0 +1,25 @@
+//&S-
+//&T-
+//&D-
+
+failure;
+
+// output stops at the runtime error, which ends the run with a failure
+
+divide(a, b: integer): integer
+begin
+  return a / b;
+end
+end
+
+begin
+  var i: integer;
+
+  for i := 0 to 3 do
+  begin
+    print divide(12, 2 - i);
+  end
+  end do
+  print 99;
+end
+end
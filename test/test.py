@@ -20,27 +20,52 @@ class Grader:
         8 : "8_while",
         9 : "9_for",
         10: "10_return",
-        11: "11_call"
+        11: "11_call",
+        12: "12_recovery"
     }
-    basic_case_scores = [0, 5, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9]
+    basic_case_scores = [0, 5, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9]
+
+    # Programs that are run, with <case>.in as their input if there is one. The tree-walking
+    # interpreter (--run) must write <case>.run, and the bytecode on pvm, on pvm compiling
+    # everything to machine code and as a native executable must all write <case>.pvm.
+    exec_case_dir = "./exec_cases"
+    exec_cases = {
+        1 : "1_expression",
+        2 : "2_control",
+        3 : "3_function",
+        4 : "4_read",
+        5 : "5_runtime_error"
+    }
+    exec_case_scores = [0, 4, 4, 4, 4, 4]
+    exec_runners = ["run", "pvm", "jit", "native"]
 
     diff_result = ""
 
-    def __init__(self, parser):
+    def __init__(self, parser, pvm):
         self.parser = parser
+        self.pvm = pvm
 
         self.output_dir = "result"
         if not os.path.exists(self.output_dir):
             os.makedirs(self.output_dir)
 
-    def get_case_id_list(self, basic_id):
-        if basic_id == 0:
+    def get_case_id_list(self, basic_id, exec_id):
+        if basic_id == 0 and exec_id == 0:
             self.basic_id_list = self.basic_cases.keys()
-        else:
+            self.exec_id_list = self.exec_cases.keys()
+            return
+        self.basic_id_list = []
+        self.exec_id_list = []
+        if basic_id != 0:
             if not basic_id in self.basic_cases:
                 print("ERROR: Invalid case ID %d" % basic_id)
                 exit(1)
             self.basic_id_list = [basic_id]
+        if exec_id != 0:
+            if not exec_id in self.exec_cases:
+                print("ERROR: Invalid exec case ID %d" % exec_id)
+                exit(1)
+            self.exec_id_list = [exec_id]
 
     def gen_output(self, case_id):
         test_case = "%s/%s/%s.p" % (self.basic_case_dir, "test_cases", self.basic_cases[case_id])
@@ -77,12 +102,64 @@ class Grader:
             out.write(stdout)
             out.write(stderr)
 
+    # Run one exec case with one runner, its stdout and stderr go to result/<case>.<runner>.
+    def gen_exec_output(self, case_id, runner):
+        name = self.exec_cases[case_id]
+        test_case = "%s/%s/%s.p" % (self.exec_case_dir, "test_cases", name)
+        input_file = "%s/%s/%s.in" % (self.exec_case_dir, "test_cases", name)
+        output_file = "%s/%s.%s" % (self.output_dir, name, runner)
+        bytecode = "%s/%s.bc" % (self.output_dir, name)
+        native = "%s/%s.native" % (self.output_dir, name)
+
+        if runner == "run":
+            clist = [self.parser, test_case, "--quiet", "--run"]
+        elif runner == "native":
+            if subprocess.run([self.parser, test_case, "--quiet", "--native", native], stdout=subprocess.DEVNULL).returncode != 0:
+                return False
+            # Run as "pvm", the name its runtime errors start with.
+            clist = ["pvm"]
+        else:
+            if subprocess.run([self.parser, test_case, "--quiet", "--emit-bytecode", bytecode], stdout=subprocess.DEVNULL).returncode != 0:
+                return False
+            clist = [self.pvm] + (["--jit-threshold", "1"] if runner == "jit" else []) + [bytecode]
+
+        stdin = open(input_file) if os.path.exists(input_file) else subprocess.DEVNULL
+        try:
+            proc = subprocess.run(clist, executable = native if runner == "native" else None,
+                                  stdin=stdin, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        except Exception as e:
+            print("Call of '%s' failed: %s" % (" ".join(clist), e))
+            return False
+        finally:
+            if stdin != subprocess.DEVNULL:
+                stdin.close()
+
+        with open(output_file, "w") as out:
+            out.write(str(proc.stdout, "utf-8", "replace"))
+            out.write(str(proc.stderr, "utf-8", "replace"))
+        return True
+
+    def test_exec_case(self, case_id):
+        ok = True
+        for runner in self.exec_runners:
+            name = "%s.%s" % (self.exec_cases[case_id], runner)
+            output_file = "%s/%s" % (self.output_dir, name)
+            solution = "%s/%s/%s.%s" % (self.exec_case_dir, "sample_solutions", self.exec_cases[case_id], "run" if runner == "run" else "pvm")
+            if not self.gen_exec_output(case_id, runner):
+                self.diff_result += "{}\nnot compiled\n".format(name)
+                ok = False
+            elif not self.diff_output(name, output_file, solution):
+                ok = False
+        return ok
+
     def test_sample_case(self, case_id):
         self.gen_output(case_id)
 
         output_file = "%s/%s" % (self.output_dir, self.basic_cases[case_id])
         solution = "%s/%s/%s" % (self.basic_case_dir, "sample_solutions", self.basic_cases[case_id])
+        return self.diff_output(self.basic_cases[case_id], output_file, solution)
 
+    def diff_output(self, name, output_file, solution):
         clist = ["diff", "-Z", "-u", output_file, solution, f'--label="your output:({output_file})"', f'--label="answer:({solution})"']
         cmd = " ".join(clist)
         try:
@@ -96,7 +173,7 @@ class Grader:
         output = str(proc.stdout.read(), "utf-8")
         retcode = proc.wait()
         if retcode != 0:
-          self.diff_result += "{}\n".format(self.basic_cases[case_id])
+          self.diff_result += "{}\n".format(name)
           self.diff_result += "{}\n".format(output)
 
         return retcode == 0
@@ -117,6 +194,16 @@ class Grader:
             total_score += get_val
             max_score += max_val
 
+        for e_id in self.exec_id_list:
+            c_name = self.exec_cases[e_id]
+            print("+++ TESTING exec case %s:" % c_name)
+            ok = self.test_exec_case(e_id)
+            max_val = self.exec_case_scores[e_id]
+            get_val = max_val if ok else 0
+            print("---\t%s\t%d/%d" % (c_name, get_val, max_val))
+            total_score += get_val
+            max_score += max_val
+
         print("---\tTOTAL\t\t%d/%d" % (total_score, max_score))
 
         with open("{}/{}".format(self.output_dir, "score.txt"), "w") as result:
@@ -129,11 +216,13 @@ class Grader:
 def main():
     parser = ArgumentParser()
     parser.add_argument("--parser", help="parser to grade", default="../src/parser")
+    parser.add_argument("--pvm", help="bytecode VM to run the exec cases on", default="../src/pvm")
     parser.add_argument("--basic_case_id", help="test case's ID", type=int, default=0)
+    parser.add_argument("--exec_case_id", help="exec case's ID", type=int, default=0)
     args = parser.parse_args()
 
-    g = Grader(parser = args.parser)
-    g.get_case_id_list(args.basic_case_id)
+    g = Grader(parser = args.parser, pvm = args.pvm)
+    g.get_case_id_list(args.basic_case_id, args.exec_case_id)
     g.run()
 
 if __name__ == "__main__":